@@ -0,0 +1,207 @@
+// Frame buffer allocation under contention, built twice: id3_cache_bench
+// with the default malloc/free allocator and id3_cache_bench_cached with
+// -DID3_FRAME_CACHE.
+//
+//   id3_cache_bench [max threads]
+//
+// For 1, 2, 4, ... up to max threads (default 32) it reports millions of
+// operations per second in two workloads:
+//
+//   parse    each thread takes a parser from id3_parser_acquire(), feeds it
+//            a tag 64 bytes at a time, so that every frame is buffered, and
+//            releases it; an operation is one frame
+//   handoff  threads in pairs: one allocates frame buffers of 32 bytes to
+//            4 KB and passes them through a ring to the other, which frees
+//            them, so every free is on a thread other than the owner; an
+//            operation is one buffer
+//
+// Each figure is the best of five runs. Compare the two builds on a machine
+// with at least as many cores as threads.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "id3v2parser.h"
+#include "synth_tag.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define BENCH_RUNS 5
+#define BENCH_TAGS 16
+#define BENCH_MAX_THREADS 64
+#define PARSE_PASSES 200
+#define HANDOFF_BUFFERS 400000
+#define RING_SIZE 256
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+} Slot;
+
+// Single-producer, single-consumer ring between the threads of a pair
+typedef struct {
+    Slot slots[RING_SIZE];
+    size_t head;               // Next slot to fill, written by the producer
+    size_t tail;               // Next slot to empty, written by the consumer
+} Ring;
+
+typedef struct {
+    Ring *ring;
+    uint64_t ops;
+} Worker;
+
+static uint8_t tags[BENCH_TAGS][16 * 1024];
+static size_t tag_lens[BENCH_TAGS];
+static Ring rings[BENCH_MAX_THREADS / 2];
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    (void)id;
+    (void)data;
+    (void)size;
+    (*(uint64_t *)user_data)++;
+}
+
+static void *parse_worker(void *arg) {
+    Worker *worker = (Worker *)arg;
+    int pass;
+    int t;
+
+    for (pass = 0; pass < PARSE_PASSES; pass++) {
+        for (t = 0; t < BENCH_TAGS; t++) {
+            ID3Parser *parser = id3_parser_acquire(count_frame, &worker->ops);
+            size_t i;
+
+            for (i = 0; i < tag_lens[t]; i += 64) {
+                size_t n = tag_lens[t] - i < 64 ? tag_lens[t] - i : 64;
+
+                if (id3_parser_feed(parser, tags[t] + i, n) != ID3_MORE) {
+                    break;
+                }
+            }
+            id3_parser_release(parser);
+        }
+    }
+    id3_frame_cache_flush();
+    return NULL;
+}
+
+static void *produce(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Ring *ring = worker->ring;
+    uint32_t state = 0x2545F491u;
+    size_t n;
+
+    for (n = 0; n < HANDOFF_BUFFERS; n++) {
+        uint32_t size = 32u << (synth_next(&state) % 8);
+        Slot slot;
+
+        slot.size = size - synth_next(&state) % 16;
+        slot.data = id3_alloc_frame(slot.size);
+        slot.data[0] = (uint8_t)n;
+        while (n - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+            sched_yield();
+        }
+        ring->slots[n % RING_SIZE] = slot;
+        __atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+    }
+    worker->ops = n;
+    id3_frame_cache_flush();
+    return NULL;
+}
+
+static void *consume(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Ring *ring = worker->ring;
+    size_t n;
+
+    for (n = 0; n < HANDOFF_BUFFERS; n++) {
+        Slot slot;
+
+        while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == n) {
+            sched_yield();
+        }
+        slot = ring->slots[n % RING_SIZE];
+        __atomic_store_n(&ring->tail, n + 1, __ATOMIC_RELEASE);
+        id3_free_frame(slot.data, slot.size);
+    }
+    worker->ops = 0;
+    id3_frame_cache_flush();
+    return NULL;
+}
+
+// Millions of operations per second with threads threads, best of runs
+static double run(int handoff, int threads) {
+    double best = 0;
+    int run;
+
+    for (run = 0; run < BENCH_RUNS; run++) {
+        pthread_t ids[BENCH_MAX_THREADS];
+        Worker workers[BENCH_MAX_THREADS];
+        uint64_t ops = 0;
+        double start = now();
+        double rate;
+        int t;
+
+        for (t = 0; t < threads; t++) {
+            rings[t / 2].head = 0;
+            rings[t / 2].tail = 0;
+        }
+        for (t = 0; t < threads; t++) {
+            void *(*body)(void *) = handoff ? (t % 2 ? consume : produce) : parse_worker;
+
+            workers[t].ring = &rings[t / 2];
+            workers[t].ops = 0;
+            pthread_create(&ids[t], NULL, body, &workers[t]);
+        }
+        for (t = 0; t < threads; t++) {
+            pthread_join(ids[t], NULL);
+            ops += workers[t].ops;
+        }
+        rate = ops / (now() - start) * 1e-6;
+        if (rate > best) {
+            best = rate;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 32;
+    int threads;
+    int t;
+
+    if (max_threads < 2 || max_threads > BENCH_MAX_THREADS) {
+        fprintf(stderr, "usage: %s [max threads, 2 to %d]\n", argv[0], BENCH_MAX_THREADS);
+        return 1;
+    }
+    for (t = 0; t < BENCH_TAGS; t++) {
+        SynthTagSpec spec = { (uint8_t)(2 + t % 3), 0, (uint16_t)(10 + t * 3),
+                              t % 4 == 0 ? 3000u : 0u, 0, (uint32_t)t + 1 };
+
+        tag_lens[t] = synth_tag(tags[t], sizeof(tags[t]), &spec);
+    }
+
+#ifdef ID3_FRAME_CACHE
+    printf("per-thread frame cache\n");
+#else
+    printf("malloc/free\n");
+#endif
+    printf("%8s %14s %14s\n", "threads", "parse Mop/s", "handoff Mop/s");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        printf("%8d %14.2f", threads, run(0, threads));
+        if (threads >= 2) {
+            printf(" %14.2f\n", run(1, threads));
+        } else {
+            printf(" %14s\n", "-");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Overhead per frame of the C++20 coroutine adapter against the raw C API.
+//
+//   id3_coroutine_bench [rounds]
+//
+// Each tag is read in 4 KB chunks rounds times (default 2000), summing frame
+// sizes: by id3_parser_feed() with a C callback, by an id3_parser_next()
+// loop, by a coroutine consuming id3::frames() over a memory_source, and
+// the same over a source that suspends on every read and is resumed by a
+// loop standing in for an event loop. Reports the best of five runs in ns
+// per frame.
+
+#include "id3v2parser.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define BENCH_TAG_CAP (512 * 1024)
+#define BENCH_CHUNK 4096
+#define BENCH_RUNS 5
+
+struct BenchTag {
+    const char *name;
+    SynthTagSpec spec;
+};
+
+static const BenchTag bench_tags[] = {
+    { "v2.3 small",   { 3, 0, 12, 0, 1024, 2 } },
+    { "v2.4 picture", { 4, 0, 24, 120 * 1024, 2048, 5 } },
+    { "v2.4 dense",   { 4, 0, 2000, 0, 0, 6 } },
+};
+
+static uint8_t tag[BENCH_TAG_CAP];
+
+static void sum_size(const char *, const uint8_t *, uint32_t size, void *user_data) {
+    *static_cast<uint64_t *>(user_data) += size;
+}
+
+static void count_frame(const char *, const uint8_t *, uint32_t, void *user_data) {
+    ++*static_cast<size_t *>(user_data);
+}
+
+static uint64_t run_callback(const uint8_t *data, size_t len) {
+    ID3Parser parser;
+    uint64_t total = 0;
+
+    id3_parser_init(&parser, sum_size, &total);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        if (id3_parser_feed(&parser, data + off, std::min<size_t>(BENCH_CHUNK, len - off)) != ID3_MORE) {
+            break;
+        }
+    }
+    id3_parser_cleanup(&parser);
+    return total;
+}
+
+static uint64_t run_next(const uint8_t *data, size_t len) {
+    ID3Parser parser;
+    uint64_t total = 0;
+
+    id3_parser_init(&parser, NULL, NULL);
+    for (size_t off = 0; off < len;) {
+        size_t chunk = std::min<size_t>(BENCH_CHUNK, len - off);
+        ID3FrameView frame;
+        size_t used;
+        int result;
+
+        while ((result = id3_parser_next(&parser, data + off, chunk, &used, &frame)) == ID3_FRAME) {
+            total += frame.size;
+            off += used;
+            chunk -= used;
+        }
+        if (result != ID3_MORE) {
+            break;
+        }
+        off += chunk;
+    }
+    id3_parser_cleanup(&parser);
+    return total;
+}
+
+// Memory source that suspends before every read
+class suspending_source {
+public:
+    struct read_awaiter {
+        suspending_source *source;
+        uint8_t *buffer;
+        size_t cap;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> waiting) const noexcept { source->pending = waiting; }
+        size_t await_resume() const noexcept {
+            size_t n = std::min(cap, source->len);
+
+            std::memcpy(buffer, source->data, n);
+            source->data += n;
+            source->len -= n;
+            return n;
+        }
+    };
+
+    suspending_source(const uint8_t *data, size_t len) : data(data), len(len) {}
+
+    read_awaiter read(uint8_t *buffer, size_t cap) { return read_awaiter{ this, buffer, cap }; }
+
+    std::coroutine_handle<> pending;
+    const uint8_t *data;
+    size_t len;
+};
+
+template <typename Source>
+static id3::task<uint64_t> sum_frames(Source &source) {
+    id3::Status status;
+    id3::async_generator<id3::FrameView> stream = id3::frames(source, status, BENCH_CHUNK);
+    uint64_t total = 0;
+
+    while (const id3::FrameView *frame = co_await stream.next()) {
+        total += frame->size;
+    }
+    co_return total;
+}
+
+static uint64_t run_generator(const uint8_t *data, size_t len) {
+    id3::memory_source source(data, len);
+    id3::task<uint64_t> sum = sum_frames(source);
+
+    sum.start();
+    return sum.result();
+}
+
+static uint64_t run_suspending(const uint8_t *data, size_t len) {
+    suspending_source source(data, len);
+    id3::task<uint64_t> sum = sum_frames(source);
+
+    sum.start();
+    while (!sum.done()) {
+        source.pending.resume();
+    }
+    return sum.result();
+}
+
+struct BenchMode {
+    const char *name;
+    uint64_t (*run)(const uint8_t *data, size_t len);
+};
+
+static const BenchMode bench_modes[] = {
+    { "C callback", run_callback },
+    { "C next()", run_next },
+    { "frames()", run_generator },
+    { "frames() suspending", run_suspending },
+};
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? std::atol(argv[1]) : 2000;
+
+    if (rounds <= 0) {
+        std::fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%-14s %-20s %10s\n", "tag", "mode", "ns/frame");
+    for (const BenchTag &bench : bench_tags) {
+        size_t len = synth_tag(tag, sizeof(tag), &bench.spec);
+        uint64_t expected = run_callback(tag, len);
+        size_t frames = 0;
+
+        id3_parse_buffer(tag, len, count_frame, &frames);
+        for (const BenchMode &mode : bench_modes) {
+            double best = 1e30;
+            uint64_t total = 0;
+
+            for (int run = 0; run < BENCH_RUNS; run++) {
+                auto start = std::chrono::steady_clock::now();
+
+                for (long i = 0; i < rounds; i++) {
+                    total = mode.run(tag, len);
+                }
+                best = std::min(best, std::chrono::duration<double>(
+                                          std::chrono::steady_clock::now() - start).count());
+            }
+            std::printf("%-14s %-20s %10.1f\n", bench.name, mode.name, best / rounds / frames * 1e9);
+            if (total != expected) {
+                std::fprintf(stderr, "%s: frames differ\n", mode.name);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
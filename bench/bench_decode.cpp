@@ -0,0 +1,146 @@
+// Latency of decoding one large tag, frame by frame in order against
+// id3::decode_frames() on a pool of threads.
+//
+//   id3_decode_bench [text frames] [picture KB]
+//
+// The tag has text frames (default 800, as in an audiobook with a frame per
+// chapter) and one picture (default 512 KB). Decoding a text frame
+// transcodes it to UTF-8; decoding any other frame runs a bytewise CRC-32
+// over it, standing in for decompression or unsynchronisation removal,
+// which also make one pass over the bytes. Results are collected in tag
+// order either way. Reports the best of five runs in microseconds per tag.
+
+#include "id3v2pipeline.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define BENCH_RUNS 5
+
+static uint32_t crc_table[256];
+
+static void crc_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static void put_utf8(std::string &out, uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+// Text frames as UTF-8, other frames as their CRC-32 in hex
+static std::string decode(const id3::FrameView &frame) {
+    std::string out;
+
+    if (frame.id[0] == 'T' && frame.size > 0) {
+        if (frame.data[0] == 1 || frame.data[0] == 2) {
+            for (uint32_t i = 1; i + 1 < frame.size; i += 2) {
+                put_utf8(out, static_cast<uint32_t>(frame.data[i]) << 8 | frame.data[i + 1]);
+            }
+        } else {
+            for (uint32_t i = 1; i < frame.size; i++) {
+                put_utf8(out, frame.data[i]);
+            }
+        }
+    } else {
+        uint32_t crc = 0xFFFFFFFFu;
+        char hex[9];
+
+        for (uint32_t i = 0; i < frame.size; i++) {
+            crc = crc_table[(crc ^ frame.data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        std::snprintf(hex, sizeof(hex), "%08x", crc ^ 0xFFFFFFFFu);
+        out = hex;
+    }
+    return out;
+}
+
+struct Collect {
+    std::vector<std::string> *results;
+
+    void operator()(std::string &result) { results->push_back(std::move(result)); }
+};
+
+static void decode_in_order(const uint8_t *tag, size_t len, std::vector<std::string> &results) {
+    std::vector<ID3FrameRef> refs(static_cast<size_t>(id3_index_frames(tag, len, nullptr, 0)));
+
+    id3_index_frames(tag, len, refs.data(), refs.size());
+    for (const ID3FrameRef &ref : refs) {
+        id3::FrameView frame = { ref.id, tag + ref.offset, ref.size, ref.offset, 0 };
+
+        results.push_back(decode(frame));
+    }
+}
+
+int main(int argc, char **argv) {
+    static const unsigned threads[] = { 1, 2, 4, 8 };
+    long text_frames = argc > 1 ? std::atol(argv[1]) : 800;
+    long picture_kb = argc > 2 ? std::atol(argv[2]) : 512;
+
+    if (text_frames < 0 || text_frames > 65535 || picture_kb < 0 || picture_kb > 16 * 1024) {
+        std::fprintf(stderr, "usage: %s [text frames] [picture KB]\n", argv[0]);
+        return 1;
+    }
+
+    SynthTagSpec spec = { 4, 0, static_cast<uint16_t>(text_frames),
+                          static_cast<uint32_t>(picture_kb * 1024), 0, 1 };
+    std::vector<uint8_t> tag(spec.picture_size + spec.text_frames * 300u + 4096);
+    size_t len = synth_tag(tag.data(), tag.size(), &spec);
+    std::vector<std::string> expected;
+
+    crc_init();
+    decode_in_order(tag.data(), len, expected);
+    std::printf("%zu frames, %zu bytes, %u hardware threads\n", expected.size(), len,
+                std::thread::hardware_concurrency());
+    std::printf("%-22s %12s\n", "decode", "us per tag");
+
+    for (int mode = -1; mode < static_cast<int>(sizeof(threads) / sizeof(threads[0])); mode++) {
+        double best = 1e30;
+        char name[32];
+
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            std::vector<std::string> results;
+            auto start = std::chrono::steady_clock::now();
+
+            if (mode < 0) {
+                decode_in_order(tag.data(), len, results);
+            } else {
+                Collect collect = { &results };
+
+                id3::decode_frames(tag.data(), len, threads[mode], decode, collect);
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            if (results != expected) {
+                std::fprintf(stderr, "results differ\n");
+                return 1;
+            }
+        }
+        if (mode < 0) {
+            std::snprintf(name, sizeof(name), "in order, 1 thread");
+        } else {
+            std::snprintf(name, sizeof(name), "decode_frames, %u", threads[mode]);
+        }
+        std::printf("%-22s %12.0f\n", name, best * 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+// emsg walker throughput and delivery latency on synthetic low-latency CMAF.
+//
+//   id3_emsg_bench [hours]
+//
+// Builds one minute of a 2 Mbit/s stream cut into 500 ms CMAF chunks
+// (moof and mdat) with an ID3 emsg event every 2 s, and walks it hours
+// (default 4) times over in 16 KB network-sized reads. A second pass times
+// each event from the start of the read that brings its first frame to the
+// delivery of that frame. A third pass seeks past the skipped boxes
+// with id3_emsg_skip() instead of reading them.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "id3v2container.h"
+#include "synth_mp4.h"
+#include "synth_tag.h"
+
+#include <time.h>
+
+#define BENCH_BITRATE 2000000
+#define BENCH_CYCLE_SECONDS 60
+#define BENCH_CHUNKS_PER_SECOND 2
+#define BENCH_READ (16 * 1024)
+
+typedef struct {
+    uint64_t frame_bytes;
+    uint64_t events;
+    int timing;                // Record the latency of the next first frame
+    double read_start;
+    double latency_sum;
+    double latency_max;
+} BenchCount;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    BenchCount *count = (BenchCount *)user_data;
+
+    (void)id;
+    (void)data;
+    count->frame_bytes += size;
+    if (count->timing == 1) {
+        double latency = now() - count->read_start;
+
+        count->latency_sum += latency;
+        if (latency > count->latency_max) {
+            count->latency_max = latency;
+        }
+        count->timing = 2; // Until the event ends
+    }
+}
+
+static void count_event(const ID3EmsgEvent *event, int complete, void *user_data) {
+    BenchCount *count = (BenchCount *)user_data;
+
+    (void)event;
+    count->events += complete;
+    if (count->timing) {
+        count->timing = 1;
+    }
+}
+
+// One cycle of the stream; returns its length and the events it carries
+static size_t build_cycle(uint8_t *out, size_t *events) {
+    static uint8_t tag[64 * 1024];
+    size_t mdat = BENCH_BITRATE / 8 / BENCH_CHUNKS_PER_SECOND;
+    uint32_t state = 0x2468ACE1u;
+    size_t len = 0;
+    size_t c;
+
+    *events = 0;
+    for (c = 0; c < BENCH_CYCLE_SECONDS * BENCH_CHUNKS_PER_SECOND; c++) {
+        if (c % 4 == 0) {
+            SynthTagSpec spec = { 4, 0, 6, (*events % 2) ? 8 * 1024 : 0, 64, (uint32_t)c };
+            size_t n = synth_tag(tag, sizeof(tag), &spec);
+
+            len += synth_mp4_emsg(&out[len], (int)(c / 4 % 2), SYNTH_MP4_ID3_SCHEME,
+                                  (uint64_t)c * 45000, (uint32_t)c, tag, n);
+            (*events)++;
+        }
+        len += synth_mp4_fragment(&out[len], &state, mdat, 0);
+    }
+    return len;
+}
+
+// Walk cycles copies of the stream; returns the bytes actually fed
+static uint64_t walk(const uint8_t *cycle, size_t len, uint64_t cycles, int seek,
+                     BenchCount *count) {
+    ID3EmsgDemux demux;
+    uint64_t fed = 0;
+    uint64_t c;
+
+    id3_emsg_init(&demux, count_frame, count_event, count);
+    for (c = 0; c < cycles; c++) {
+        size_t off = 0;
+
+        while (off < len) {
+            size_t n = len - off < BENCH_READ ? len - off : BENCH_READ;
+
+            if (count->timing) {
+                count->read_start = now();
+            }
+            id3_emsg_feed(&demux, cycle + off, n);
+            off += n;
+            fed += n;
+            if (seek) {
+                off += (size_t)id3_emsg_skip(&demux); // Stands in for lseek()
+            }
+        }
+    }
+    id3_emsg_cleanup(&demux);
+    return fed;
+}
+
+int main(int argc, char **argv) {
+    double hours = argc > 1 ? atof(argv[1]) : 4;
+    uint64_t cycles = (uint64_t)(hours * 3600 / BENCH_CYCLE_SECONDS);
+    size_t cap = (size_t)BENCH_BITRATE / 8 * BENCH_CYCLE_SECONDS + 4 * 1024 * 1024;
+    BenchCount count;
+    uint8_t *cycle;
+    size_t cycle_events;
+    size_t len;
+    uint64_t fed;
+    double start;
+    double elapsed;
+
+    if (cycles == 0) {
+        fprintf(stderr, "usage: %s [hours]\n", argv[0]);
+        return 1;
+    }
+    cycle = (uint8_t *)malloc(cap);
+    if (!cycle) {
+        return 1;
+    }
+    len = build_cycle(cycle, &cycle_events);
+
+    memset(&count, 0, sizeof(count));
+    start = now();
+    walk(cycle, len, cycles, 0, &count);
+    elapsed = now() - start;
+    printf("%.1f h of stream, %.0f MB, %llu events (%llu expected), %.1f MB of frames\n",
+           cycles * BENCH_CYCLE_SECONDS / 3600.0, (double)len * cycles / 1e6,
+           (unsigned long long)count.events, (unsigned long long)(cycle_events * cycles),
+           count.frame_bytes / 1e6);
+    printf("read:    %.2f s, %.0f MB/s, %.0fx real time\n", elapsed,
+           len * cycles / elapsed / 1e6, cycles * BENCH_CYCLE_SECONDS / elapsed);
+    if (count.events != cycle_events * cycles) {
+        return 1;
+    }
+
+    memset(&count, 0, sizeof(count));
+    count.timing = 1;
+    walk(cycle, len, cycles < 10 ? cycles : 10, 0, &count);
+    printf("latency: %.2f us mean, %.2f us max from read to first frame\n",
+           count.latency_sum / count.events * 1e6, count.latency_max * 1e6);
+
+    memset(&count, 0, sizeof(count));
+    start = now();
+    fed = walk(cycle, len, cycles, 1, &count);
+    elapsed = now() - start;
+    printf("seek:    %.2f s, %.1f%% of the stream read\n", elapsed, 100.0 * fed / (len * cycles));
+
+    free(cycle);
+    return 0;
+}
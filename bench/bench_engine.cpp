@@ -0,0 +1,174 @@
+// The compile-time engine id3::parser<Handlers...> against the C callback
+// path on the same work.
+//
+//   id3_engine_bench [rounds]
+//
+// Each tag is fed in 4 KB chunks rounds times (default 2000) by
+// id3_parser_feed() with a C callback, by id3::Parser::feed() with a lambda,
+// and by the engine. Two workloads: summing the sizes of every frame, and of
+// the title, artist and album frames only, which the callbacks pick out by
+// comparing IDs and the engine by its handlers' frame_ids. Reports the best
+// of five runs in ns per tag.
+
+#include "id3v2parser.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define BENCH_TAG_CAP (512 * 1024)
+#define BENCH_CHUNK 4096
+#define BENCH_RUNS 5
+
+struct BenchTag {
+    const char *name;
+    SynthTagSpec spec;
+};
+
+static const BenchTag bench_tags[] = {
+    { "v2.3 small",   { 3, 0, 12, 0, 1024, 2 } },
+    { "v2.4 picture", { 4, 0, 24, 120 * 1024, 2048, 5 } },
+    { "v2.2 dense",   { 2, 0, 2000, 0, 0, 6 } },
+    { "v2.4 dense",   { 4, 0, 2000, 0, 0, 6 } },
+};
+
+static uint8_t tag[BENCH_TAG_CAP];
+
+static bool is_text(const char *id) {
+    return std::strcmp(id, "TIT2") == 0 || std::strcmp(id, "TPE1") == 0 ||
+           std::strcmp(id, "TALB") == 0 || std::strcmp(id, "TT2") == 0 ||
+           std::strcmp(id, "TP1") == 0 || std::strcmp(id, "TAL") == 0;
+}
+
+static void sum_all(const char *, const uint8_t *, uint32_t size, void *user_data) {
+    *static_cast<uint64_t *>(user_data) += size;
+}
+
+static void sum_text(const char *id, const uint8_t *, uint32_t size, void *user_data) {
+    if (is_text(id)) {
+        *static_cast<uint64_t *>(user_data) += size;
+    }
+}
+
+struct AllSizes {
+    using ids = id3::any_frame;
+
+    uint64_t total = 0;
+
+    void operator()(const id3::FrameView &frame) { total += frame.size; }
+};
+
+struct TextSizes {
+    using ids = id3::frame_ids<ID3_FOURCC('T', 'I', 'T', '2'), ID3_FOURCC('T', 'P', 'E', '1'),
+                               ID3_FOURCC('T', 'A', 'L', 'B'), ID3_FOURCC('T', 'T', '2', 0),
+                               ID3_FOURCC('T', 'P', '1', 0), ID3_FOURCC('T', 'A', 'L', 0)>;
+
+    uint64_t total = 0;
+
+    void operator()(const id3::FrameView &frame) { total += frame.size; }
+};
+
+static uint64_t run_c(const uint8_t *data, size_t len, bool text) {
+    ID3Parser parser;
+    uint64_t total = 0;
+
+    id3_parser_init(&parser, text ? sum_text : sum_all, &total);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        if (id3_parser_feed(&parser, data + off, std::min<size_t>(BENCH_CHUNK, len - off)) != ID3_MORE) {
+            break;
+        }
+    }
+    id3_parser_cleanup(&parser);
+    return total;
+}
+
+static uint64_t run_wrapper(const uint8_t *data, size_t len, bool text) {
+    id3::Parser parser;
+    uint64_t total = 0;
+
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        id3::Status status = parser.feed(data + off, std::min<size_t>(BENCH_CHUNK, len - off),
+                                         [&](const id3::FrameView &frame) {
+                                             if (!text || is_text(frame.id)) {
+                                                 total += frame.size;
+                                             }
+                                         });
+
+        if (status != id3::Status::More) {
+            break;
+        }
+    }
+    return total;
+}
+
+template <typename Handler>
+static uint64_t run_engine(const uint8_t *data, size_t len) {
+    id3::parser<Handler> parser{ Handler() };
+
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        if (parser.feed(data + off, std::min<size_t>(BENCH_CHUNK, len - off)) != id3::Status::More) {
+            break;
+        }
+    }
+    return parser.template handler<Handler>().total;
+}
+
+static uint64_t run_c_all(const uint8_t *data, size_t len) { return run_c(data, len, false); }
+static uint64_t run_c_text(const uint8_t *data, size_t len) { return run_c(data, len, true); }
+static uint64_t run_wrapper_all(const uint8_t *data, size_t len) { return run_wrapper(data, len, false); }
+static uint64_t run_wrapper_text(const uint8_t *data, size_t len) { return run_wrapper(data, len, true); }
+
+struct BenchMode {
+    const char *work;
+    const char *name;
+    uint64_t (*run)(const uint8_t *data, size_t len);
+};
+
+static const BenchMode bench_modes[] = {
+    { "all", "C callback", run_c_all },
+    { "all", "id3::Parser", run_wrapper_all },
+    { "all", "id3::parser<>", run_engine<AllSizes> },
+    { "text", "C callback", run_c_text },
+    { "text", "id3::Parser", run_wrapper_text },
+    { "text", "id3::parser<>", run_engine<TextSizes> },
+};
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? std::atol(argv[1]) : 2000;
+
+    if (rounds <= 0) {
+        std::fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%-14s %-6s %-14s %12s\n", "tag", "work", "mode", "ns/tag");
+    for (const BenchTag &bench : bench_tags) {
+        size_t len = synth_tag(tag, sizeof(tag), &bench.spec);
+        uint64_t expected[2] = { run_c_all(tag, len), run_c_text(tag, len) };
+
+        for (const BenchMode &mode : bench_modes) {
+            double best = 1e30;
+            uint64_t total = 0;
+
+            for (int run = 0; run < BENCH_RUNS; run++) {
+                auto start = std::chrono::steady_clock::now();
+
+                for (long i = 0; i < rounds; i++) {
+                    total = mode.run(tag, len);
+                }
+                best = std::min(best, std::chrono::duration<double>(
+                                          std::chrono::steady_clock::now() - start).count());
+            }
+            std::printf("%-14s %-6s %-14s %12.0f\n", bench.name, mode.work, mode.name,
+                        best / rounds * 1e9);
+            if (total != expected[mode.work[0] == 't']) {
+                std::fprintf(stderr, "%s: frames differ\n", mode.name);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
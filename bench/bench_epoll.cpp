@@ -0,0 +1,196 @@
+// Throughput and latency of one id3::stream_loop over many concurrent
+// streams (Linux).
+//
+//   id3_epoll_bench [streams]
+//
+// A writer thread writes a synthetic tag into each of streams descriptor
+// pairs (default 10000, half socketpairs and half pipes) a chunk per turn,
+// round robin, so every stream is part way through its tag at once, while
+// the loop thread parses them all on one edge-triggered epoll loop. For
+// chunks of 128 bytes to 4 KB it reports tags and megabytes per second, and
+// the latency from writing the last byte of a tag to the sink seeing the
+// tag end: median, p99 and maximum. Each row is the run with the best
+// throughput of five. Raises the descriptor limit to fit two per stream,
+// or runs fewer streams if it cannot.
+
+#include "id3v2epoll.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define BENCH_RUNS 5
+#define BENCH_TAGS 64
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct Sink {
+    std::unique_ptr<std::atomic<uint64_t>[]> written;   // When the last byte went out
+    std::vector<uint64_t> latency;
+    uint64_t frames = 0;
+    size_t ended = 0;
+    size_t failed = 0;
+
+    void frame(uint64_t, const char *, const uint8_t *, uint32_t) { frames++; }
+    void end(uint64_t stream, id3::Status status) {
+        latency[stream] = now_ns() - written[stream].load(std::memory_order_acquire);
+        ended++;
+        failed += status != id3::Status::Done;
+    }
+};
+
+struct Result {
+    double seconds;
+    uint64_t bytes;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+};
+
+static bool run(const std::vector<std::vector<uint8_t>> &tags, size_t streams, size_t chunk, Result &result) {
+    Sink sink;
+    std::vector<int> peers(streams);
+    uint64_t bytes = 0;
+
+    sink.written.reset(new std::atomic<uint64_t>[streams]);
+    sink.latency.assign(streams, 0);
+
+    id3::stream_loop<Sink> loop(sink, streams, 64 * 1024);
+
+    for (size_t s = 0; s < streams; s++) {
+        int fds[2];
+
+        if ((s % 2 ? socketpair(AF_UNIX, SOCK_STREAM, 0, fds) : pipe(fds)) != 0 || !loop.add(fds[0], s)) {
+            std::perror("stream");
+            return false;
+        }
+        peers[s] = fds[1];
+        sink.written[s].store(0, std::memory_order_relaxed);
+        bytes += tags[s % BENCH_TAGS].size();
+    }
+
+    uint64_t start = now_ns();
+    std::thread writer([&] {
+        for (size_t off = 0, open = streams; open > 0; off += chunk) {
+            for (size_t s = 0; s < streams; s++) {
+                const std::vector<uint8_t> &tag = tags[s % BENCH_TAGS];
+
+                if (off >= tag.size()) {
+                    continue;
+                }
+                size_t n = std::min(chunk, tag.size() - off);
+
+                if (off + n == tag.size()) {
+                    sink.written[s].store(now_ns(), std::memory_order_release);
+                    open--;
+                }
+                if (write(peers[s], &tag[off], n) != static_cast<ssize_t>(n)) {
+                    std::perror("write");
+                    std::exit(1);
+                }
+            }
+        }
+    });
+
+    bool served = loop.run();
+    double seconds = (now_ns() - start) * 1e-9;
+
+    writer.join();
+    for (int fd : peers) {
+        close(fd);
+    }
+    if (!served || sink.ended != streams || sink.failed) {
+        std::fprintf(stderr, "%zu of %zu streams ended, %zu failed\n", sink.ended, streams, sink.failed);
+        return false;
+    }
+
+    std::sort(sink.latency.begin(), sink.latency.end());
+    result.seconds = seconds;
+    result.bytes = bytes;
+    result.p50 = sink.latency[streams / 2];
+    result.p99 = sink.latency[streams * 99 / 100];
+    result.max = sink.latency.back();
+    return true;
+}
+
+// Room for two descriptors per stream, or the streams that fit
+static size_t fit_streams(size_t streams) {
+    struct rlimit limit;
+    rlim_t want = static_cast<rlim_t>(streams * 2 + 32);
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return streams;
+    }
+    if (limit.rlim_cur < want) {
+        struct rlimit raised = limit;
+
+        raised.rlim_cur = want;
+        raised.rlim_max = std::max(limit.rlim_max, want);
+        if (setrlimit(RLIMIT_NOFILE, &raised) != 0) {
+            raised.rlim_cur = limit.rlim_max; // Not allowed past the hard limit
+            raised.rlim_max = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &raised);
+            getrlimit(RLIMIT_NOFILE, &limit);
+            return limit.rlim_cur > 32 ? (limit.rlim_cur - 32) / 2 : 0;
+        }
+    }
+    return streams;
+}
+
+int main(int argc, char **argv) {
+    static const size_t chunks[] = { 128, 512, 4096 };
+    long requested = argc > 1 ? std::atol(argv[1]) : 10000;
+    std::vector<std::vector<uint8_t>> tags;
+    static uint8_t tag[16 * 1024];
+
+    if (requested <= 0) {
+        std::fprintf(stderr, "usage: %s [streams]\n", argv[0]);
+        return 1;
+    }
+    size_t streams = fit_streams(static_cast<size_t>(requested));
+
+    if (streams == 0) {
+        std::fprintf(stderr, "no descriptors to spare\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (uint32_t i = 0; i < BENCH_TAGS; i++) {
+        SynthTagSpec spec = { static_cast<uint8_t>(2 + i % 3), 0, static_cast<uint16_t>(8 + i % 24),
+                              i % 8 == 0 ? 2000u : 0u, 0, i + 1 }; // Ends with its last frame
+        size_t len = synth_tag(tag, sizeof(tag), &spec);
+
+        tags.emplace_back(tag, tag + len);
+    }
+
+    std::printf("%zu streams\n", streams);
+    std::printf("%-7s %10s %8s %10s %10s %10s\n", "chunk", "tags/s", "MB/s", "p50 us", "p99 us", "max us");
+    for (size_t chunk : chunks) {
+        Result best = { 1e30, 0, 0, 0, 0 };
+
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            Result result;
+
+            if (!run(tags, streams, chunk, result)) {
+                return 1;
+            }
+            if (result.seconds < best.seconds) {
+                best = result;
+            }
+        }
+        std::printf("%-7zu %10.0f %8.1f %10.1f %10.1f %10.1f\n", chunk, streams / best.seconds,
+                    best.bytes / best.seconds * 1e-6, best.p50 * 1e-3, best.p99 * 1e-3, best.max * 1e-3);
+    }
+    return 0;
+}
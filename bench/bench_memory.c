@@ -0,0 +1,100 @@
+// Resident memory of many concurrent parsers (Linux).
+//
+//   id3_memory_bench [streams] [frame size]
+//
+// Creates streams parsers (default 1000000) in one array and reports the
+// growth of the process's resident set per stream: once idle, after
+// id3_parser_init(), and once active, each part way through a frame of
+// frame size bytes (default 256) and so holding its frame buffer. The heap
+// figure is the frame memory the parsers account for; the rest of the
+// active growth is allocator overhead.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "id3v2parser.h"
+
+#include <unistd.h>
+
+// Resident set size in bytes, or 0 if it cannot be read
+static size_t resident(void) {
+    FILE *file = fopen("/proc/self/statm", "r");
+    unsigned long pages = 0;
+    unsigned long size;
+
+    if (!file) {
+        return 0;
+    }
+    if (fscanf(file, "%lu %lu", &size, &pages) != 2) {
+        pages = 0;
+    }
+    fclose(file);
+    return (size_t)pages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void ignore_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    (void)id;
+    (void)data;
+    (void)size;
+    (void)user_data;
+}
+
+int main(int argc, char **argv) {
+    long streams = argc > 1 ? atol(argv[1]) : 1000000;
+    long frame_size = argc > 2 ? atol(argv[2]) : 256;
+    uint8_t prefix[21];
+    ID3Parser *parsers;
+    ID3MemoryStats stats;
+    size_t before;
+    size_t idle;
+    size_t active;
+    long i;
+
+    if (streams <= 0 || frame_size < 2 || frame_size > 0x0FFFFFF0) {
+        fprintf(stderr, "usage: %s [streams] [frame size]\n", argv[0]);
+        return 1;
+    }
+
+    // A v2.3 tag holding one frame, up to the first byte of its data
+    memcpy(prefix, "ID3\3\0\0", 6);
+    prefix[6] = (uint8_t)(((frame_size + 10) >> 21) & 0x7F);
+    prefix[7] = (uint8_t)(((frame_size + 10) >> 14) & 0x7F);
+    prefix[8] = (uint8_t)(((frame_size + 10) >> 7) & 0x7F);
+    prefix[9] = (uint8_t)((frame_size + 10) & 0x7F);
+    memcpy(&prefix[10], "APIC", 4);
+    prefix[14] = (uint8_t)(frame_size >> 24);
+    prefix[15] = (uint8_t)(frame_size >> 16);
+    prefix[16] = (uint8_t)(frame_size >> 8);
+    prefix[17] = (uint8_t)frame_size;
+    memset(&prefix[18], 0, 3);
+
+    before = resident();
+    parsers = (ID3Parser *)malloc((size_t)streams * sizeof(ID3Parser));
+    if (!parsers || before == 0) {
+        fprintf(stderr, "%s\n", parsers ? "cannot read /proc/self/statm" : "out of memory");
+        return 1;
+    }
+    for (i = 0; i < streams; i++) {
+        id3_parser_init(&parsers[i], ignore_frame, NULL);
+    }
+    idle = resident();
+
+    for (i = 0; i < streams; i++) {
+        if (id3_parser_feed(&parsers[i], prefix, sizeof(prefix)) != ID3_MORE) {
+            fprintf(stderr, "stream %ld did not start its frame\n", i);
+            return 1;
+        }
+    }
+    active = resident();
+    id3_get_memory_stats(&stats);
+
+    printf("%ld streams, sizeof(ID3Parser) = %u bytes\n", streams, (unsigned)sizeof(ID3Parser));
+    printf("%-28s %10.1f bytes/stream\n", "idle (resident)", (double)(idle - before) / streams);
+    printf("%-28s %10.1f bytes/stream\n", "active (resident)", (double)(active - before) / streams);
+    printf("%-28s %10.1f bytes/stream\n", "active frame buffers (heap)", (double)stats.in_use / streams);
+
+    for (i = 0; i < streams; i++) {
+        id3_parser_cleanup(&parsers[i]);
+    }
+    free(parsers);
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Parser throughput on synthetic tags.
+//
+//   id3_bench [rounds]
+//
+// Each workload parses its tag rounds times (default 2000) and reports the
+// best of five runs. The dense tags, one per version, show the cost of the
+// streaming frame loop itself, without malloc in the pool modes. The same
+// program is the pgo-train workload.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "id3v2parser.h"
+#include "synth_tag.h"
+
+#include <time.h>
+
+#define BENCH_TAG_CAP (512 * 1024)
+#define BENCH_RUNS 5
+
+typedef struct {
+    const char *name;
+    SynthTagSpec spec;
+} BenchTag;
+
+static const BenchTag bench_tags[] = {
+    { "v2.2 small",   { 2, 0, 12, 0, 256, 1 } },
+    { "v2.3 small",   { 3, 0, 12, 0, 1024, 2 } },
+    { "v2.4 small",   { 4, 1, 12, 0, 1024, 3 } },
+    { "v2.3 picture", { 3, 0, 24, 120 * 1024, 2048, 4 } },
+    { "v2.4 picture", { 4, 0, 24, 120 * 1024, 2048, 5 } },
+    { "v2.2 dense",   { 2, 0, 2000, 0, 0, 6 } },
+    { "v2.3 dense",   { 3, 0, 2000, 0, 0, 6 } },
+    { "v2.4 dense",   { 4, 0, 2000, 0, 0, 6 } },
+};
+
+static uint8_t tag[BENCH_TAG_CAP];
+static volatile uint32_t sink;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    (void)id;
+    (void)data;
+    *(uint32_t *)user_data += size;
+}
+
+static void run_feed(const uint8_t *data, size_t len, size_t chunk) {
+    ID3Parser parser;
+    uint32_t total = 0;
+    size_t off;
+
+    id3_parser_init(&parser, count_frame, &total);
+    for (off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+
+        if (id3_parser_feed(&parser, data + off, n) != ID3_MORE) {
+            break;
+        }
+    }
+    id3_parser_cleanup(&parser);
+    sink += total;
+}
+
+static void run_feed_512(const uint8_t *data, size_t len) {
+    run_feed(data, len, 512);
+}
+
+static void run_feed_4096(const uint8_t *data, size_t len) {
+    run_feed(data, len, 4096);
+}
+
+static void run_pull(const uint8_t *data, size_t len) {
+    ID3Parser parser;
+    ID3FrameView frame;
+    size_t used;
+
+    id3_parser_init(&parser, NULL, NULL);
+    while (id3_parser_next(&parser, data, len, &used, &frame) == ID3_FRAME) {
+        sink += frame.size;
+        data += used;
+        len -= used;
+    }
+    id3_parser_cleanup(&parser);
+}
+
+// Frame buffers from one reused block, so the pool modes time the parse
+// loop rather than malloc
+static uint8_t pool_block[BENCH_TAG_CAP];
+
+static void *pool_alloc(size_t size, void *ctx) {
+    (void)ctx;
+    return size <= sizeof(pool_block) ? pool_block : NULL;
+}
+
+static void pool_free(void *ptr, size_t size, void *ctx) {
+    (void)ptr;
+    (void)size;
+    (void)ctx;
+}
+
+static const ID3Allocator pool_allocator = { pool_alloc, pool_free, NULL };
+
+static void run_feed_pool(const uint8_t *data, size_t len) {
+    id3_set_allocator(&pool_allocator);
+    run_feed(data, len, 4096);
+    id3_set_allocator(NULL);
+}
+
+static void run_pull_pool(const uint8_t *data, size_t len) {
+    id3_set_allocator(&pool_allocator);
+    run_pull(data, len);
+    id3_set_allocator(NULL);
+}
+
+static void run_buffer(const uint8_t *data, size_t len) {
+    uint32_t total = 0;
+
+    id3_parse_buffer(data, len, count_frame, &total);
+    sink += total;
+}
+
+static void run_index(const uint8_t *data, size_t len) {
+    ID3FrameRef frames[64];
+
+    sink += (uint32_t)id3_index_frames(data, len, frames, 64);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(const uint8_t *data, size_t len);
+} BenchMode;
+
+static const BenchMode bench_modes[] = {
+    { "feed/512", run_feed_512 },
+    { "feed/4096", run_feed_4096 },
+    { "next", run_pull },
+    { "feed/4096 pool", run_feed_pool },
+    { "next pool", run_pull_pool },
+    { "parse_buffer", run_buffer },
+    { "index_frames", run_index },
+};
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 2000;
+    size_t t, m;
+
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-14s %-14s %10s %12s\n", "tag", "mode", "MB/s", "ns/tag");
+    for (t = 0; t < sizeof(bench_tags) / sizeof(bench_tags[0]); t++) {
+        size_t len = synth_tag(tag, sizeof(tag), &bench_tags[t].spec);
+
+        for (m = 0; m < sizeof(bench_modes) / sizeof(bench_modes[0]); m++) {
+            double best = 1e30;
+            int run;
+
+            for (run = 0; run < BENCH_RUNS; run++) {
+                double start = now();
+                double elapsed;
+                long i;
+
+                for (i = 0; i < rounds; i++) {
+                    bench_modes[m].run(tag, len);
+                }
+                elapsed = now() - start;
+                if (elapsed < best) {
+                    best = elapsed;
+                }
+            }
+            printf("%-14s %-14s %10.1f %12.0f\n", bench_tags[t].name, bench_modes[m].name,
+                   (double)len * rounds / best / 1e6, best / rounds * 1e9);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+// Multi-tag discovery throughput against thread count.
+//
+//   id3_scan_bench [size_mb] [path]
+//
+// Writes a synthetic capture of size_mb (default 4096) to path (default
+// id3_scan_bench.bin): noise with frequent false "ID3" signatures and a
+// tag every few hundred KB, some with "ID3" inside their frame data. The
+// file is mapped and scanned with 1, 2, 4, ... threads, each taking one
+// range, then the results are resolved and checked against the
+// single-threaded scan. The file is removed afterwards.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "id3v2parser.h"
+#include "synth_tag.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCAN_CHUNK (1024 * 1024)
+#define SCAN_MAX_THREADS 64
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;                // Bytes readable from data
+    size_t scan_len;           // Bytes whose signatures this range owns
+    uint64_t base;
+    ID3TagLocation *tags;
+    size_t count;
+} ScanRange;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write the capture in SCAN_CHUNK pieces; returns the number of real tags
+static size_t write_capture(int fd, uint64_t size) {
+    static uint8_t chunk[SCAN_CHUNK + 256 * 1024];
+    static size_t starts[SCAN_CHUNK / 64];
+    uint32_t state = 0x12345678u;
+    uint64_t written = 0;
+    size_t tags = 0;
+
+    while (written < size) {
+        size_t len = 0;
+        size_t count = 0;
+        size_t i;
+
+        while (len < SCAN_CHUNK) {
+            uint32_t r = synth_next(&state);
+
+            if (r % 4096 == 0) {
+                SynthTagSpec spec = { (uint8_t)(2 + r % 3), 0, (uint16_t)(5 + r % 20),
+                                      (r >> 8) % 2 ? 64 * 1024 : 0, 512, r };
+                size_t n = synth_tag(&chunk[len], sizeof(chunk) - len, &spec);
+
+                if (n > 200) {
+                    memcpy(&chunk[len + 150], "ID3\x03\0\0\0\0\0\x14TIT2\0\0\0\x01\0\0", 20);
+                }
+                starts[count++] = len;
+                len += n;
+            } else if (r % 64 == 1) {
+                memcpy(&chunk[len], "ID3", 3); // False signature, no valid header
+                len += 3;
+            } else {
+                memcpy(&chunk[len], &r, sizeof(r));
+                len += sizeof(r);
+            }
+        }
+        if (written + len > size) {
+            len = (size_t)(size - written); // May cut the last tag short
+        }
+        for (i = 0; i < count; i++) {
+            tags += starts[i] + 10 <= len;
+        }
+        if (write(fd, chunk, len) != (ssize_t)len) {
+            perror("write");
+            exit(1);
+        }
+        written += len;
+    }
+    return tags;
+}
+
+static void *scan_range(void *arg) {
+    ScanRange *range = (ScanRange *)arg;
+    size_t max = 1024;
+
+    for (;;) {
+        range->tags = (ID3TagLocation *)malloc(max * sizeof(ID3TagLocation));
+        range->count = id3_scan_tags(range->data, range->len, range->scan_len, range->base,
+                                     range->tags, max);
+        if (range->count <= max) {
+            return NULL;
+        }
+        free(range->tags);
+        max = range->count;
+    }
+}
+
+// Scan with threads ranges and return the number of tags after resolving
+static size_t scan(const uint8_t *data, uint64_t size, int threads) {
+    ScanRange ranges[SCAN_MAX_THREADS];
+    pthread_t ids[SCAN_MAX_THREADS];
+    uint64_t step = size / threads + 1;
+    ID3TagLocation *all;
+    size_t total = 0;
+    int t;
+
+    for (t = 0; t < threads; t++) {
+        uint64_t start = step * t < size ? step * t : size;
+        uint64_t end = start + step < size ? start + step : size;
+        uint64_t avail = end + ID3_SCAN_OVERLAP < size ? end + ID3_SCAN_OVERLAP : size;
+
+        ranges[t].data = data + start;
+        ranges[t].len = (size_t)(avail - start);
+        ranges[t].scan_len = (size_t)(end - start);
+        ranges[t].base = start;
+        pthread_create(&ids[t], NULL, scan_range, &ranges[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        total += ranges[t].count;
+    }
+
+    // Ranges are in stream order, so their results concatenate in order
+    all = (ID3TagLocation *)malloc((total + 1) * sizeof(ID3TagLocation));
+    total = 0;
+    for (t = 0; t < threads; t++) {
+        memcpy(&all[total], ranges[t].tags, ranges[t].count * sizeof(ID3TagLocation));
+        total += ranges[t].count;
+        free(ranges[t].tags);
+    }
+    total = id3_resolve_tags(all, total);
+    free(all);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    uint64_t size = (uint64_t)(argc > 1 ? atol(argv[1]) : 4096) * 1024 * 1024;
+    const char *path = argc > 2 ? argv[2] : "id3_scan_bench.bin";
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cpus > 8 ? (int)cpus : 8;
+    size_t expected;
+    size_t found;
+    uint8_t *data;
+    double base_time = 0;
+    int threads;
+    int fd;
+
+    if (size == 0) {
+        fprintf(stderr, "usage: %s [size_mb] [path]\n", argv[0]);
+        return 1;
+    }
+    if (max_threads > SCAN_MAX_THREADS) {
+        max_threads = SCAN_MAX_THREADS;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    expected = write_capture(fd, size);
+    data = (uint8_t *)mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    // Warm the page cache so every run reads from memory
+    found = scan(data, size, 1);
+    printf("%.0f MB, %zu tags written, %zu found\n", size / 1e6, expected, found);
+    printf("%8s %10s %10s\n", "threads", "GB/s", "speedup");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        double start = now();
+        double elapsed;
+
+        if (scan(data, size, threads) != found) {
+            fprintf(stderr, "%d threads: tag count differs\n", threads);
+            return 1;
+        }
+        elapsed = now() - start;
+        if (threads == 1) {
+            base_time = elapsed;
+        }
+        printf("%8d %10.2f %10.2f\n", threads, size / elapsed / 1e9, base_time / elapsed);
+    }
+
+    munmap(data, (size_t)size);
+    close(fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Cost per packed audio segment of reading its head.
+//
+//   id3_segment_bench [rounds]
+//
+// Reads the timestamp and audio sync of 4096 synthetic segment heads (ADTS
+// and MP3, some with padding) rounds times (default 2000) with
+// id3_segment_head(), and for comparison with id3_parse_buffer() and a
+// callback that decodes the PRIV frame.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "id3v2container.h"
+#include "synth_ts.h"
+
+#include <time.h>
+
+#define BENCH_SEGMENTS 4096
+#define BENCH_SLOT 512
+
+static uint8_t heads[BENCH_SEGMENTS][BENCH_SLOT];
+static size_t lens[BENCH_SEGMENTS];
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void priv_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    if (memcmp(id, "PRIV", 4) == 0 && size == 53 &&
+        memcmp(data, "com.apple.streaming.transportStreamTimestamp", 45) == 0) {
+        uint64_t value = 0;
+        int i;
+
+        for (i = 45; i < 53; i++) {
+            value = value << 8 | data[i];
+        }
+        *(uint64_t *)user_data += value & 0x1FFFFFFFFu;
+    }
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 2000;
+    uint64_t expected = 0;
+    uint64_t sum;
+    double start;
+    double elapsed;
+    long r;
+    size_t s;
+
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+    for (s = 0; s < BENCH_SEGMENTS; s++) {
+        uint64_t pts = (uint64_t)s * 540000 + 0x100000000u;
+
+        lens[s] = synth_ts_audio_head(heads[s], pts, (int)(s % 2), (s % 3) * 64);
+        expected += pts;
+    }
+    printf("%-18s %10s\n", "mode", "ns/segment");
+
+    sum = 0;
+    start = now();
+    for (r = 0; r < rounds; r++) {
+        for (s = 0; s < BENCH_SEGMENTS; s++) {
+            ID3SegmentHead head;
+
+            if (id3_segment_head(heads[s], lens[s], &head) == ID3_DONE && head.audio) {
+                sum += head.timestamp;
+            }
+        }
+    }
+    elapsed = now() - start;
+    printf("%-18s %10.1f\n", "id3_segment_head", elapsed / rounds / BENCH_SEGMENTS * 1e9);
+    if (sum != expected * (uint64_t)rounds) {
+        fprintf(stderr, "timestamps differ\n");
+        return 1;
+    }
+
+    sum = 0;
+    start = now();
+    for (r = 0; r < rounds; r++) {
+        for (s = 0; s < BENCH_SEGMENTS; s++) {
+            id3_parse_buffer(heads[s], lens[s], priv_frame, &sum);
+        }
+    }
+    elapsed = now() - start;
+    printf("%-18s %10.1f\n", "id3_parse_buffer", elapsed / rounds / BENCH_SEGMENTS * 1e9);
+    return sum == expected * (uint64_t)rounds ? 0 : 1;
+}
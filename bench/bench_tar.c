@@ -0,0 +1,137 @@
+// Tar walker speed with and without seeking past member bodies.
+//
+//   id3_tar_bench [members] [path]
+//
+// Writes a delivery of members (default 200) MP3-like files of about 5 MB,
+// each a tag followed by noise, as a ustar archive at path (default
+// id3_tar_bench.tar). The archive is then walked twice through a file
+// descriptor: once seeking past the bodies with lseek() as for a file on
+// disk, and once reading everything as from a pipe. The file is removed
+// afterwards.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "id3v2container.h"
+#include "synth_tag.h"
+#include "synth_tar.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MEMBER_AUDIO (5 * 1024 * 1024)
+#define BENCH_READ (64 * 1024)
+
+typedef struct {
+    uint64_t tagged;
+    uint64_t frames;
+} BenchCount;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    (void)id;
+    (void)data;
+    (void)size;
+    ((BenchCount *)user_data)->frames++;
+}
+
+static void count_member(const char *name, uint64_t size, int result, void *user_data) {
+    (void)name;
+    (void)size;
+    ((BenchCount *)user_data)->tagged += result == ID3_DONE;
+}
+
+static int write_archive(int fd, size_t members) {
+    static uint8_t buf[BENCH_MEMBER_AUDIO + 64 * 1024];
+    uint32_t state = 0xC0FFEEu;
+    size_t m;
+
+    for (m = 0; m < members; m++) {
+        SynthTagSpec spec = { 3, 0, 12, m % 4 == 0 ? 48 * 1024 : 0, 1024, (uint32_t)m };
+        size_t len = synth_tag(&buf[512], sizeof(buf) - 512, &spec);
+        char name[64];
+        size_t i;
+
+        for (i = 0; i < BENCH_MEMBER_AUDIO - m * 7; i += 4) {
+            uint32_t r = synth_next(&state);
+
+            memcpy(&buf[512 + len + i], &r, 4);
+        }
+        len += i;
+        sprintf(name, "delivery/disc1/%03u - Track.mp3", (unsigned)m);
+        synth_tar_header(buf, name, len, '0');
+        len += 512;
+        len += synth_tar_pad(&buf[len], len);
+        if (write(fd, buf, len) != (ssize_t)len) {
+            return 0;
+        }
+    }
+    memset(buf, 0, 1024);
+    return write(fd, buf, 1024) == 1024;
+}
+
+// Walk the archive from the start of fd; returns the bytes read
+static uint64_t walk(int fd, int seek, BenchCount *count) {
+    static uint8_t buf[BENCH_READ];
+    ID3TarWalker walker;
+    uint64_t total = 0;
+    int result = ID3_MORE;
+    ssize_t n;
+
+    lseek(fd, 0, SEEK_SET);
+    id3_tar_init(&walker, count_frame, count_member, count);
+    while (result == ID3_MORE && (n = read(fd, buf, sizeof(buf))) > 0) {
+        uint64_t skip;
+
+        total += (uint64_t)n;
+        result = id3_tar_feed(&walker, buf, (size_t)n);
+        if (seek && (skip = id3_tar_skip(&walker)) > 0) {
+            lseek(fd, (off_t)skip, SEEK_CUR);
+        }
+    }
+    id3_tar_cleanup(&walker);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    size_t members = argc > 1 ? (size_t)atol(argv[1]) : 200;
+    const char *path = argc > 2 ? argv[2] : "id3_tar_bench.tar";
+    off_t size;
+    int mode;
+    int fd;
+
+    if (members == 0) {
+        fprintf(stderr, "usage: %s [members] [path]\n", argv[0]);
+        return 1;
+    }
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !write_archive(fd, members)) {
+        perror(path);
+        return 1;
+    }
+    size = lseek(fd, 0, SEEK_END);
+    printf("%zu members, %.0f MB\n", members, size / 1e6);
+    printf("%-6s %10s %10s %10s %12s\n", "mode", "MB read", "seconds", "members/s", "tags found");
+    for (mode = 1; mode >= 0; mode--) {
+        BenchCount count = { 0, 0 };
+        double start = now();
+        uint64_t read_bytes = walk(fd, mode, &count);
+        double elapsed = now() - start;
+
+        printf("%-6s %10.1f %10.3f %10.0f %12llu\n", mode ? "seek" : "read", read_bytes / 1e6,
+               elapsed, members / elapsed, (unsigned long long)count.tagged);
+        if (count.tagged != members) {
+            fprintf(stderr, "tags missing\n");
+            return 1;
+        }
+    }
+    close(fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Timed metadata demux throughput on a synthetic transport stream.
+//
+//   id3_ts_bench [hours]
+//
+// Builds one minute of a 2 Mbit/s single-program stream (PAT and PMT every
+// 100 ms, media noise, a tag every 10 s with a picture in every other one)
+// and feeds it hours (default 4) times over in 64 KB reads, as a segment
+// ingester would. Reports throughput and how much faster than real time
+// the stream is demuxed.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "id3v2container.h"
+#include "synth_tag.h"
+#include "synth_ts.h"
+
+#include <time.h>
+
+#define BENCH_BITRATE 2000000
+#define BENCH_CYCLE_SECONDS 60
+#define BENCH_READ (64 * 1024)
+
+typedef struct {
+    uint64_t frame_bytes;
+    uint64_t tags;
+} BenchCount;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void count_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    (void)id;
+    (void)data;
+    ((BenchCount *)user_data)->frame_bytes += size;
+}
+
+static void count_tag(uint64_t pts, int complete, void *user_data) {
+    (void)pts;
+    ((BenchCount *)user_data)->tags += complete;
+}
+
+// One cycle of the stream; returns its length and the tags it carries
+static size_t build_cycle(uint8_t *out, size_t packets, size_t *tags) {
+    static uint8_t tag[128 * 1024];
+    size_t per_second = packets / BENCH_CYCLE_SECONDS;
+    size_t next_psi = 0;
+    size_t next_tag = per_second / 2;
+    size_t len = 0;
+    size_t p = 0;
+    SynthTs ts;
+
+    memset(&ts, 0, sizeof(ts));
+    ts.state = 0x13579BDFu;
+    *tags = 0;
+    while (p < packets) {
+        size_t n = len;
+
+        if (p >= next_psi) {
+            len += synth_ts_psi(&ts, &out[len]);
+            next_psi += per_second / 10;
+        } else if (p >= next_tag) {
+            SynthTagSpec spec = { 4, 0, 6, (*tags % 2) ? 16 * 1024 : 0, 64, (uint32_t)p };
+
+            len += synth_ts_tag(&ts, &out[len], (uint64_t)p * 90000 / per_second, tag,
+                                synth_tag(tag, sizeof(tag), &spec));
+            next_tag += per_second * 10;
+            (*tags)++;
+        } else {
+            len += synth_ts_noise(&ts, &out[len]);
+        }
+        p += (len - n) / 188;
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    double hours = argc > 1 ? atof(argv[1]) : 4;
+    size_t packets = (size_t)BENCH_BITRATE / 8 * BENCH_CYCLE_SECONDS / 188;
+    uint64_t cycles = (uint64_t)(hours * 3600 / BENCH_CYCLE_SECONDS);
+    BenchCount count = { 0, 0 };
+    ID3TsDemux demux;
+    uint8_t *cycle;
+    size_t cycle_tags;
+    size_t len;
+    uint64_t c;
+    double start;
+    double elapsed;
+
+    if (cycles == 0) {
+        fprintf(stderr, "usage: %s [hours]\n", argv[0]);
+        return 1;
+    }
+    cycle = (uint8_t *)malloc((packets + 256) * 188);
+    if (!cycle) {
+        return 1;
+    }
+    len = build_cycle(cycle, packets, &cycle_tags);
+
+    id3_ts_init(&demux, count_frame, count_tag, &count);
+    start = now();
+    for (c = 0; c < cycles; c++) {
+        size_t off;
+
+        for (off = 0; off < len; off += BENCH_READ) {
+            id3_ts_feed(&demux, cycle + off, len - off < BENCH_READ ? len - off : BENCH_READ);
+        }
+    }
+    elapsed = now() - start;
+    id3_ts_cleanup(&demux);
+
+    printf("%.1f h of stream, %.0f MB, %llu tags (%llu expected), %.1f MB of frames\n",
+           cycles * BENCH_CYCLE_SECONDS / 3600.0, (double)len * cycles / 1e6,
+           (unsigned long long)count.tags, (unsigned long long)(cycle_tags * cycles),
+           count.frame_bytes / 1e6);
+    printf("%.2f s, %.0f MB/s, %.0fx real time\n", elapsed, len * cycles / elapsed / 1e6,
+           cycles * BENCH_CYCLE_SECONDS / elapsed);
+    free(cycle);
+    return count.tags == cycle_tags * cycles ? 0 : 1;
+}
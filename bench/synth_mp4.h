@@ -0,0 +1,91 @@
+#pragma once
+
+// Synthetic fragmented MP4 for the emsg walker benchmark and tests: emsg
+// boxes (version 0 and 1) around tags, and moof/mdat pairs with noise.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SYNTH_MP4_ID3_SCHEME "https://aomedia.org/emsg/ID3"
+
+static void synth_mp4_put32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+// Box header for a body of len bytes, with a 64-bit size if large is set.
+// Returns the header size.
+static size_t synth_mp4_header(uint8_t *out, const char *type, uint64_t len, int large) {
+    if (large) {
+        synth_mp4_put32(out, 1);
+        memcpy(&out[4], type, 4);
+        synth_mp4_put32(&out[8], (uint32_t)((len + 16) >> 32));
+        synth_mp4_put32(&out[12], (uint32_t)(len + 16));
+        return 16;
+    }
+    synth_mp4_put32(out, (uint32_t)(len + 8));
+    memcpy(&out[4], type, 4);
+    return 8;
+}
+
+// An emsg box carrying message; returns its size
+static size_t synth_mp4_emsg(uint8_t *out, int version, const char *scheme, uint64_t time,
+                             uint32_t id, const uint8_t *message, size_t len) {
+    static const char value[] = "1";
+    uint8_t body[512];
+    size_t scheme_len = strlen(scheme) + 1;
+    size_t n = 4;
+    size_t header;
+
+    body[0] = (uint8_t)version;
+    body[1] = body[2] = body[3] = 0;
+    if (version == 0) {
+        memcpy(&body[n], scheme, scheme_len);
+        n += scheme_len;
+        memcpy(&body[n], value, sizeof(value));
+        n += sizeof(value);
+        synth_mp4_put32(&body[n], 90000);
+        synth_mp4_put32(&body[n + 4], (uint32_t)time);
+        synth_mp4_put32(&body[n + 8], 0xFFFFFFFFu);
+        synth_mp4_put32(&body[n + 12], id);
+        n += 16;
+    } else {
+        synth_mp4_put32(&body[n], 90000);
+        synth_mp4_put32(&body[n + 4], (uint32_t)(time >> 32));
+        synth_mp4_put32(&body[n + 8], (uint32_t)time);
+        synth_mp4_put32(&body[n + 12], 0xFFFFFFFFu);
+        synth_mp4_put32(&body[n + 16], id);
+        n += 20;
+        memcpy(&body[n], scheme, scheme_len);
+        n += scheme_len;
+        memcpy(&body[n], value, sizeof(value));
+        n += sizeof(value);
+    }
+    header = synth_mp4_header(out, "emsg", n + len, 0);
+    memcpy(&out[header], body, n);
+    memcpy(&out[header + n], message, len);
+    return header + n + len;
+}
+
+// A moof stand-in and an mdat of len noise bytes; returns their size
+static size_t synth_mp4_fragment(uint8_t *out, uint32_t *state, size_t len, int large) {
+    size_t n = synth_mp4_header(out, "moof", 96, 0);
+    size_t i;
+
+    memset(&out[n], 0, 96);
+    n += 96;
+    n += synth_mp4_header(&out[n], "mdat", len, large);
+    for (i = 0; i + 4 <= len; i += 4) {
+        uint32_t x = *state;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *state = x;
+        memcpy(&out[n + i], &x, 4);
+    }
+    memset(&out[n + i], 0, len - i);
+    return n + len;
+}
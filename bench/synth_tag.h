@@ -0,0 +1,125 @@
+#pragma once
+
+// Synthetic ID3v2 tags shaped like real ones: a run of short text frames,
+// a comment, a PRIV frame, an optional cover picture and padding. Used by
+// the benchmarks, the PGO training run and the tests.
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t version;        // 2, 3 or 4
+    uint8_t extended;       // Add an extended header (v2.3+)
+    uint16_t text_frames;   // Number of text frames
+    uint32_t picture_size;  // Cover picture bytes, 0 for none
+    uint32_t padding;       // Zero bytes after the last frame
+    uint32_t seed;          // Varies frame sizes and contents
+} SynthTagSpec;
+
+static uint32_t synth_next(uint32_t *state) {
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void synth_put_size(uint8_t *out, uint32_t size, int synchsafe) {
+    if (synchsafe) {
+        out[0] = (size >> 21) & 0x7F;
+        out[1] = (size >> 14) & 0x7F;
+        out[2] = (size >> 7) & 0x7F;
+        out[3] = size & 0x7F;
+    } else {
+        out[0] = (uint8_t)(size >> 24);
+        out[1] = (uint8_t)(size >> 16);
+        out[2] = (uint8_t)(size >> 8);
+        out[3] = (uint8_t)size;
+    }
+}
+
+// Append a frame header for id (3 or 4 chars) and size bytes of content
+static size_t synth_frame(uint8_t *out, size_t cap, size_t pos, int version,
+                          const char *id, uint32_t size, uint32_t *state) {
+    size_t header = version == 2 ? 6 : 10;
+    uint32_t i;
+
+    if (pos + header + size > cap) {
+        return pos;
+    }
+    if (version == 2) {
+        memcpy(&out[pos], id, 3);
+        out[pos + 3] = (uint8_t)(size >> 16);
+        out[pos + 4] = (uint8_t)(size >> 8);
+        out[pos + 5] = (uint8_t)size;
+    } else {
+        memcpy(&out[pos], id, 4);
+        synth_put_size(&out[pos + 4], size, version == 4);
+        out[pos + 8] = 0;
+        out[pos + 9] = 0;
+    }
+    pos += header;
+    for (i = 0; i < size; i++) {
+        out[pos + i] = (uint8_t)(' ' + synth_next(state) % 95);
+    }
+    if (size > 0) {
+        out[pos] = 0; // Text encoding byte
+    }
+    return pos + size;
+}
+
+// Write a tag into out and return its length, or 0 if cap is too small.
+// Frame IDs cycle through common ones so a frame filter sees a real mix.
+static size_t synth_tag(uint8_t *out, size_t cap, const SynthTagSpec *spec) {
+    static const char *const ids_v2[] = { "TT2", "TP1", "TAL", "TRK", "TYE", "TCO" };
+    static const char *const ids_v3[] = { "TIT2", "TPE1", "TALB", "TRCK", "TYER", "TCON" };
+    static const char *const ids_v4[] = { "TIT2", "TPE1", "TALB", "TRCK", "TDRC", "TCON" };
+    const char *const *ids = spec->version == 2 ? ids_v2 : spec->version == 3 ? ids_v3 : ids_v4;
+    uint32_t state = spec->seed ? spec->seed : 1;
+    size_t pos = 10;
+    uint16_t i;
+
+    if (cap < 10 + spec->padding) {
+        return 0;
+    }
+    cap -= spec->padding;
+    memcpy(out, "ID3", 3);
+    out[3] = spec->version;
+    out[4] = 0;
+    out[5] = 0;
+
+    if (spec->extended && spec->version >= 3 && cap >= 20) {
+        out[5] = 0x40;
+        if (spec->version == 4) {
+            synth_put_size(&out[pos], 6, 1); // Size includes itself
+            out[pos + 4] = 1;
+            out[pos + 5] = 0;
+        } else {
+            synth_put_size(&out[pos], 6, 0); // Size excludes itself
+            memset(&out[pos + 4], 0, 6);
+        }
+        pos += spec->version == 4 ? 6 : 10;
+    }
+
+    for (i = 0; i < spec->text_frames; i++) {
+        uint32_t size = 1 + synth_next(&state) % 48;
+
+        pos = synth_frame(out, cap, pos, spec->version, ids[i % 6], size, &state);
+    }
+    pos = synth_frame(out, cap, pos, spec->version, spec->version == 2 ? "COM" : "COMM",
+                      64 + synth_next(&state) % 192, &state);
+    if (spec->version > 2) {
+        pos = synth_frame(out, cap, pos, spec->version, "PRIV", 53, &state);
+    }
+    if (spec->picture_size > 0) {
+        pos = synth_frame(out, cap, pos, spec->version, spec->version == 2 ? "PIC" : "APIC",
+                          spec->picture_size, &state);
+    }
+
+    memset(&out[pos], 0, spec->padding);
+    pos += spec->padding;
+    synth_put_size(&out[6], (uint32_t)(pos - 10), 1);
+    return pos;
+}
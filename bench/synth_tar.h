@@ -0,0 +1,82 @@
+#pragma once
+
+// Synthetic tar archives for the tar walker benchmark and tests: ustar
+// headers (with the prefix field), pax extended headers and padding.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// A 512-byte ustar header for a body of size bytes; name may carry a
+// "prefix/" part of up to 155 bytes split off at its last '/'. Returns 512.
+static inline size_t synth_tar_header(uint8_t *out, const char *name, uint64_t size, char type) {
+    size_t len = strlen(name);
+    const char *split = len > 100 ? strrchr(name, '/') : NULL;
+    unsigned checksum = 0;
+    size_t i;
+
+    memset(out, 0, 512);
+    if (split) {
+        memcpy(&out[345], name, (size_t)(split - name));
+        name = split + 1;
+        len = strlen(name);
+    }
+    memcpy(out, name, len < 100 ? len : 100);
+    memcpy(&out[100], "0000644", 7);
+    memcpy(&out[108], "0001750", 7);
+    memcpy(&out[116], "0001750", 7);
+    if (size < 077777777777ull) {
+        sprintf((char *)&out[124], "%011llo", (unsigned long long)size);
+    } else {
+        // Base-256 for sizes of 8 GB and more
+        out[124] = 0x80;
+        for (i = 0; i < 8; i++) {
+            out[135 - i] = (uint8_t)(size >> (i * 8));
+        }
+    }
+    memcpy(&out[136], "14712345670", 11);
+    memset(&out[148], ' ', 8);
+    out[156] = (uint8_t)type;
+    memcpy(&out[257], "ustar", 6);
+    memcpy(&out[263], "00", 2);
+    for (i = 0; i < 512; i++) {
+        checksum += out[i];
+    }
+    sprintf((char *)&out[148], "%06o", checksum);
+    out[155] = ' ';
+    return 512;
+}
+
+// Zero bytes up to the next 512-byte boundary after len bytes of body
+static inline size_t synth_tar_pad(uint8_t *out, uint64_t len) {
+    size_t pad = (size_t)((512 - len % 512) % 512);
+
+    memset(out, 0, pad);
+    return pad;
+}
+
+// One pax record, "len key=value\n", where len counts its own digits
+static inline int synth_tar_record(char *out, const char *key, const char *value) {
+    int base = (int)(strlen(key) + strlen(value)) + 3;
+    int len = base + 1;
+
+    while (len != base + snprintf(NULL, 0, "%d", len)) {
+        len = base + snprintf(NULL, 0, "%d", len);
+    }
+    return sprintf(out, "%d %s=%s\n", len, key, value);
+}
+
+// A pax extended header giving the next member's path and size. Returns
+// the bytes written.
+static inline size_t synth_tar_pax(uint8_t *out, const char *path, uint64_t size) {
+    char records[600];
+    char value[24];
+    int len;
+
+    sprintf(value, "%llu", (unsigned long long)size);
+    len = synth_tar_record(records, "path", path);
+    len += synth_tar_record(&records[len], "size", value);
+    synth_tar_header(out, "PaxHeaders/entry", (uint64_t)len, 'x');
+    memcpy(&out[512], records, (size_t)len);
+    return 512 + (size_t)len + synth_tar_pad(&out[512 + len], (uint64_t)len);
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+// Synthetic MPEG-TS for the demuxer benchmark and tests: PAT and PMT for one
+// program with video, audio and an ID3 timed metadata stream (stream_type
+// 0x15), noise packets for the media PIDs and PES-wrapped tags.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SYNTH_TS_PMT_PID      0x1000
+#define SYNTH_TS_VIDEO_PID    0x0100
+#define SYNTH_TS_AUDIO_PID    0x0101
+#define SYNTH_TS_METADATA_PID 0x0102
+
+typedef struct {
+    uint8_t continuity[4];     // PAT, PMT, media and metadata PIDs
+    uint32_t state;            // Noise generator
+} SynthTs;
+
+static inline uint32_t synth_ts_crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    size_t i;
+    int bit;
+
+    for (i = 0; i < len; i++) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// One packet carrying len (<= 184) payload bytes, padded with an adaptation
+// field. Returns 188.
+static inline size_t synth_ts_packet(uint8_t *out, uint16_t pid, int start, uint8_t *continuity,
+                                     const uint8_t *payload, size_t len) {
+    size_t stuffing = 184 - len;
+
+    out[0] = 0x47;
+    out[1] = (uint8_t)((start ? 0x40 : 0) | (pid >> 8));
+    out[2] = (uint8_t)pid;
+    out[3] = (uint8_t)((stuffing ? 0x30 : 0x10) | (*continuity & 0x0F));
+    *continuity = (uint8_t)((*continuity + 1) & 0x0F);
+    if (stuffing > 0) {
+        out[4] = (uint8_t)(stuffing - 1);
+        if (stuffing > 1) {
+            out[5] = 0;
+            memset(&out[6], 0xFF, stuffing - 2);
+        }
+    }
+    memcpy(&out[4 + stuffing], payload, len);
+    return 188;
+}
+
+// PSI section with pointer field and CRC in one packet
+static inline size_t synth_ts_section(uint8_t *out, uint16_t pid, uint8_t *continuity,
+                                      const uint8_t *body, size_t len) {
+    uint8_t payload[184];
+    uint32_t crc;
+
+    payload[0] = 0; // Pointer field
+    memcpy(&payload[1], body, len);
+    payload[2] = (uint8_t)(0xB0 | ((len + 1) >> 8)); // Section length covers the CRC
+    payload[3] = (uint8_t)(len + 1);
+    crc = synth_ts_crc32(&payload[1], len);
+    payload[1 + len] = (uint8_t)(crc >> 24);
+    payload[2 + len] = (uint8_t)(crc >> 16);
+    payload[3 + len] = (uint8_t)(crc >> 8);
+    payload[4 + len] = (uint8_t)crc;
+    memset(&payload[5 + len], 0xFF, 184 - 5 - len);
+    return synth_ts_packet(out, pid, 1, continuity, payload, 184);
+}
+
+// PAT and PMT, 376 bytes
+static inline size_t synth_ts_psi(SynthTs *ts, uint8_t *out) {
+    static const uint8_t pat[] = {
+        0x00, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+        0x00, 0x01, 0xE0 | (SYNTH_TS_PMT_PID >> 8), SYNTH_TS_PMT_PID & 0xFF
+    };
+    static const uint8_t pmt[] = {
+        0x02, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+        0xE0 | (SYNTH_TS_VIDEO_PID >> 8), SYNTH_TS_VIDEO_PID & 0xFF, 0xF0, 0x00,
+        0x1B, 0xE0 | (SYNTH_TS_VIDEO_PID >> 8), SYNTH_TS_VIDEO_PID & 0xFF, 0xF0, 0x00,
+        0x0F, 0xE0 | (SYNTH_TS_AUDIO_PID >> 8), SYNTH_TS_AUDIO_PID & 0xFF, 0xF0, 0x00,
+        0x15, 0xE0 | (SYNTH_TS_METADATA_PID >> 8), SYNTH_TS_METADATA_PID & 0xFF, 0xF0, 0x00
+    };
+
+    synth_ts_section(out, 0, &ts->continuity[0], pat, sizeof(pat));
+    synth_ts_section(&out[188], SYNTH_TS_PMT_PID, &ts->continuity[1], pmt, sizeof(pmt));
+    return 376;
+}
+
+// A media packet full of noise, 188 bytes
+static inline size_t synth_ts_noise(SynthTs *ts, uint8_t *out) {
+    uint8_t payload[184];
+    size_t i;
+
+    for (i = 0; i < sizeof(payload); i += 4) {
+        uint32_t x = ts->state;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        ts->state = x;
+        memcpy(&payload[i], &x, 4);
+    }
+    return synth_ts_packet(out, (ts->state & 1) ? SYNTH_TS_VIDEO_PID : SYNTH_TS_AUDIO_PID, 0,
+                           &ts->continuity[2], payload, sizeof(payload));
+}
+
+// A metadata PES (stream_id 0xBD, bounded length, PTS) carrying tag, split
+// into as many packets as needed. Returns the bytes written to out.
+static inline size_t synth_ts_tag(SynthTs *ts, uint8_t *out, uint64_t pts,
+                                  const uint8_t *tag, size_t len) {
+    uint8_t first[184];
+    size_t pes_length = 3 + 5 + len;
+    size_t written = 0;
+    size_t n;
+
+    first[0] = 0;
+    first[1] = 0;
+    first[2] = 1;
+    first[3] = 0xBD;
+    first[4] = (uint8_t)(pes_length > 0xFFFF ? 0 : pes_length >> 8);
+    first[5] = (uint8_t)(pes_length > 0xFFFF ? 0 : pes_length);
+    first[6] = 0x84; // Data aligned
+    first[7] = 0x80; // PTS only
+    first[8] = 5;
+    first[9] = (uint8_t)(0x21 | ((pts >> 29) & 0x0E));
+    first[10] = (uint8_t)(pts >> 22);
+    first[11] = (uint8_t)(0x01 | ((pts >> 14) & 0xFE));
+    first[12] = (uint8_t)(pts >> 7);
+    first[13] = (uint8_t)(0x01 | ((pts << 1) & 0xFE));
+
+    n = len < 184 - 14 ? len : 184 - 14;
+    memcpy(&first[14], tag, n);
+    written += synth_ts_packet(out, SYNTH_TS_METADATA_PID, 1, &ts->continuity[3], first, 14 + n);
+    tag += n;
+    len -= n;
+    while (len > 0) {
+        n = len < 184 ? len : 184;
+        written += synth_ts_packet(&out[written], SYNTH_TS_METADATA_PID, 0, &ts->continuity[3],
+                                   tag, n);
+        tag += n;
+        len -= n;
+    }
+    return written;
+}
+
+// Head of a packed audio segment: a v2.4 tag with the transportStreamTimestamp
+// PRIV frame (after a TIT2 frame and before padding bytes of padding) and
+// the first bytes of an ADTS or MPEG audio frame. Returns the bytes written.
+static inline size_t synth_ts_audio_head(uint8_t *out, uint64_t pts, int adts, size_t padding) {
+    static const char owner[] = "com.apple.streaming.transportStreamTimestamp";
+    static const uint8_t title[] = { 'T', 'I', 'T', '2', 0, 0, 0, 6, 0, 0, 3, 'L', 'i', 'v', 'e', 0 };
+    static const uint8_t adts_sync[] = { 0xFF, 0xF1, 0x50, 0x80, 0x2E, 0x7F, 0xFC };
+    static const uint8_t mpeg_sync[] = { 0xFF, 0xFB, 0x90, 0x64 };
+    size_t priv = sizeof(owner) + 8;
+    size_t size = sizeof(title) + 10 + priv + padding;
+    size_t len = 10;
+    int i;
+
+    memcpy(out, "ID3\x04\0\0", 6);
+    out[6] = (uint8_t)((size >> 21) & 0x7F);
+    out[7] = (uint8_t)((size >> 14) & 0x7F);
+    out[8] = (uint8_t)((size >> 7) & 0x7F);
+    out[9] = (uint8_t)(size & 0x7F);
+    memcpy(&out[len], title, sizeof(title));
+    len += sizeof(title);
+    memcpy(&out[len], "PRIV\0\0\0", 7);
+    out[len + 7] = (uint8_t)priv;
+    out[len + 8] = out[len + 9] = 0;
+    len += 10;
+    memcpy(&out[len], owner, sizeof(owner));
+    len += sizeof(owner);
+    for (i = 7; i >= 0; i--) {
+        out[len++] = (uint8_t)(pts >> (i * 8));
+    }
+    memset(&out[len], 0, padding);
+    len += padding;
+    if (adts) {
+        memcpy(&out[len], adts_sync, sizeof(adts_sync));
+        return len + sizeof(adts_sync);
+    }
+    memcpy(&out[len], mpeg_sync, sizeof(mpeg_sync));
+    return len + sizeof(mpeg_sync);
+}
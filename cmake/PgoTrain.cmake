@@ -0,0 +1,103 @@
+# Profile-guided build of the libraries, run by the pgo-train target:
+#
+#   1. build BINARY_DIR with instrumentation and run id3_bench as training
+#   2. rebuild the same tree with the collected profile
+#   3. if LLVM_BOLT is set, instrument the shared library with BOLT, train it
+#      again and replace it with the relaid-out copy
+#
+# The same tree is reused for both compiles because GCC names its profile
+# files after the object paths.
+
+cmake_minimum_required(VERSION 3.13)
+
+foreach(var SOURCE_DIR BINARY_DIR C_COMPILER)
+    if(NOT ${var})
+        message(FATAL_ERROR "PgoTrain.cmake needs -D${var}=...")
+    endif()
+endforeach()
+
+set(PROFILE_DIR ${BINARY_DIR}/profile)
+set(TRAIN_ROUNDS 300)
+
+function(run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        string(REPLACE ";" " " command "${ARGN}")
+        message(FATAL_ERROR "pgo-train: '${command}' failed (${result})")
+    endif()
+endfunction()
+
+function(configure_and_build mode bolt)
+    run(${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${BINARY_DIR}
+        -DCMAKE_BUILD_TYPE=Release
+        -DCMAKE_C_COMPILER=${C_COMPILER}
+        -DID3_BUILD_TESTS=OFF
+        -DID3_BUILD_BENCHMARKS=ON
+        -DID3_BOLT=${bolt}
+        -DID3_PGO=${mode}
+        -DID3_PGO_DIR=${PROFILE_DIR})
+    run(${CMAKE_COMMAND} --build ${BINARY_DIR} --clean-first)
+endfunction()
+
+if(LLVM_BOLT)
+    set(bolt ON)
+else()
+    set(bolt OFF)
+endif()
+
+message(STATUS "pgo-train: instrumented build")
+file(REMOVE_RECURSE ${PROFILE_DIR})
+file(MAKE_DIRECTORY ${PROFILE_DIR})
+configure_and_build(GENERATE ${bolt})
+
+message(STATUS "pgo-train: training")
+run(${BINARY_DIR}/id3_bench ${TRAIN_ROUNDS})
+
+file(GLOB raw_profiles ${PROFILE_DIR}/*.profraw)
+if(raw_profiles)
+    if(NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "pgo-train: llvm-profdata is needed to merge Clang profiles")
+    endif()
+    run(${LLVM_PROFDATA} merge -o ${PROFILE_DIR}/id3.profdata ${raw_profiles})
+endif()
+
+message(STATUS "pgo-train: optimised build")
+configure_and_build(USE ${bolt})
+
+if(NOT LLVM_BOLT)
+    message(STATUS "pgo-train: llvm-bolt not found, skipping BOLT")
+    message(STATUS "pgo-train: libraries in ${BINARY_DIR}")
+    return()
+endif()
+
+file(GLOB shared_libs LIST_DIRECTORIES false ${BINARY_DIR}/libid3v2parser.so.*.*)
+list(GET shared_libs 0 shared_lib)
+get_filename_component(shared_name ${shared_lib} NAME)
+set(BOLT_DIR ${BINARY_DIR}/bolt)
+file(REMOVE_RECURSE ${BOLT_DIR})
+file(MAKE_DIRECTORY ${BOLT_DIR})
+
+message(STATUS "pgo-train: BOLT training")
+run(${LLVM_BOLT} ${shared_lib} -instrument
+    -instrumentation-file=${BOLT_DIR}/id3.fdata
+    -o ${BOLT_DIR}/${shared_name})
+# The benchmark loads the library by soname
+file(GLOB sonames LIST_DIRECTORIES true ${BINARY_DIR}/libid3v2parser.so.*)
+foreach(soname ${sonames})
+    get_filename_component(name ${soname} NAME)
+    if(NOT name STREQUAL shared_name)
+        file(CREATE_LINK ${shared_name} ${BOLT_DIR}/${name} SYMBOLIC)
+    endif()
+endforeach()
+run(${CMAKE_COMMAND} -E env LD_LIBRARY_PATH=${BOLT_DIR}
+    ${BINARY_DIR}/id3_bench_shared ${TRAIN_ROUNDS})
+
+message(STATUS "pgo-train: BOLT layout")
+run(${LLVM_BOLT} ${shared_lib} -o ${shared_lib}.bolt
+    -data=${BOLT_DIR}/id3.fdata
+    -reorder-blocks=ext-tsp
+    -reorder-functions=hfsort
+    -split-functions
+    -icf=1)
+file(RENAME ${shared_lib}.bolt ${shared_lib})
+message(STATUS "pgo-train: libraries in ${BINARY_DIR}")
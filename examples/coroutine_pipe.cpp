@@ -0,0 +1,137 @@
+// Parsing a tag from a non-blocking pipe with the C++20 coroutine adapter
+// (POSIX).
+//
+//   id3_coroutine_pipe
+//
+// A single-threaded loop writes a synthetic tag into a pipe a few hundred
+// bytes per turn, and a coroutine reads it through a byte source whose
+// read() suspends when the pipe is empty. The loop polls the pipe and
+// resumes the coroutine once it is readable. The frames are checked against
+// id3_parse_buffer() on the whole tag; the exit status is 0 if they match.
+
+#include "id3v2parser.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Byte source over a non-blocking file descriptor. A read that would block
+// suspends the coroutine and leaves its handle in pending for the loop.
+class pipe_source {
+public:
+    struct read_awaiter {
+        pipe_source *source;
+        uint8_t *buffer;
+        size_t cap;
+        ssize_t result;
+
+        bool await_ready() {
+            result = ::read(source->fd, buffer, cap);
+            return result >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        }
+        void await_suspend(std::coroutine_handle<> waiting) { source->pending = waiting; }
+        size_t await_resume() {
+            // Resumed once the pipe is readable, or ready with a result
+            while (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                result = ::read(source->fd, buffer, cap);
+            }
+            return result > 0 ? static_cast<size_t>(result) : 0;
+        }
+    };
+
+    explicit pipe_source(int fd) : fd(fd) {}
+
+    read_awaiter read(uint8_t *buffer, size_t cap) { return read_awaiter{ this, buffer, cap, -1 }; }
+
+    int fd;
+    std::coroutine_handle<> pending;
+};
+
+struct Summary {
+    size_t frames = 0;
+    uint64_t bytes = 0;
+    id3::Status status = id3::Status::Error;
+};
+
+static id3::task<Summary> summarize(pipe_source &source) {
+    Summary summary;
+    id3::async_generator<id3::FrameView> stream = id3::frames(source, summary.status, 512);
+
+    while (const id3::FrameView *frame = co_await stream.next()) {
+        if (summary.frames < 3) {
+            std::printf("%s: %u bytes at offset %llu\n", frame->id, frame->size,
+                        static_cast<unsigned long long>(frame->offset));
+        }
+        summary.frames++;
+        summary.bytes += frame->size;
+    }
+    co_return summary;
+}
+
+static void add_frame(const char *, const uint8_t *, uint32_t size, void *user_data) {
+    Summary *summary = static_cast<Summary *>(user_data);
+
+    summary->frames++;
+    summary->bytes += size;
+}
+
+int main() {
+    static uint8_t tag[64 * 1024];
+    const SynthTagSpec spec = { 4, 1, 40, 16 * 1024, 512, 9 };
+    size_t len = synth_tag(tag, sizeof(tag), &spec);
+    size_t written = 0;
+    Summary expected;
+    int fds[2];
+
+    if (len == 0 || pipe(fds) != 0 || fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+    id3_parse_buffer(tag, len, add_frame, &expected);
+
+    pipe_source source(fds[0]);
+    id3::task<Summary> read = summarize(source);
+
+    read.start();
+    while (!read.done()) {
+        struct pollfd readable = { fds[0], POLLIN, 0 };
+
+        // Stand-in for the writing side: a few hundred bytes per turn
+        if (written < len) {
+            size_t n = std::min<size_t>(300, len - written);
+            ssize_t result = ::write(fds[1], tag + written, n);
+
+            if (result < 0) {
+                std::perror("write");
+                return 1;
+            }
+            written += static_cast<size_t>(result);
+        } else if (fds[1] >= 0) {
+            close(fds[1]);
+            fds[1] = -1;
+        }
+        if (poll(&readable, 1, 0) > 0 && source.pending) {
+            std::coroutine_handle<> pending = source.pending;
+
+            source.pending = nullptr;
+            pending.resume();
+        }
+    }
+    close(fds[0]);
+    if (fds[1] >= 0) {
+        close(fds[1]);
+    }
+
+    Summary summary = read.result();
+
+    std::printf("%zu frames, %llu bytes, status %d\n", summary.frames,
+                static_cast<unsigned long long>(summary.bytes), static_cast<int>(summary.status));
+    return summary.status == id3::Status::Done && summary.frames == expected.frames &&
+           summary.bytes == expected.bytes ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+// A read -> parse -> decode -> sink scanner built on id3v2pipeline.hpp.
+//
+//   id3_scan_pipeline [-p parse threads] [-d decode threads] [file...]
+//
+// Reads each file whole, parses its first tag, decodes its text frames to
+// UTF-8 and counts them, then prints what each stage did: its share of
+// thread time busy, blocked on the next stage, or waiting for input, and
+// the depth of its input channel. Without files it scans 20000 synthetic
+// tags held in memory.
+
+#include "id3v2pipeline.hpp"
+#include "synth_tag.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct File {
+    uint64_t index = 0;
+    std::vector<uint8_t> bytes;
+};
+
+struct Text {
+    uint32_t id = 0;
+    std::string utf8;
+};
+
+static std::vector<std::vector<uint8_t>> synthetic;
+
+static bool read_file(const char *path, std::vector<uint8_t> &bytes) {
+    FILE *file = std::fopen(path, "rb");
+    uint8_t chunk[64 * 1024];
+    size_t n;
+
+    if (!file) {
+        return false;
+    }
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        bytes.insert(bytes.end(), chunk, chunk + n);
+    }
+    std::fclose(file);
+    return true;
+}
+
+static void put_utf8(std::string &out, uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+// Text frame data (encoding byte, then text) to UTF-8. UTF-16 surrogate
+// pairs are passed through as separate code units.
+static std::string decode_text(const uint8_t *data, uint32_t size) {
+    std::string out;
+    uint32_t i = 1;
+    bool big_endian = true;
+
+    if (size == 0) {
+        return out;
+    }
+    switch (data[0]) {
+    case 0:
+        for (; i < size && data[i]; i++) {
+            put_utf8(out, data[i]);
+        }
+        return out;
+    case 1:
+    case 2:
+        if (data[0] == 1 && size >= 3) {
+            big_endian = !(data[1] == 0xFF && data[2] == 0xFE);
+            i = 3;
+        }
+        for (; i + 1 < size; i += 2) {
+            uint32_t c = big_endian ? (data[i] << 8 | data[i + 1]) : (data[i + 1] << 8 | data[i]);
+
+            if (c == 0) {
+                break;
+            }
+            put_utf8(out, c);
+        }
+        return out;
+    default:
+        out.assign(reinterpret_cast<const char *>(data) + 1, size - 1);
+        return out.substr(0, out.find('\0'));
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned parse_threads = 2;
+    unsigned decode_threads = 2;
+    std::vector<const char *> paths;
+    id3::channel<uint64_t> names(64);
+    id3::channel<File> files(16);
+    id3::channel<id3::frame_desc> frames(1024);
+    id3::channel<Text> texts(1024);
+    uint64_t texts_seen = 0;
+    uint64_t utf8_bytes = 0;
+    id3::pipeline pipeline;
+
+    for (int i = 1; i < argc; i++) {
+        if ((std::strcmp(argv[i], "-p") == 0 || std::strcmp(argv[i], "-d") == 0) && i + 1 < argc) {
+            unsigned threads = static_cast<unsigned>(std::atoi(argv[i + 1]));
+
+            (argv[i][1] == 'p' ? parse_threads : decode_threads) = threads ? threads : 1;
+            i++;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        uint8_t tag[16 * 1024];
+
+        for (uint32_t i = 0; i < 20000; i++) {
+            SynthTagSpec spec = { static_cast<uint8_t>(2 + i % 3), 0, static_cast<uint16_t>(8 + i % 24),
+                                  i % 4 == 0 ? 6000u : 0u, 512, i + 1 };
+            size_t len = synth_tag(tag, sizeof(tag), &spec);
+
+            synthetic.emplace_back(tag, tag + len);
+        }
+    }
+
+    pipeline.add_stage("read", 1, names, files, [&paths](uint64_t &index, id3::output<File> &out) {
+        File file;
+
+        file.index = index;
+        if (paths.empty()) {
+            file.bytes = synthetic[index];
+        } else if (!read_file(paths[index], file.bytes)) {
+            std::fprintf(stderr, "cannot read %s\n", paths[index]);
+            return;
+        }
+        out.push(std::move(file));
+    });
+    pipeline.add_stage("parse", parse_threads, files, frames,
+                       [](File &file, id3::output<id3::frame_desc> &out) {
+        id3::Parser parser;
+        id3::FrameView frame;
+        const uint8_t *data = file.bytes.data();
+        size_t len = file.bytes.size();
+        size_t used;
+
+        while (parser.next(data, len, used, frame) == id3::Status::Frame) {
+            if (frame.id[0] == 'T') {
+                out.push(id3::frame_desc(frame, parser.take_frame(), file.index));
+            }
+            data += used;
+            len -= used;
+        }
+    });
+    pipeline.add_stage("decode", decode_threads, frames, texts,
+                       [](id3::frame_desc &desc, id3::output<Text> &out) {
+        Text text;
+
+        text.id = desc.id;
+        text.utf8 = decode_text(desc.payload.data(), desc.payload.size());
+        desc.payload = id3::FrameBuffer();
+        out.push(std::move(text));
+    });
+    pipeline.add_sink("sink", 1, texts, [&](Text &text) {
+        // Stands in for an index write: a little slower than decoding
+        volatile uint32_t work = 0;
+
+        for (size_t i = 0; i < text.utf8.size() * 8; i++) {
+            work = work + static_cast<uint8_t>(text.utf8[i / 8]);
+        }
+        texts_seen++;
+        utf8_bytes += text.utf8.size();
+    });
+
+    pipeline.start();
+    for (uint64_t i = 0; i < (paths.empty() ? synthetic.size() : paths.size()); i++) {
+        names.push(uint64_t(i));
+    }
+    names.close();
+    pipeline.wait();
+
+    std::printf("%llu text frames, %llu bytes of UTF-8\n\n", static_cast<unsigned long long>(texts_seen),
+                static_cast<unsigned long long>(utf8_bytes));
+    std::printf("%-8s %7s %9s %6s %8s %6s %12s\n", "stage", "threads", "items", "busy", "blocked", "idle",
+                "depth/cap");
+    for (const id3::stage_stats &stage : pipeline.stats()) {
+        std::printf("%-8s %7u %9llu %5.0f%% %7.0f%% %5.0f%% %5.1f/%zu\n", stage.name.c_str(), stage.threads,
+                    static_cast<unsigned long long>(stage.items), stage.busy * 100, stage.blocked * 100,
+                    (1 - stage.busy - stage.blocked) * 100, stage.depth, stage.capacity);
+    }
+    return 0;
+}
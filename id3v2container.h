@@ -0,0 +1,1144 @@
+// Container front-ends for the ID3v2 parser, as a single header: they find
+// the ID3 tags carried inside other formats and hand them to an ID3Parser.
+//
+// Include it like id3v2parser.h, which it includes. The implementation is
+// compiled wherever ID3_IMPLEMENTATION is defined before the include
+// (id3v2parser.c does this for both headers).
+
+#ifndef ID3V2CONTAINER_H
+#define ID3V2CONTAINER_H
+
+#include "id3v2parser.h"
+
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PTS value when a PES packet carries none
+#define ID3_TS_NO_PTS UINT64_MAX
+
+// Called when a tag from a metadata PES packet ends, after its frames went
+// to the frame callback. complete is 0 when the tag was cut short (lost
+// packets, a new PES, a parse error) and the frames seen so far should be
+// discarded. pts is in 90 kHz units.
+typedef void (*ID3TsTagCallback)(uint64_t pts, int complete, void *user_data);
+
+// MPEG-TS demuxer for timed metadata (stream_type 0x15, as used by HLS).
+// Follows the PAT to the first program's PMT, finds the metadata PID and
+// streams its PES payloads into the parser packet by packet, so nothing
+// bigger than one TS packet is ever buffered. PSI sections must fit in one
+// TS packet, which holds for the single-program streams HLS uses.
+typedef struct {
+    ID3Parser parser;          // Parses the metadata PES payloads
+    ID3TsTagCallback tag_callback;
+    uint64_t pts;              // PTS of the current PES packet
+    uint32_t pes_remaining;    // PES payload bytes left when the length is bounded
+    uint16_t pmt_pid;          // 0x1FFF until the PAT is seen
+    uint16_t metadata_pid;     // 0x1FFF until the PMT is seen
+    uint16_t pes_header_pos;   // PES header bytes seen
+    uint16_t pes_header_len;   // Full PES header size, once known
+    uint8_t packet[188];       // Partial TS packet carried across calls
+    uint8_t packet_len;
+    uint8_t pes_header[14];    // Start of the PES header, up to the PTS
+    uint8_t continuity;        // Last continuity counter on the metadata PID, 0x10 before any
+    uint8_t repeated;          // That packet was sent twice
+    uint8_t pes_state;         // ID3TsPesState
+    uint8_t error;             // A frame buffer failed in the current call
+} ID3TsDemux;
+
+ID3_API void id3_ts_init(ID3TsDemux *demux, ID3FrameCallback frame_callback,
+                         ID3TsTagCallback tag_callback, void *user_data);
+ID3_API int id3_ts_feed(ID3TsDemux *demux, const uint8_t *data, size_t len);
+ID3_API uint64_t id3_ts_pts(const ID3TsDemux *demux);
+ID3_API void id3_ts_cleanup(ID3TsDemux *demux);
+
+// Audio found right after the tag of a packed audio segment
+typedef enum {
+    ID3_AUDIO_NONE,            // Neither sync word where the audio should start
+    ID3_AUDIO_ADTS,            // AAC in ADTS frames
+    ID3_AUDIO_MPEG             // MPEG audio frames (MP3)
+} ID3AudioSync;
+
+// Head of an HLS packed audio segment (.aac, .mp3)
+typedef struct {
+    uint64_t timestamp;        // 33-bit PRIV transportStreamTimestamp, or ID3_TS_NO_PTS
+    uint64_t audio_offset;     // First byte after the tag (and its footer)
+    uint8_t audio;             // ID3AudioSync at audio_offset
+} ID3SegmentHead;
+
+ID3_API int id3_segment_head(const uint8_t *data, size_t len, ID3SegmentHead *head);
+
+// Largest emsg header (version to message data) the walker buffers; events
+// with longer scheme and value strings are skipped
+#define ID3_EMSG_HEADER_MAX 256
+
+// Timing and identity of an emsg event. For version 0 boxes,
+// presentation_time is the presentation_time_delta from the start of the
+// segment; for version 1 it is absolute. Both are in timescale units.
+typedef struct {
+    uint64_t presentation_time;
+    uint32_t timescale;
+    uint32_t event_duration;
+    uint32_t id;
+    uint8_t version;
+} ID3EmsgEvent;
+
+// Called when the tag of an ID3 emsg event ends, after its frames went to
+// the frame callback. complete is 0 when the tag was cut short (the box
+// ended inside it, or a parse error) and its frames should be discarded.
+typedef void (*ID3EmsgCallback)(const ID3EmsgEvent *event, int complete, void *user_data);
+
+// Top-level box walker for fragmented MP4 (CMAF) that feeds the message data
+// of emsg boxes with the https://aomedia.org/emsg/ID3 scheme straight from
+// the input into the parser. Every other box, mdat included, is stepped over
+// by its size; id3_emsg_skip() lets a reader seek past it instead.
+typedef struct {
+    ID3Parser parser;          // Parses the emsg message data
+    ID3EmsgCallback event_callback;
+    ID3EmsgEvent event;        // Event whose message is being parsed
+    uint64_t box_remaining;    // Bytes of the current box not yet walked
+    uint16_t header_len;       // Bytes in header
+    uint16_t header_end;       // Full emsg header size, once known
+    uint8_t header[ID3_EMSG_HEADER_MAX]; // Box header, then the emsg header
+    uint8_t strings;           // emsg strings terminated so far
+    uint8_t state;             // ID3EmsgState
+    uint8_t error;             // A frame buffer failed in the current call
+} ID3EmsgDemux;
+
+ID3_API void id3_emsg_init(ID3EmsgDemux *demux, ID3FrameCallback frame_callback,
+                           ID3EmsgCallback event_callback, void *user_data);
+ID3_API int id3_emsg_feed(ID3EmsgDemux *demux, const uint8_t *data, size_t len);
+ID3_API uint64_t id3_emsg_skip(ID3EmsgDemux *demux);
+ID3_API const ID3EmsgEvent *id3_emsg_event(const ID3EmsgDemux *demux);
+ID3_API void id3_emsg_cleanup(ID3EmsgDemux *demux);
+
+// Random-access reader for the locators: read up to len bytes at offset
+// into buf and return how many were read (0 at the end or on error)
+typedef size_t (*ID3ReadAt)(uint64_t offset, uint8_t *buf, size_t len, void *ctx);
+
+ID3_API int id3_locate_tag(ID3ReadAt read_at, void *ctx, ID3TagLocation *location);
+ID3_API int id3_parse_region(ID3ReadAt read_at, void *ctx, const ID3TagLocation *location,
+                             ID3FrameCallback callback, void *user_data);
+#ifndef ID3_NO_STDIO
+ID3_API size_t id3_file_read_at(uint64_t offset, uint8_t *buf, size_t len, void *file);
+ID3_API int id3_parse_file(const char *path, ID3FrameCallback callback, void *user_data);
+#endif
+
+// Longest member name kept, terminator included; longer names are cut
+#define ID3_TAR_NAME_MAX 256
+
+// Called once per regular member of a tar archive, after the frames of its
+// tag went to the frame callback. result is ID3_DONE when the member starts
+// with a tag that parsed, ID3_MORE when the member ended inside the tag, and
+// ID3_ERROR when it has no tag (or a frame buffer could not be allocated).
+typedef void (*ID3TarMemberCallback)(const char *name, uint64_t size, int result,
+                                     void *user_data);
+
+// Walker over a tar archive (ustar, with pax and GNU long name extensions)
+// that parses the tag at the start of each member and steps over the rest
+// of its body. id3_tar_skip() lets a reader seek past the body instead.
+typedef struct {
+    ID3Parser parser;          // Parses the head of the current member
+    ID3TarMemberCallback member_callback;
+    uint64_t remaining;        // Body and padding bytes left in the current entry
+    uint64_t data_remaining;   // Body bytes left in the current entry
+    uint64_t size;             // Body size of the current member
+    uint64_t pax_size;         // Size from a pax header for the next member
+    uint16_t block_len;        // Bytes in block
+    uint8_t block[512];        // Header block, pax records or the member's first bytes
+    char name[ID3_TAR_NAME_MAX];
+    uint8_t state;             // ID3TarState
+    uint8_t pending;           // ID3_TAR_PAX_SIZE / ID3_TAR_LONG_NAME for the next member
+    uint8_t zero_blocks;       // Consecutive zero header blocks
+    uint8_t error;             // A frame buffer failed in the current call
+} ID3TarWalker;
+
+ID3_API void id3_tar_init(ID3TarWalker *walker, ID3FrameCallback frame_callback,
+                          ID3TarMemberCallback member_callback, void *user_data);
+ID3_API int id3_tar_feed(ID3TarWalker *walker, const uint8_t *data, size_t len);
+ID3_API uint64_t id3_tar_skip(ID3TarWalker *walker);
+ID3_API const char *id3_tar_member(const ID3TarWalker *walker);
+ID3_API void id3_tar_cleanup(ID3TarWalker *walker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ID3V2CONTAINER_H
+
+#if defined(ID3_IMPLEMENTATION) && !defined(ID3_CONTAINER_IMPLEMENTATION_INCLUDED)
+#define ID3_CONTAINER_IMPLEMENTATION_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ID3_TS_PACKET_SIZE 188
+#define ID3_TS_NO_PID      0x1FFF
+
+typedef enum {
+    ID3_PES_IDLE,              // Waiting for a packet that starts a PES
+    ID3_PES_HEADER,            // Reading the PES header
+    ID3_PES_PAYLOAD,           // Streaming the payload into the parser
+    ID3_PES_SKIP               // Dropping the rest of a broken or finished PES
+} ID3TsPesState;
+
+ID3_API void id3_ts_init(ID3TsDemux *demux, ID3FrameCallback frame_callback,
+                         ID3TsTagCallback tag_callback, void *user_data) {
+    memset(demux, 0, sizeof(ID3TsDemux));
+    id3_parser_init(&demux->parser, frame_callback, user_data);
+    demux->tag_callback = tag_callback;
+    demux->pts = ID3_TS_NO_PTS;
+    demux->pmt_pid = ID3_TS_NO_PID;
+    demux->metadata_pid = ID3_TS_NO_PID;
+    demux->continuity = 0x10;
+    demux->pes_state = ID3_PES_IDLE;
+}
+
+// PTS of the PES packet whose tag is being parsed, e.g. from the frame
+// callback; ID3_TS_NO_PTS if it has none
+ID3_API uint64_t id3_ts_pts(const ID3TsDemux *demux) {
+    return demux->pts;
+}
+
+ID3_API void id3_ts_cleanup(ID3TsDemux *demux) {
+    id3_parser_cleanup(&demux->parser);
+}
+
+// Locate the section of a PSI packet payload; returns its length or 0
+static size_t id3_ts_section(const uint8_t *payload, size_t len, uint8_t table_id,
+                             const uint8_t **section) {
+    size_t start;
+    size_t size;
+
+    if (len < 1 || (start = 1 + (size_t)payload[0]) + 3 > len || payload[start] != table_id) {
+        return 0;
+    }
+    size = 3 + (((size_t)payload[start + 1] & 0x0F) << 8 | payload[start + 2]);
+    if (start + size > len || size < 12) {
+        return 0; // Spans packets or too short for header and CRC
+    }
+    *section = &payload[start];
+    return size;
+}
+
+static void id3_ts_pat(ID3TsDemux *demux, const uint8_t *payload, size_t len) {
+    const uint8_t *section;
+    size_t size = id3_ts_section(payload, len, 0x00, &section);
+    size_t i;
+
+    // Program loop between the 8-byte header and the CRC
+    for (i = 8; size > 0 && i + 4 <= size - 4; i += 4) {
+        uint16_t program = (uint16_t)(section[i] << 8 | section[i + 1]);
+
+        if (program != 0) {
+            demux->pmt_pid = (uint16_t)((section[i + 2] & 0x1F) << 8 | section[i + 3]);
+            return;
+        }
+    }
+}
+
+static void id3_ts_pmt(ID3TsDemux *demux, const uint8_t *payload, size_t len) {
+    const uint8_t *section;
+    size_t size = id3_ts_section(payload, len, 0x02, &section);
+    size_t i;
+
+    if (size == 0) {
+        return;
+    }
+    // Skip the program info descriptors, then walk the elementary streams
+    i = 12 + (((size_t)section[10] & 0x0F) << 8 | section[11]);
+    while (i + 5 <= size - 4) {
+        if (section[i] == 0x15) {
+            demux->metadata_pid = (uint16_t)((section[i + 1] & 0x1F) << 8 | section[i + 2]);
+            return;
+        }
+        i += 5 + (((size_t)section[i + 3] & 0x0F) << 8 | section[i + 4]);
+    }
+}
+
+// Decode the 33-bit PTS from the 5 bytes after the PES header length
+static uint64_t id3_ts_read_pts(const uint8_t *p) {
+    return ((uint64_t)(p[0] & 0x0E) << 29) | ((uint64_t)p[1] << 22) |
+           ((uint64_t)(p[2] & 0xFE) << 14) | ((uint64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+// End the tag being streamed into the parser and report it
+static void id3_ts_end_tag(ID3TsDemux *demux, int result) {
+    if (demux->tag_callback) {
+        demux->tag_callback(demux->pts, result == ID3_DONE, demux->parser.user_data);
+    }
+    id3_parser_reset(&demux->parser);
+    demux->pes_state = ID3_PES_SKIP;
+}
+
+static void id3_ts_payload(ID3TsDemux *demux, const uint8_t *data, size_t len) {
+    int bounded = demux->pes_remaining > 0;
+    int result;
+
+    if (bounded && len > demux->pes_remaining) {
+        len = demux->pes_remaining; // Bytes past a bounded PES are not payload
+    }
+    result = id3_parser_feed(&demux->parser, data, len);
+    if (bounded) {
+        demux->pes_remaining -= (uint32_t)len;
+    }
+    if (result == ID3_ERROR) {
+        demux->error = 1;
+        id3_ts_end_tag(demux, result);
+    } else if (result == ID3_DONE || (bounded && demux->pes_remaining == 0)) {
+        id3_ts_end_tag(demux, result); // Done, or the PES ended inside the tag
+    }
+}
+
+// Metadata PES bytes from one TS packet
+static void id3_ts_pes(ID3TsDemux *demux, const uint8_t *data, size_t len, int start) {
+    size_t n;
+
+    if (start) {
+        if (demux->pes_state == ID3_PES_PAYLOAD) {
+            id3_ts_end_tag(demux, ID3_MORE); // The previous PES ended inside its tag
+        }
+        demux->pes_state = ID3_PES_HEADER;
+        demux->pes_header_pos = 0;
+        demux->pes_header_len = 9;
+        demux->pts = ID3_TS_NO_PTS;
+    }
+
+    if (demux->pes_state == ID3_PES_HEADER) {
+        // Fixed 9 bytes, then the optional fields; the PTS comes first
+        while (len > 0 && demux->pes_header_pos < demux->pes_header_len) {
+            if (demux->pes_header_pos < sizeof(demux->pes_header)) {
+                demux->pes_header[demux->pes_header_pos] = *data;
+            }
+            demux->pes_header_pos++;
+            data++;
+            len--;
+
+            if (demux->pes_header_pos == 9) {
+                const uint8_t *h = demux->pes_header;
+
+                if (h[0] != 0 || h[1] != 0 || h[2] != 1 || (h[6] & 0xC0) != 0x80) {
+                    demux->pes_state = ID3_PES_SKIP;
+                    return;
+                }
+                demux->pes_header_len = (uint16_t)(9 + h[8]);
+                n = (size_t)h[4] << 8 | h[5];
+                demux->pes_remaining = (n > 3u + h[8]) ? (uint32_t)(n - 3 - h[8]) : 0;
+                if (n > 0 && demux->pes_remaining == 0) {
+                    demux->pes_state = ID3_PES_SKIP; // Bounded PES without payload
+                    return;
+                }
+            }
+        }
+        if (demux->pes_header_pos < demux->pes_header_len) {
+            return;
+        }
+        if ((demux->pes_header[7] & 0x80) && demux->pes_header_len >= 14) {
+            demux->pts = id3_ts_read_pts(&demux->pes_header[9]);
+        }
+        demux->pes_state = ID3_PES_PAYLOAD;
+    }
+
+    if (demux->pes_state == ID3_PES_PAYLOAD && len > 0) {
+        id3_ts_payload(demux, data, len);
+    }
+}
+
+static void id3_ts_packet(ID3TsDemux *demux, const uint8_t *packet) {
+    uint16_t pid = (uint16_t)((packet[1] & 0x1F) << 8 | packet[2]);
+    int start = packet[1] & 0x40;
+    uint8_t control = (uint8_t)(packet[3] >> 4) & 0x03;
+    uint8_t continuity = packet[3] & 0x0F;
+    size_t offset = 4;
+
+    if (!(control & 0x01) || (packet[1] & 0x80)) {
+        return; // No payload, or flagged as corrupt
+    }
+    if (control & 0x02) {
+        offset += 1 + (size_t)packet[4]; // Adaptation field
+        if (offset >= ID3_TS_PACKET_SIZE) {
+            return;
+        }
+    }
+
+    if (pid == demux->metadata_pid) {
+        // A packet may be sent twice in a row with the same counter
+        // (ISO/IEC 13818-1 2.4.3.3); the copy carries nothing new
+        if (continuity == demux->continuity && !demux->repeated) {
+            demux->repeated = 1;
+            return;
+        }
+        demux->repeated = 0;
+
+        // A gap inside a PES loses part of the tag
+        if (!start && continuity != ((demux->continuity + 1) & 0x0F)) {
+            if (demux->pes_state == ID3_PES_PAYLOAD) {
+                id3_ts_end_tag(demux, ID3_MORE);
+            }
+            demux->pes_state = ID3_PES_SKIP;
+        }
+        demux->continuity = continuity;
+        if (start || demux->pes_state == ID3_PES_HEADER || demux->pes_state == ID3_PES_PAYLOAD) {
+            id3_ts_pes(demux, &packet[offset], ID3_TS_PACKET_SIZE - offset, start);
+        }
+    } else if (pid == 0 && start) {
+        id3_ts_pat(demux, &packet[offset], ID3_TS_PACKET_SIZE - offset);
+    } else if (pid == demux->pmt_pid && start) {
+        id3_ts_pmt(demux, &packet[offset], ID3_TS_PACKET_SIZE - offset);
+    }
+}
+
+// Demux a chunk of a transport stream of any size. Frames of the metadata
+// tags go to the frame callback and each finished tag to the tag callback.
+// Returns ID3_MORE, or ID3_ERROR if a frame buffer could not be allocated
+// (that tag is dropped and demuxing goes on with the next).
+ID3_API int id3_ts_feed(ID3TsDemux *demux, const uint8_t *data, size_t len) {
+    demux->error = 0;
+
+    // Complete a packet split across calls
+    if (demux->packet_len > 0) {
+        size_t n = ID3_TS_PACKET_SIZE - demux->packet_len;
+
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&demux->packet[demux->packet_len], data, n);
+        demux->packet_len = (uint8_t)(demux->packet_len + n);
+        data += n;
+        len -= n;
+        if (demux->packet_len < ID3_TS_PACKET_SIZE) {
+            return ID3_MORE;
+        }
+        id3_ts_packet(demux, demux->packet);
+        demux->packet_len = 0;
+    }
+
+    // Whole packets straight from the input
+    while (len > 0) {
+        if (data[0] != 0x47) {
+            // Lost sync: skip to the next sync byte
+            const uint8_t *sync = (const uint8_t *)memchr(data, 0x47, len);
+
+            if (!sync) {
+                break;
+            }
+            len -= (size_t)(sync - data);
+            data = sync;
+        }
+        if (len < ID3_TS_PACKET_SIZE) {
+            memcpy(demux->packet, data, len);
+            demux->packet_len = (uint8_t)len;
+            break;
+        }
+        id3_ts_packet(demux, data);
+        data += ID3_TS_PACKET_SIZE;
+        len -= ID3_TS_PACKET_SIZE;
+    }
+    return demux->error ? ID3_ERROR : ID3_MORE;
+}
+
+#define ID3_TIMESTAMP_OWNER "com.apple.streaming.transportStreamTimestamp"
+
+// Picks the timestamp PRIV frame out of the frame walk and stops it there
+static int id3_segment_priv(const char *id, uint32_t offset, uint32_t size, void *ctx) {
+    ID3BufferState *buffer = (ID3BufferState *)ctx;
+    const uint8_t *frame = buffer->tag + offset;
+
+    if (size != sizeof(ID3_TIMESTAMP_OWNER) + 8 || memcmp(id, "PRIV", 4) != 0 ||
+        memcmp(frame, ID3_TIMESTAMP_OWNER, sizeof(ID3_TIMESTAMP_OWNER)) != 0) {
+        return 0;
+    }
+    ((ID3SegmentHead *)buffer->user_data)->timestamp =
+        id3_bytes_to_uint64(&frame[sizeof(ID3_TIMESTAMP_OWNER)]) & 0x1FFFFFFFFu;
+    return 1;
+}
+
+// Classify the 3 bytes where the audio should start
+static uint8_t id3_audio_sync(const uint8_t *p) {
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return ID3_AUDIO_NONE;
+    }
+    if ((p[1] & 0xF6) == 0xF0) {
+        // ADTS: 12-bit sync, layer 0, a defined sampling frequency index
+        return ((p[2] >> 2) & 0x0F) < 13 ? ID3_AUDIO_ADTS : ID3_AUDIO_NONE;
+    }
+    // MPEG audio: 11-bit sync, no reserved version, layer, bitrate or rate
+    if ((p[1] & 0x18) == 0x08 || (p[1] & 0x06) == 0 || (p[2] & 0xF0) == 0xF0 ||
+        (p[2] & 0x0C) == 0x0C) {
+        return ID3_AUDIO_NONE;
+    }
+    return ID3_AUDIO_MPEG;
+}
+
+// Read the head of an HLS packed audio segment in memory: the timestamp from
+// the com.apple.streaming.transportStreamTimestamp PRIV frame and the sync
+// word after the tag. Frames are walked in place up to the PRIV frame, with
+// no copy or allocation. Returns ID3_DONE, ID3_MORE if data ends before
+// audio_offset + 3 (retry with at least that much), or ID3_ERROR if data
+// does not start with a tag header.
+ID3_API int id3_segment_head(const uint8_t *data, size_t len, ID3SegmentHead *head) {
+    ID3BufferState buffer = { data, NULL, head };
+    ID3TagHeader header;
+
+    head->timestamp = ID3_TS_NO_PTS;
+    head->audio = ID3_AUDIO_NONE;
+    if (!id3_probe_header(data, len, &header)) {
+        head->audio_offset = 0;
+        return ID3_ERROR;
+    }
+    head->audio_offset = 10 + (uint64_t)header.size + ((header.flags & 0x10) ? 10 : 0);
+    id3_walk_frames(data, len, id3_segment_priv, &buffer);
+    if (head->audio_offset + 3 > len) {
+        return ID3_MORE;
+    }
+    head->audio = id3_audio_sync(&data[head->audio_offset]);
+    return ID3_DONE;
+}
+
+#define ID3_EMSG_SCHEME "https://aomedia.org/emsg/ID3"
+
+typedef enum {
+    ID3_EMSG_BOX,              // Reading a box header
+    ID3_EMSG_HEADER,           // Reading the header of an emsg box
+    ID3_EMSG_MESSAGE,          // Streaming the message data into the parser
+    ID3_EMSG_SKIP,             // Stepping over the rest of the box
+    ID3_EMSG_BROKEN            // A box size made no sense; nothing more is walked
+} ID3EmsgState;
+
+ID3_API void id3_emsg_init(ID3EmsgDemux *demux, ID3FrameCallback frame_callback,
+                           ID3EmsgCallback event_callback, void *user_data) {
+    memset(demux, 0, sizeof(ID3EmsgDemux));
+    id3_parser_init(&demux->parser, frame_callback, user_data);
+    demux->event_callback = event_callback;
+    demux->state = ID3_EMSG_BOX;
+}
+
+// Event whose tag is being parsed, e.g. from the frame callback
+ID3_API const ID3EmsgEvent *id3_emsg_event(const ID3EmsgDemux *demux) {
+    return &demux->event;
+}
+
+ID3_API void id3_emsg_cleanup(ID3EmsgDemux *demux) {
+    id3_parser_cleanup(&demux->parser);
+}
+
+// Decode a complete box header of len (8 or 16) bytes and pick the state for
+// its body
+static void id3_emsg_box(ID3EmsgDemux *demux, size_t len) {
+    const uint8_t *h = demux->header;
+    uint64_t size = len == 16 ? id3_bytes_to_uint64(&h[8]) : id3_bytes_to_uint32(h);
+
+    if (size == 0) {
+        demux->box_remaining = UINT64_MAX; // Runs to the end of the file
+    } else if (size < len) {
+        demux->state = ID3_EMSG_BROKEN;
+        return;
+    } else {
+        demux->box_remaining = size - len;
+    }
+    demux->header_len = 0;
+    demux->header_end = 0;
+    demux->strings = 0;
+    demux->state = memcmp(&h[4], "emsg", 4) == 0 ? ID3_EMSG_HEADER : ID3_EMSG_SKIP;
+}
+
+// Decode a complete emsg header and decide whether its message is ID3
+static void id3_emsg_header(ID3EmsgDemux *demux) {
+    const uint8_t *h = demux->header;
+    ID3EmsgEvent *event = &demux->event;
+    const char *scheme;
+    size_t fields;
+
+    event->version = h[0];
+    if (h[0] == 0) {
+        scheme = (const char *)&h[4];
+        fields = demux->header_end - 16u;
+        event->timescale = id3_bytes_to_uint32(&h[fields]);
+        event->presentation_time = id3_bytes_to_uint32(&h[fields + 4]);
+        event->event_duration = id3_bytes_to_uint32(&h[fields + 8]);
+        event->id = id3_bytes_to_uint32(&h[fields + 12]);
+    } else {
+        scheme = (const char *)&h[24];
+        event->timescale = id3_bytes_to_uint32(&h[4]);
+        event->presentation_time = id3_bytes_to_uint64(&h[8]);
+        event->event_duration = id3_bytes_to_uint32(&h[16]);
+        event->id = id3_bytes_to_uint32(&h[20]);
+    }
+    demux->state = strcmp(scheme, ID3_EMSG_SCHEME) == 0 ? ID3_EMSG_MESSAGE : ID3_EMSG_SKIP;
+}
+
+// Buffer emsg header bytes until both strings and the fields around them
+// are in; returns the bytes consumed
+static size_t id3_emsg_header_bytes(ID3EmsgDemux *demux, const uint8_t *data, size_t len) {
+    size_t used = 0;
+
+    while (used < len && demux->box_remaining > 0) {
+        uint8_t byte = data[used++];
+        size_t pos = demux->header_len;
+
+        demux->box_remaining--;
+        if (pos == ID3_EMSG_HEADER_MAX || (pos == 0 && byte > 1)) {
+            demux->state = ID3_EMSG_SKIP; // Too long, or an unknown version
+            return used;
+        }
+        demux->header[demux->header_len++] = byte;
+
+        // Version 0 strings follow the full box header, version 1 strings
+        // follow the fixed fields; version 0 fields follow the strings
+        if (byte == 0 && demux->strings < 2 && pos >= (demux->header[0] == 0 ? 4u : 24u)) {
+            if (++demux->strings == 2) {
+                demux->header_end = (uint16_t)(demux->header[0] == 0 ? pos + 17 : pos + 1);
+            }
+        }
+        if (demux->strings == 2 && demux->header_len == demux->header_end) {
+            id3_emsg_header(demux);
+            return used;
+        }
+    }
+    return used; // Needs more input, or the box ended inside the header
+}
+
+// End the tag of the current event and report it
+static void id3_emsg_end_tag(ID3EmsgDemux *demux, int result) {
+    if (demux->event_callback) {
+        demux->event_callback(&demux->event, result == ID3_DONE, demux->parser.user_data);
+    }
+    id3_parser_reset(&demux->parser);
+    demux->state = ID3_EMSG_SKIP;
+}
+
+// Walk a chunk of an fMP4 stream of any size. Frames of ID3 emsg events go
+// to the frame callback and the end of each tag to the event callback.
+// Returns ID3_MORE, or ID3_ERROR if a frame buffer could not be allocated
+// (that tag is dropped) or a box size is invalid (nothing more is walked).
+ID3_API int id3_emsg_feed(ID3EmsgDemux *demux, const uint8_t *data, size_t len) {
+    demux->error = 0;
+
+    while (len > 0 && demux->state != ID3_EMSG_BROKEN) {
+        size_t n;
+
+        if (demux->state == ID3_EMSG_BOX) {
+            // 8-byte header, then 8 more when the size field is 1 (64-bit size)
+            n = id3_min_size(len, (demux->header_len < 8 ? 8u : 16u) - demux->header_len);
+            memcpy(&demux->header[demux->header_len], data, n);
+            demux->header_len = (uint16_t)(demux->header_len + n);
+            if (demux->header_len == 16 ||
+                (demux->header_len == 8 && id3_bytes_to_uint32(demux->header) != 1)) {
+                id3_emsg_box(demux, demux->header_len);
+            }
+        } else if (demux->state == ID3_EMSG_HEADER) {
+            n = id3_emsg_header_bytes(demux, data, len);
+        } else if (demux->state == ID3_EMSG_MESSAGE) {
+            int result;
+
+            n = (size_t)(demux->box_remaining < len ? demux->box_remaining : len);
+            result = id3_parser_feed(&demux->parser, data, n);
+            demux->box_remaining -= n;
+            if (result == ID3_ERROR) {
+                demux->error = 1;
+                id3_emsg_end_tag(demux, result);
+            } else if (result == ID3_DONE || demux->box_remaining == 0) {
+                id3_emsg_end_tag(demux, result); // Done, or the box ended inside the tag
+            }
+        } else {
+            n = (size_t)(demux->box_remaining < len ? demux->box_remaining : len);
+            if (demux->box_remaining != UINT64_MAX) {
+                demux->box_remaining -= n;
+            }
+        }
+        data += n;
+        len -= n;
+        if (demux->box_remaining == 0 && demux->state != ID3_EMSG_BOX &&
+            demux->state != ID3_EMSG_BROKEN) {
+            demux->state = ID3_EMSG_BOX;
+            demux->header_len = 0;
+        }
+    }
+    if (demux->state == ID3_EMSG_BROKEN) {
+        return ID3_ERROR;
+    }
+    return demux->error ? ID3_ERROR : ID3_MORE;
+}
+
+// When the walker is stepping over a box (mdat, moof, non-ID3 events),
+// consume the rest of it without data and return how many bytes the caller
+// should seek past before the next id3_emsg_feed(). Returns 0 otherwise.
+ID3_API uint64_t id3_emsg_skip(ID3EmsgDemux *demux) {
+    uint64_t n = demux->box_remaining;
+
+    if (demux->state != ID3_EMSG_SKIP || n == UINT64_MAX) {
+        return 0;
+    }
+    demux->box_remaining = 0;
+    demux->state = ID3_EMSG_BOX;
+    demux->header_len = 0;
+    return n;
+}
+
+// Bytes read at a time by the locators; chunk headers are usually close
+// enough together that one read covers several
+#define ID3_LOCATOR_WINDOW 64
+
+// Bytes read at a time when parsing a located region
+#ifndef ID3_REGION_CHUNK
+#define ID3_REGION_CHUNK 1024
+#endif
+
+typedef struct {
+    ID3ReadAt read_at;
+    void *ctx;
+    uint64_t base;             // Offset of buf[0]
+    size_t len;                // Bytes valid in buf
+    uint8_t buf[ID3_LOCATOR_WINDOW];
+} ID3ReadWindow;
+
+// need bytes at offset, from the last read if it covered them; NULL past
+// the end of the input
+static const uint8_t *id3_window(ID3ReadWindow *window, uint64_t offset, size_t need) {
+    if (offset < window->base || offset - window->base + need > window->len) {
+        window->base = offset;
+        window->len = window->read_at(offset, window->buf, sizeof(window->buf), window->ctx);
+        if (window->len < need) {
+            return NULL;
+        }
+    }
+    return &window->buf[offset - window->base];
+}
+
+static uint32_t id3_le32(const uint8_t *buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) |
+           ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t id3_le64(const uint8_t *buf) {
+    return id3_le32(buf) | ((uint64_t)id3_le32(&buf[4]) << 32);
+}
+
+// Walk the chunks of a RIFF/RF64 (little-endian sizes) or IFF (big-endian)
+// file from pos to the ID3 chunk; returns the offset of its body or 0
+static uint64_t id3_find_chunk(ID3ReadWindow *window, uint64_t pos, int little_endian) {
+    uint64_t data_size = 0;    // RF64 size of the data chunk, from ds64
+    const uint8_t *chunk;
+
+    while ((chunk = id3_window(window, pos, 8)) != NULL) {
+        uint64_t size = little_endian ? id3_le32(&chunk[4]) : id3_bytes_to_uint32(&chunk[4]);
+
+        if (memcmp(chunk, "id3 ", 4) == 0 || memcmp(chunk, "ID3 ", 4) == 0) {
+            return pos + 8;
+        }
+        if (memcmp(chunk, "ds64", 4) == 0 && little_endian) {
+            const uint8_t *ds64 = id3_window(window, pos + 8, 16);
+
+            if (ds64) {
+                data_size = id3_le64(&ds64[8]);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0 && size == 0xFFFFFFFFu && data_size) {
+            size = data_size;
+        }
+        pos += 8 + size + (size & 1); // Chunks are padded to even sizes
+    }
+    return 0;
+}
+
+// Find the ID3v2 tag of a file without scanning it: at the start of the
+// file, in the "id3 " or "ID3 " chunk of a WAV (RIFF or RF64) or AIFF file,
+// or at the metadata offset in a DSF header. A typical file takes two or
+// three reads of ID3_LOCATOR_WINDOW bytes. Returns 1 and fills location
+// when a valid tag header is there, 0 otherwise.
+ID3_API int id3_locate_tag(ID3ReadAt read_at, void *ctx, ID3TagLocation *location) {
+    ID3ReadWindow window;
+    const uint8_t *head;
+    uint64_t offset = 0;
+
+    window.read_at = read_at;
+    window.ctx = ctx;
+    window.base = 0;
+    window.len = 0;
+    head = id3_window(&window, 0, 10);
+    if (!head) {
+        return 0;
+    }
+
+    // A tag at the start (MP3), else the container's own place for it; an
+    // offset of 0 from a container means it has no tag
+    if (memcmp(head, "ID3", 3) != 0) {
+        if ((head = id3_window(&window, 0, 28)) == NULL) {
+            return 0;
+        }
+        if ((memcmp(head, "RIFF", 4) == 0 || memcmp(head, "RF64", 4) == 0) &&
+            memcmp(&head[8], "WAVE", 4) == 0) {
+            offset = id3_find_chunk(&window, 12, 1);
+        } else if (memcmp(head, "FORM", 4) == 0 &&
+                   (memcmp(&head[8], "AIFF", 4) == 0 || memcmp(&head[8], "AIFC", 4) == 0)) {
+            offset = id3_find_chunk(&window, 12, 0);
+        } else if (memcmp(head, "DSD ", 4) == 0 && id3_le64(&head[4]) == 28) {
+            offset = id3_le64(&head[20]); // Metadata pointer
+        }
+        if (offset == 0) {
+            return 0;
+        }
+    }
+
+    head = id3_window(&window, offset, 10);
+    if (!head || !id3_probe_header(head, 10, &location->header)) {
+        return 0;
+    }
+    location->offset = offset;
+    return 1;
+}
+
+// Run a parser over the tag at location (and its v2.4 footer), reading it
+// in ID3_REGION_CHUNK pieces. Frame offsets are offsets in the input.
+// Returns ID3_DONE, ID3_MORE if the input ended inside the tag, or ID3_ERROR.
+ID3_API int id3_parse_region(ID3ReadAt read_at, void *ctx, const ID3TagLocation *location,
+                             ID3FrameCallback callback, void *user_data) {
+    uint8_t buf[ID3_REGION_CHUNK];
+    ID3Parser parser;
+    uint64_t pos = location->offset;
+    uint64_t end = pos + 10 + location->header.size + ((location->header.flags & 0x10) ? 10 : 0);
+    int result = ID3_MORE;
+
+    id3_parser_init(&parser, callback, user_data);
+    id3_parser_set_offset(&parser, pos);
+    while (result == ID3_MORE && pos < end) {
+        size_t n = (size_t)(end - pos < sizeof(buf) ? end - pos : sizeof(buf));
+
+        n = read_at(pos, buf, n, ctx);
+        if (n == 0) {
+            break;
+        }
+        result = id3_parser_feed(&parser, buf, n);
+        pos += n;
+    }
+    id3_parser_cleanup(&parser);
+    return result;
+}
+
+#ifndef ID3_NO_STDIO
+// ID3ReadAt for a FILE * opened in binary mode. Offsets beyond LONG_MAX
+// need a 64-bit long, or _fseeki64 on Windows.
+ID3_API size_t id3_file_read_at(uint64_t offset, uint8_t *buf, size_t len, void *file) {
+#if defined(_WIN32)
+    if (_fseeki64((FILE *)file, (__int64)offset, SEEK_SET) != 0) {
+        return 0;
+    }
+#else
+    if (offset > (uint64_t)LONG_MAX || fseek((FILE *)file, (long)offset, SEEK_SET) != 0) {
+        return 0;
+    }
+#endif
+    return fread(buf, 1, len, (FILE *)file);
+}
+
+// Locate and parse the tag of an MP3, WAV, AIFF or DSF file. Returns
+// ID3_DONE, ID3_MORE if the file ends inside the tag, or ID3_ERROR if the
+// file cannot be opened, has no tag, or a frame buffer failed.
+ID3_API int id3_parse_file(const char *path, ID3FrameCallback callback, void *user_data) {
+    FILE *file = fopen(path, "rb");
+    ID3TagLocation location;
+    int result = ID3_ERROR;
+
+    if (!file) {
+        return ID3_ERROR;
+    }
+    if (id3_locate_tag(id3_file_read_at, file, &location)) {
+        result = id3_parse_region(id3_file_read_at, file, &location, callback, user_data);
+    }
+    fclose(file);
+    return result;
+}
+#endif
+
+#define ID3_TAR_BLOCK 512
+
+// Flags in ID3TarWalker.pending
+#define ID3_TAR_PAX_SIZE  0x01
+#define ID3_TAR_LONG_NAME 0x02
+
+typedef enum {
+    ID3_TAR_HEADER,            // Reading a header block
+    ID3_TAR_PAX,               // Reading pax records for the next member
+    ID3_TAR_NAME,              // Reading a GNU long name for the next member
+    ID3_TAR_PROBE,             // Reading the first 10 bytes of a member
+    ID3_TAR_TAG,               // Streaming the member's tag into the parser
+    ID3_TAR_SKIP,              // Stepping over the rest of the entry
+    ID3_TAR_END,               // Past the end-of-archive blocks
+    ID3_TAR_BROKEN             // A header failed its checksum; nothing more is walked
+} ID3TarState;
+
+ID3_API void id3_tar_init(ID3TarWalker *walker, ID3FrameCallback frame_callback,
+                          ID3TarMemberCallback member_callback, void *user_data) {
+    memset(walker, 0, sizeof(ID3TarWalker));
+    id3_parser_init(&walker->parser, frame_callback, user_data);
+    walker->member_callback = member_callback;
+    walker->state = ID3_TAR_HEADER;
+}
+
+// Name of the member being parsed, e.g. from the frame callback
+ID3_API const char *id3_tar_member(const ID3TarWalker *walker) {
+    return walker->name;
+}
+
+ID3_API void id3_tar_cleanup(ID3TarWalker *walker) {
+    id3_parser_cleanup(&walker->parser);
+}
+
+// Numeric header field: octal digits, or base-256 when the top bit is set
+static uint64_t id3_tar_number(const uint8_t *field, size_t len) {
+    uint64_t value = 0;
+    size_t i = 0;
+
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7F;
+        for (i = 1; i < len; i++) {
+            value = value << 8 | field[i];
+        }
+        return value;
+    }
+    while (i < len && (field[i] == ' ' || field[i] == 0)) {
+        i++;
+    }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value << 3 | (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+// Write up to len bytes of name (stopping at a NUL) at position at of the
+// member name, cutting it at ID3_TAR_NAME_MAX; returns the new name length
+static size_t id3_tar_set_name(ID3TarWalker *walker, size_t at, const uint8_t *name, size_t len) {
+    const uint8_t *end = (const uint8_t *)memchr(name, 0, len);
+
+    if (end) {
+        len = (size_t)(end - name);
+    }
+    if (len > ID3_TAR_NAME_MAX - 1 - at) {
+        len = ID3_TAR_NAME_MAX - 1 - at;
+    }
+    memcpy(&walker->name[at], name, len);
+    walker->name[at + len] = '\0';
+    return at + len;
+}
+
+// Apply the path and size records of a pax extended header ("len key=value\n")
+static void id3_tar_pax(ID3TarWalker *walker) {
+    const uint8_t *records = walker->block;
+    size_t len = walker->block_len;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t record = 0;
+        size_t key = pos;
+        size_t value;
+
+        while (key < len && records[key] >= '0' && records[key] <= '9') {
+            record = record * 10 + (size_t)(records[key++] - '0');
+        }
+        if (key >= len || records[key] != ' ' || record == 0 || record > len - pos) {
+            return; // Malformed, or runs past what was kept
+        }
+        key++;
+        for (value = key; value < pos + record && records[value] != '='; value++) {
+        }
+        if (value >= pos + record - 1) {
+            return;
+        }
+        if (value - key == 4 && memcmp(&records[key], "path", 4) == 0) {
+            id3_tar_set_name(walker, 0, &records[value + 1], pos + record - 1 - (value + 1));
+            walker->pending |= ID3_TAR_LONG_NAME;
+        } else if (value - key == 4 && memcmp(&records[key], "size", 4) == 0) {
+            walker->pax_size = 0;
+            for (value++; value < pos + record && records[value] >= '0' && records[value] <= '9';
+                 value++) {
+                walker->pax_size = walker->pax_size * 10 + (uint64_t)(records[value] - '0');
+            }
+            walker->pending |= ID3_TAR_PAX_SIZE;
+        }
+        pos += record;
+    }
+}
+
+// Report the current member and step over the rest of its body
+static void id3_tar_end_member(ID3TarWalker *walker, int result) {
+    if (walker->member_callback) {
+        walker->member_callback(walker->name, walker->size, result, walker->parser.user_data);
+    }
+    id3_parser_reset(&walker->parser);
+    walker->state = ID3_TAR_SKIP;
+}
+
+// Decode a complete header block and pick the state for the entry's body
+static void id3_tar_header(ID3TarWalker *walker) {
+    const uint8_t *h = walker->block;
+    uint64_t size = id3_tar_number(&h[124], 12);
+    uint64_t checksum = 0;
+    size_t i;
+
+    for (i = 0; i < ID3_TAR_BLOCK && h[i] == 0; i++) {
+    }
+    if (i == ID3_TAR_BLOCK) {
+        // Two zero blocks end the archive
+        walker->state = ++walker->zero_blocks == 2 ? ID3_TAR_END : ID3_TAR_HEADER;
+        walker->block_len = 0;
+        return;
+    }
+    walker->zero_blocks = 0;
+    for (i = 0; i < ID3_TAR_BLOCK; i++) {
+        checksum += (i >= 148 && i < 156) ? ' ' : h[i];
+    }
+    if (checksum != id3_tar_number(&h[148], 8)) {
+        walker->state = ID3_TAR_BROKEN;
+        return;
+    }
+
+    if (h[156] == 'x') {
+        walker->state = ID3_TAR_PAX;
+    } else if (h[156] == 'L') {
+        walker->state = ID3_TAR_NAME;
+    } else if (h[156] == '0' || h[156] == 0 || h[156] == '7') {
+        if (walker->pending & ID3_TAR_PAX_SIZE) {
+            size = walker->pax_size;
+        }
+        if (!(walker->pending & ID3_TAR_LONG_NAME)) {
+            // POSIX ustar prefix (GNU headers use the field for times), then the name
+            size_t n = 0;
+
+            if (memcmp(&h[257], "ustar", 6) == 0 && h[345] != 0) {
+                n = id3_tar_set_name(walker, 0, &h[345], 155);
+                n = id3_tar_set_name(walker, n, (const uint8_t *)"/", 1);
+            }
+            id3_tar_set_name(walker, n, &h[0], 100);
+        }
+        walker->pending = 0;
+        walker->size = size;
+        walker->state = ID3_TAR_PROBE;
+    } else {
+        walker->pending = 0; // Directories, links, global pax headers
+        walker->state = ID3_TAR_SKIP;
+    }
+    walker->data_remaining = size;
+    walker->remaining = size + ((ID3_TAR_BLOCK - size % ID3_TAR_BLOCK) % ID3_TAR_BLOCK);
+    walker->block_len = 0;
+    if (walker->state == ID3_TAR_PROBE && size < 10) {
+        id3_tar_end_member(walker, ID3_ERROR); // Too short for a tag
+    }
+}
+
+// Feed member bytes to the parser and end the member when its tag or its
+// body does
+static void id3_tar_tag_bytes(ID3TarWalker *walker, const uint8_t *data, size_t len) {
+    int result = id3_parser_feed(&walker->parser, data, len);
+
+    if (result == ID3_ERROR) {
+        walker->error = 1;
+        id3_tar_end_member(walker, result);
+    } else if (result == ID3_DONE || walker->data_remaining == 0) {
+        id3_tar_end_member(walker, result); // Done, or the member ended inside the tag
+    }
+}
+
+// Walk a chunk of a tar archive of any size. Frames of each member's tag go
+// to the frame callback and each regular member to the member callback.
+// Returns ID3_MORE, ID3_DONE once the end-of-archive blocks are seen, or
+// ID3_ERROR if a frame buffer could not be allocated (that member is
+// reported with ID3_ERROR) or a header fails its checksum (nothing more is
+// walked).
+ID3_API int id3_tar_feed(ID3TarWalker *walker, const uint8_t *data, size_t len) {
+    walker->error = 0;
+
+    while (len > 0 && walker->state != ID3_TAR_END && walker->state != ID3_TAR_BROKEN) {
+        size_t n;
+
+        if (walker->state == ID3_TAR_HEADER) {
+            n = id3_min_size(len, ID3_TAR_BLOCK - walker->block_len);
+            memcpy(&walker->block[walker->block_len], data, n);
+            walker->block_len = (uint16_t)(walker->block_len + n);
+            if (walker->block_len == ID3_TAR_BLOCK) {
+                id3_tar_header(walker);
+            }
+        } else if (walker->state == ID3_TAR_PAX || walker->state == ID3_TAR_NAME) {
+            // Keep the first block of the body; records past it are dropped
+            size_t keep;
+
+            n = (size_t)(walker->data_remaining < len ? walker->data_remaining : len);
+            keep = id3_min_size(n, ID3_TAR_BLOCK - walker->block_len);
+            memcpy(&walker->block[walker->block_len], data, keep);
+            walker->block_len = (uint16_t)(walker->block_len + keep);
+            walker->data_remaining -= n;
+            walker->remaining -= n;
+            if (walker->data_remaining == 0) {
+                if (walker->state == ID3_TAR_PAX) {
+                    id3_tar_pax(walker);
+                } else {
+                    id3_tar_set_name(walker, 0, walker->block, walker->block_len);
+                    walker->pending |= ID3_TAR_LONG_NAME;
+                }
+                walker->state = ID3_TAR_SKIP;
+            }
+        } else if (walker->state == ID3_TAR_PROBE) {
+            ID3TagHeader header;
+
+            n = id3_min_size(len, 10 - walker->block_len);
+            memcpy(&walker->block[walker->block_len], data, n);
+            walker->block_len = (uint16_t)(walker->block_len + n);
+            walker->data_remaining -= n;
+            walker->remaining -= n;
+            if (walker->block_len == 10) {
+                if (id3_probe_header(walker->block, 10, &header)) {
+                    walker->state = ID3_TAR_TAG;
+                    id3_tar_tag_bytes(walker, walker->block, 10);
+                } else {
+                    id3_tar_end_member(walker, ID3_ERROR);
+                }
+            }
+        } else if (walker->state == ID3_TAR_TAG) {
+            n = (size_t)(walker->data_remaining < len ? walker->data_remaining : len);
+            walker->data_remaining -= n;
+            walker->remaining -= n;
+            id3_tar_tag_bytes(walker, data, n);
+        } else {
+            n = (size_t)(walker->remaining < len ? walker->remaining : len);
+            walker->remaining -= n;
+        }
+        data += n;
+        len -= n;
+        if (walker->remaining == 0 && walker->state != ID3_TAR_HEADER &&
+            walker->state != ID3_TAR_END && walker->state != ID3_TAR_BROKEN) {
+            walker->state = ID3_TAR_HEADER;
+            walker->block_len = 0;
+        }
+    }
+    if (walker->state == ID3_TAR_BROKEN) {
+        return ID3_ERROR;
+    }
+    if (walker->error) {
+        return ID3_ERROR;
+    }
+    return walker->state == ID3_TAR_END ? ID3_DONE : ID3_MORE;
+}
+
+// When the walker is stepping over the body of an entry (audio after a
+// member's tag, a member without a tag, directories), consume the rest of it
+// without data and return how many bytes the caller should seek past before
+// the next id3_tar_feed(). Returns 0 otherwise.
+ID3_API uint64_t id3_tar_skip(ID3TarWalker *walker) {
+    uint64_t n = walker->remaining;
+
+    if (walker->state != ID3_TAR_SKIP) {
+        return 0;
+    }
+    walker->remaining = 0;
+    walker->data_remaining = 0;
+    walker->state = ID3_TAR_HEADER;
+    walker->block_len = 0;
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ID3_IMPLEMENTATION
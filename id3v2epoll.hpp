@@ -0,0 +1,192 @@
+#pragma once
+
+// Edge-triggered epoll loop parsing the ID3v2 tag at the head of many
+// non-blocking streams at once, such as uploads on sockets or relays on
+// pipes, for C++11 on Linux. Builds with -fno-exceptions.
+//
+// id3::stream_loop<Sink> drives one ID3Parser per file descriptor through
+// id3_parser_feed(). Streams live in a table allocated once, 80 bytes each
+// on 64-bit targets, and all reads go through one buffer owned by the loop:
+// the parser keeps partial headers and frames itself, so streams need no
+// read buffer of their own. Frames and the end of each stream go to the
+// sink, which provides
+//
+//   void frame(uint64_t stream, const char *id, const uint8_t *data, uint32_t size);
+//   void end(uint64_t stream, Status status);
+//
+// frame() is the parser's frame callback: data is valid during the call.
+// end() gets Status::Done once the tag is parsed, Status::Error if a frame
+// buffer did not fit in the memory budget or could not be allocated, and
+// Status::More if the peer closed the stream, or reading it failed, before
+// the end of the tag. The loop has closed the descriptor by then.
+
+#include "id3v2parser.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace id3 {
+
+template <typename Sink>
+class stream_loop {
+public:
+    // Room for max_streams open streams, read buffer_size bytes at a time
+    stream_loop(Sink &sink, size_t max_streams, size_t buffer_size = 64 * 1024)
+        : sink_(sink), epoll_(epoll_create1(EPOLL_CLOEXEC)), slots_(new slot[max_streams]),
+          max_streams_(max_streams), buffer_(new uint8_t[buffer_size]), buffer_size_(buffer_size) {
+        free_.reserve(max_streams);
+        for (size_t i = max_streams; i-- > 0;) {
+            free_.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    stream_loop(const stream_loop &) = delete;
+    stream_loop &operator=(const stream_loop &) = delete;
+
+    // Closes the streams still open without telling the sink
+    ~stream_loop() {
+        for (size_t i = 0; i < max_streams_; i++) {
+            if (slots_[i].fd >= 0) {
+                ::close(slots_[i].fd);
+                id3_parser_cleanup(&slots_[i].parser);
+            }
+        }
+        if (epoll_ >= 0) {
+            ::close(epoll_);
+        }
+    }
+
+    // False if the epoll instance could not be created
+    bool valid() const { return epoll_ >= 0; }
+
+    // Start parsing fd, which is made non-blocking, reporting its frames as
+    // stream. The loop closes fd once the stream ends. Returns false,
+    // leaving fd open, if max_streams streams are open or epoll refuses fd.
+    bool add(int fd, uint64_t stream) {
+        int flags = ::fcntl(fd, F_GETFL);
+        epoll_event event = {};
+
+        if (free_.empty() || flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            return false;
+        }
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.u32 = free_.back();
+        if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            return false;
+        }
+
+        slot &added = slots_[free_.back()];
+
+        free_.pop_back();
+        id3_parser_init(&added.parser, on_frame, this);
+        added.stream = stream;
+        added.fd = fd;
+        active_++;
+        return true;
+    }
+
+    // Wait up to timeout_ms milliseconds (-1 for no limit) for streams with
+    // new data and parse all of it. Returns the number of streams served,
+    // or -1 if epoll_wait() failed.
+    int run_once(int timeout_ms) {
+        int ready = ::epoll_wait(epoll_, events_, event_batch, timeout_ms);
+
+        if (ready < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        for (int e = 0; e < ready; e++) {
+            serve(events_[e].data.u32);
+        }
+        return ready;
+    }
+
+    // Serve streams until every one added has ended. Returns false if
+    // epoll_wait() failed.
+    bool run() {
+        while (active_ > 0) {
+            if (run_once(-1) < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Streams open
+    size_t streams() const { return active_; }
+
+private:
+    static const int event_batch = 256;
+
+    struct slot {
+        ID3Parser parser;
+        uint64_t stream = 0;
+        int fd = -1;
+    };
+
+    static void on_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+        stream_loop *loop = static_cast<stream_loop *>(user_data);
+
+        loop->sink_.frame(loop->current_, id, data, size);
+    }
+
+    // Edge-triggered epoll reports new data once, so read until the
+    // descriptor would block or the stream ends
+    void serve(uint32_t index) {
+        slot &ready = slots_[index];
+
+        if (ready.fd < 0) {
+            return; // Ended earlier in this batch
+        }
+        current_ = ready.stream;
+        for (;;) {
+            ssize_t n = ::read(ready.fd, buffer_.get(), buffer_size_);
+
+            if (n > 0) {
+                int result = id3_parser_feed(&ready.parser, buffer_.get(), static_cast<size_t>(n));
+
+                if (result != ID3_MORE) {
+                    end(index, static_cast<Status>(result));
+                    return;
+                }
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else {
+                end(index, Status::More); // Closed or failed before the end of the tag
+                return;
+            }
+        }
+    }
+
+    void end(uint32_t index, Status status) {
+        slot &ended = slots_[index];
+        uint64_t stream = ended.stream;
+
+        ::epoll_ctl(epoll_, EPOLL_CTL_DEL, ended.fd, nullptr);
+        ::close(ended.fd);
+        id3_parser_cleanup(&ended.parser);
+        ended.fd = -1;
+        free_.push_back(index);
+        active_--;
+        sink_.end(stream, status); // May add streams, even into this slot
+    }
+
+    Sink &sink_;
+    int epoll_;
+    std::unique_ptr<slot[]> slots_;
+    size_t max_streams_;
+    std::vector<uint32_t> free_;
+    size_t active_ = 0;
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t buffer_size_;
+    uint64_t current_ = 0;
+    epoll_event events_[event_batch];
+};
+
+} // namespace id3
@@ -1,12 +1,37 @@
-#pragma once
+// ID3v2 streaming parser, as a single header.
+//
+// Include it anywhere for the declarations. In exactly one C or C++ file,
+// define ID3_IMPLEMENTATION before including it to compile the parser there
+// (id3v2parser.c does just that). Defining ID3_STATIC as well makes every
+// function static inline, so a program that parses in a single translation
+// unit gets the hot paths inlined into its own loops.
 
+#ifndef ID3V2PARSER_H
+#define ID3V2PARSER_H
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
+#ifndef ID3_API
+#ifdef ID3_STATIC
+#define ID3_API static inline
+#else
+#define ID3_API extern
+#endif
+#endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame ID as a big-endian integer, e.g. ID3_FOURCC('T','I','T','2').
+// ID3v2.2 IDs have a zero last byte: ID3_FOURCC('T','T','2',0).
+#define ID3_FOURCC(a, b, c, d) (((uint32_t)(uint8_t)(a) << 24) | \
+                                ((uint32_t)(uint8_t)(b) << 16) | \
+                                ((uint32_t)(uint8_t)(c) << 8) |  \
+                                (uint32_t)(uint8_t)(d))
 
 // ID3v2 parser state
 typedef enum {
@@ -15,41 +40,1834 @@ typedef enum {
     STATE_READ_EXT_HEADER,
     STATE_READ_FRAME_HEADER,
     STATE_READ_FRAME_DATA,
+    STATE_FRAME_READY,
+    STATE_SKIP_FRAME_DATA,
     STATE_DONE
 } ParserState;
 
+// Return codes of id3_parser_feed() and id3_parser_next()
+#define ID3_ERROR  -1   // Memory allocation failure
+#define ID3_MORE    0   // Need more data
+#define ID3_DONE    1   // Tag fully parsed
+#define ID3_FRAME   2   // id3_parser_next() only: a frame is ready
+
+// Frame callback: receives the frame ID, its data and the user data pointer
+// passed to id3_parser_init()
+typedef void (*ID3FrameCallback)(const char *id, const uint8_t *data,
+                                 uint32_t size, void *user_data);
+
+// A parsed frame returned by id3_parser_next(). Valid until the next call
+// on the same parser.
 typedef struct {
-    char id[5];
+    const char *id;
+    const uint8_t *data;
     uint32_t size;
-    uint16_t flags;
-    uint8_t *data;
-    uint32_t data_read;
-} ID3Frame;
+    uint64_t offset;           // Stream offset of the frame data
+    uint64_t tag_offset;       // Stream offset of the tag's "ID3" signature
+} ID3FrameView;
 
+// Fields of a 10-byte ID3v2 tag header
 typedef struct {
-    ParserState state;
-    uint8_t buffer[10];        // Temp buffer for headers
-    size_t buf_pos;            // Position in temp buffer
-    
-    // ID3v2 header info
+    uint8_t version;           // Major version (2, 3 or 4)
+    uint8_t revision;
+    uint8_t flags;
+    uint32_t size;             // Tag size excluding the 10-byte header
+} ID3TagHeader;
+
+// A tag header found by id3_scan_tags()
+typedef struct {
+    uint64_t offset;           // Stream offset of the "ID3" signature
+    ID3TagHeader header;
+} ID3TagLocation;
+
+// Bytes past a range that id3_scan_tags() needs to validate headers at its end
+#define ID3_SCAN_OVERLAP 19
+
+// Location of a frame inside an in-memory tag
+typedef struct {
+    char id[5];
+    uint32_t offset;           // Offset of the frame data from the start of the tag
+    uint32_t size;             // Size of the frame data
+} ID3FrameRef;
+
+// Result of id3_parse_batch(): one flat arena holding this header, an
+// ID3BatchEntry per input, the ID3BatchFrame records of all inputs and a pool
+// of frame data. Offsets are from the start of the arena unless noted, in
+// host byte order, so FFI callers can copy or map the arena as is.
+#define ID3_BATCH_FORMAT 1
+
+typedef struct {
+    char magic[4];             // "I3B" and ID3_BATCH_FORMAT
+    uint32_t count;            // Number of inputs and entries
+    uint32_t frame_count;      // Number of frame records
+    uint32_t entries;          // Offset of the entry table
+    uint32_t frames;           // Offset of the frame records
+    uint32_t pool;             // Offset of the frame data pool
+    uint32_t size;             // Bytes of the arena in use
+    uint32_t reserved;
+} ID3BatchHeader;
+
+typedef struct {
+    int32_t status;            // As from id3_parse_buffer(): ID3_DONE, ID3_MORE or ID3_ERROR (no tag)
+    uint32_t tag_size;         // Tag size excluding the 10-byte header
+    uint32_t first_frame;      // Index of the input's first frame record
+    uint32_t frame_count;      // Number of frame records for the input
     uint8_t version;
     uint8_t revision;
     uint8_t flags;
-    uint32_t tag_size;
-    uint32_t bytes_processed;
+    uint8_t reserved[5];
+} ID3BatchEntry;
+
+typedef struct {
+    uint64_t offset;           // Offset of the frame data within its input
+    char id[5];                // NUL-terminated frame ID
+    uint8_t reserved[3];
+    uint32_t input;            // Index of the input the frame belongs to
+    uint32_t size;             // Size of the frame data
+    uint32_t data;             // Offset of the stored data within the pool
+    uint32_t stored;           // Bytes stored: size, or less if cut at data_limit
+} ID3BatchFrame;
+
+// Frame buffer allocator shared by all parsers. Buffers are attached only
+// while a frame's data is being read, so idle parsers own no heap memory.
+typedef struct {
+    void *(*alloc)(size_t size, void *ctx);
+    void (*free)(void *ptr, size_t size, void *ctx);
+    void *ctx;
+} ID3Allocator;
+
+// What to do with a frame whose buffer would exceed the memory budget
+typedef enum {
+    ID3_BUDGET_SKIP,           // Skip the frame's data and continue with the next frame
+    ID3_BUDGET_FAIL            // Stop with ID3_ERROR
+} ID3BudgetPolicy;
+
+// Process-wide frame memory accounting
+typedef struct {
+    size_t in_use;             // Bytes of frame buffers currently allocated
+    uint32_t skipped;          // Frames skipped under ID3_BUDGET_SKIP
+    uint32_t failed;           // Frames failed under ID3_BUDGET_FAIL
+} ID3MemoryStats;
+
+// Compact parser state: 64 bytes on 64-bit targets, 46 bytes on AVR. The
+// budget was 48 bytes until the two 64-bit stream offsets were added; it is
+// now 64 bytes, checked below.
+typedef struct {
+    // Callback for completed frames
+    ID3FrameCallback frame_callback;
+    void *user_data;           // Passed back to frame_callback
     
-    // Extended header
-    uint32_t ext_header_size;
-    uint32_t ext_bytes_read;
+    // Absolute positions, so streams past 4 GB keep exact offsets
+    uint64_t stream_pos;       // Stream offset of the next input byte
+    uint64_t tag_offset;       // Stream offset of the current tag's "ID3"
     
     // Current frame being parsed
-    ID3Frame current_frame;
-    int frame_valid;
+    uint8_t *frame_data;       // Frame data (NULL until the frame header is read)
+    uint32_t size;             // Size of the current frame or extended header
+    uint32_t pos;              // Bytes read of the current header or frame
     
-    // Callback for completed frames
-    void (*frame_callback)(const char *id, const uint8_t *data, uint32_t size);
+    uint32_t tag_remaining;    // Tag bytes left after the 10-byte header
+    uint8_t buffer[10];        // Temp buffer for headers, holds the frame ID once parsed
+    uint8_t state;             // ParserState
+    uint8_t version;           // ID3v2 major version of the current tag
 } ID3Parser;
 
+// Compile-time assertion for C99 as well as C11 and C++11
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define ID3_STATIC_ASSERT(cond, name) static_assert(cond, #name)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ID3_STATIC_ASSERT(cond, name) _Static_assert(cond, #name)
+#else
+#define ID3_STATIC_ASSERT(cond, name) typedef char id3_assert_##name[(cond) ? 1 : -1]
+#endif
+
+ID3_STATIC_ASSERT(sizeof(ID3Parser) <= 64, parser_state_fits_64_bytes);
+
+
+ID3_API int id3_parser_feed(ID3Parser *parser, const uint8_t *data, size_t len);
+ID3_API int id3_parser_next(ID3Parser *parser, const uint8_t *data, size_t len,
+                            size_t *consumed, ID3FrameView *frame);
+ID3_API void id3_parser_init(ID3Parser *parser, ID3FrameCallback callback, void *user_data);
+ID3_API size_t id3_parser_need(const ID3Parser *parser);
+ID3_API void id3_parser_set_offset(ID3Parser *parser, uint64_t offset);
+ID3_API uint64_t id3_parser_tag_offset(const ID3Parser *parser);
+ID3_API uint64_t id3_parser_frame_offset(const ID3Parser *parser);
+ID3_API size_t id3_parser_save(const ID3Parser *parser, uint8_t *out, size_t cap);
+ID3_API int id3_parser_restore(ID3Parser *parser, const uint8_t *blob, size_t len);
+ID3_API uint8_t *id3_parser_take_frame(ID3Parser *parser);
+ID3_API uint8_t *id3_alloc_frame(uint32_t size);
+ID3_API void id3_free_frame(uint8_t *data, uint32_t size);
+ID3_API int id3_budget_reserve(uint32_t size);
+ID3_API void id3_budget_release(uint32_t size);
+ID3_API void id3_parser_reset(ID3Parser *parser);
+ID3_API void id3_parser_cleanup(ID3Parser *parser);
+ID3_API ID3Parser *id3_parser_acquire(ID3FrameCallback callback, void *user_data);
+ID3_API void id3_parser_release(ID3Parser *parser);
+ID3_API void id3_set_allocator(const ID3Allocator *allocator);
+ID3_API void id3_frame_cache_flush(void);
+ID3_API void id3_set_memory_budget(size_t limit, ID3BudgetPolicy policy);
+ID3_API ID3BudgetPolicy id3_get_budget_policy(void);
+ID3_API void id3_get_memory_stats(ID3MemoryStats *stats);
+
+ID3_API int id3_probe_header(const uint8_t *data, size_t len, ID3TagHeader *header);
+ID3_API size_t id3_probe_headers(const uint8_t *const *data, const size_t *len, size_t count,
+                                 ID3TagHeader *headers, uint8_t *valid);
+ID3_API int id3_parse_buffer(const uint8_t *tag, size_t len, ID3FrameCallback callback, void *user_data);
+ID3_API int id3_index_frames(const uint8_t *tag, size_t len, ID3FrameRef *frames, size_t max);
+ID3_API size_t id3_scan_tags(const uint8_t *data, size_t len, size_t scan_len, uint64_t base,
+                             ID3TagLocation *tags, size_t max);
+ID3_API size_t id3_resolve_tags(ID3TagLocation *tags, size_t count);
+ID3_API size_t id3_parse_batch(const uint8_t *const *data, const size_t *len, size_t count,
+                               uint32_t data_limit, uint8_t *arena, size_t cap);
+#ifndef ID3_NO_STDIO
+ID3_API size_t id3_parse_batch_files(const char *const *paths, size_t count,
+                                     uint32_t data_limit, uint8_t *arena, size_t cap);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ID3V2PARSER_H
+
+#if defined(ID3_IMPLEMENTATION) && !defined(ID3_IMPLEMENTATION_INCLUDED)
+#define ID3_IMPLEMENTATION_INCLUDED
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compile-time frame filter. Build with ID3_FRAME_WANTED(fourcc) defined as
+// an expression over the frame's ID3_FOURCC value to keep only some frames:
+// the rest are skipped without being buffered or delivered, and the check is
+// inlined into the frame loops. Default: every frame is wanted.
+#ifndef ID3_FRAME_WANTED
+#define ID3_FRAME_WANTED(fourcc) 1
+#endif
+
+// Lock-free counters for the memory budget. Toolchains without GCC-style
+// atomics are assumed to run parsers from a single thread.
+#if defined(__GNUC__)
+#define ID3_ATOMIC_LOAD(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define ID3_ATOMIC_ADD(p, v)    __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define ID3_ATOMIC_SUB(p, v)    __atomic_fetch_sub(p, v, __ATOMIC_RELAXED)
+#define ID3_ATOMIC_CAS(p, expected, desired) \
+    __atomic_compare_exchange_n(p, expected, desired, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+#define ID3_ATOMIC_LOAD(p)      (*(p))
+#define ID3_ATOMIC_ADD(p, v)    (*(p) += (v))
+#define ID3_ATOMIC_SUB(p, v)    (*(p) -= (v))
+#define ID3_ATOMIC_CAS(p, expected, desired) \
+    (*(p) == *(expected) ? (*(p) = (desired), 1) : (*(expected) = *(p), 0))
+#endif
+
+// Synchsafe integer decode (7 bits per byte)
+static uint32_t id3_synchsafe_to_uint32(const uint8_t *buf) {
+    return ((uint32_t)buf[0] << 21) |
+           ((uint32_t)buf[1] << 14) |
+           ((uint32_t)buf[2] << 7) |
+           ((uint32_t)buf[3]);
+}
+
+
+// Regular 32-bit integer decode (big-endian)
+static uint32_t id3_bytes_to_uint32(const uint8_t *buf) {
+    return ((uint32_t)buf[0] << 24) |
+           ((uint32_t)buf[1] << 16) |
+           ((uint32_t)buf[2] << 8) |
+           ((uint32_t)buf[3]);
+}
+
+static size_t id3_min_size(size_t a, size_t b) {
+    return (a < b) ? a : b;
+}
+
+// Validate and decode a 10-byte tag header. Checks the signature, a known
+// major version, no reserved flags and a well-formed synchsafe size.
+static int id3_parse_tag_header(const uint8_t *buf, ID3TagHeader *header) {
+    // Flags undefined for each major version
+    static const uint8_t reserved_flags[5] = { 0xFF, 0xFF, 0x3F, 0x1F, 0x0F };
+    
+    // Fold every byte check into one value so valid headers take one branch
+    uint8_t bad = (uint8_t)((buf[0] ^ 'I') | (buf[1] ^ 'D') | (buf[2] ^ '3') |
+                            ((buf[6] | buf[7] | buf[8] | buf[9]) & 0x80));
+    
+    if (bad || buf[3] < 2 || buf[3] > 4 || buf[4] == 0xFF ||
+        (buf[5] & reserved_flags[buf[3]])) {
+        return 0;
+    }
+    
+    header->version = buf[3];
+    header->revision = buf[4];
+    header->flags = buf[5];
+    header->size = id3_synchsafe_to_uint32(&buf[6]);
+    return 1;
+}
+
+// Check whether data starts with a valid ID3v2 tag header and decode it.
+// Returns 1 if so, 0 otherwise (including when len < 10).
+ID3_API int id3_probe_header(const uint8_t *data, size_t len, ID3TagHeader *header) {
+    return len >= 10 && id3_parse_tag_header(data, header);
+}
+
+#if defined(__AVX2__)
+// Batch probing with AVX2 takes headers eight at a time as struct-of-arrays
+// of big-endian words: bytes 0-3 (signature and major version), 4-7
+// (revision and flags on top) and 6-9 (synchsafe size). The checks of
+// id3_parse_tag_header() then become lane-wise arithmetic without branches,
+// so a mix of valid and invalid buffers costs no mispredictions.
+#define ID3_PROBE_LANES 8
+
+typedef struct {
+    uint32_t head[ID3_PROBE_LANES];
+    uint32_t mid[ID3_PROBE_LANES];
+    uint32_t size[ID3_PROBE_LANES];  // Decoded
+    uint32_t ok[ID3_PROBE_LANES];    // 1 for a valid header
+} ID3ProbeLanes;
+
+// Stands in for short buffers and unused lanes, and fails the signature
+static const uint8_t id3_no_header[10] = { 0 };
+
+// Validate and decode the headers of eight buffers of at least 10 bytes
+static void id3_probe_lanes(const uint8_t *const *buf, ID3ProbeLanes *lanes) {
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i head, mid, raw, version, flags, good;
+    
+#define ID3_LANE_WORDS(at)                                                                          \
+    _mm256_setr_epi32((int)id3_bytes_to_uint32(&buf[0][at]), (int)id3_bytes_to_uint32(&buf[1][at]), \
+                      (int)id3_bytes_to_uint32(&buf[2][at]), (int)id3_bytes_to_uint32(&buf[3][at]), \
+                      (int)id3_bytes_to_uint32(&buf[4][at]), (int)id3_bytes_to_uint32(&buf[5][at]), \
+                      (int)id3_bytes_to_uint32(&buf[6][at]), (int)id3_bytes_to_uint32(&buf[7][at]))
+    head = ID3_LANE_WORDS(0);
+    mid = ID3_LANE_WORDS(4);
+    raw = ID3_LANE_WORDS(6);
+#undef ID3_LANE_WORDS
+    version = _mm256_and_si256(head, byte);
+    flags = _mm256_and_si256(_mm256_srli_epi32(mid, 16), byte);
+    
+    // Signature, major version 2-4, revision not 0xFF
+    good = _mm256_cmpeq_epi32(_mm256_srli_epi32(head, 8), _mm256_set1_epi32(0x494433));
+    good = _mm256_and_si256(good, _mm256_cmpgt_epi32(version, _mm256_set1_epi32(1)));
+    good = _mm256_and_si256(good, _mm256_cmpgt_epi32(_mm256_set1_epi32(5), version));
+    good = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_srli_epi32(mid, 24), byte), good);
+    
+    // Reserved flags are the low 8 - version bits: 0x3F, 0x1F, 0x0F
+    good = _mm256_and_si256(good, _mm256_cmpeq_epi32(
+        _mm256_and_si256(flags, _mm256_srlv_epi32(byte, version)), zero));
+        
+    // Synchsafe size: no byte has its top bit set
+    good = _mm256_and_si256(good, _mm256_cmpeq_epi32(
+        _mm256_and_si256(raw, _mm256_set1_epi32((int)0x80808080u)), zero));
+        
+    _mm256_storeu_si256((__m256i *)lanes->head, head);
+    _mm256_storeu_si256((__m256i *)lanes->mid, mid);
+    _mm256_storeu_si256((__m256i *)lanes->ok, _mm256_srli_epi32(good, 31));
+    _mm256_storeu_si256((__m256i *)lanes->size, _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(raw, 3), _mm256_set1_epi32(0x0FE00000)),
+                        _mm256_and_si256(_mm256_srli_epi32(raw, 2), _mm256_set1_epi32(0x001FC000))),
+        _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(raw, 1), _mm256_set1_epi32(0x00003F80)),
+                        _mm256_and_si256(raw, _mm256_set1_epi32(0x7F)))));
+}
+
+// Probe the headers of count in-memory buffers in one call. valid[n] is set
+// to 1 when headers[n] holds the decoded header of data[n]; the other
+// entries of headers may be overwritten. Returns the number of valid headers.
+ID3_API size_t id3_probe_headers(const uint8_t *const *data, const size_t *len, size_t count,
+                                 ID3TagHeader *headers, uint8_t *valid) {
+    size_t found = 0;
+    size_t base;
+    
+    for (base = 0; base < count; base += ID3_PROBE_LANES) {
+        size_t lanes = id3_min_size(count - base, ID3_PROBE_LANES);
+        const uint8_t *buf[ID3_PROBE_LANES];
+        ID3ProbeLanes probe;
+        size_t n;
+        
+        for (n = 0; n < ID3_PROBE_LANES; n++) {
+            buf[n] = (n < lanes && len[base + n] >= 10) ? data[base + n] : id3_no_header;
+        }
+        id3_probe_lanes(buf, &probe);
+        
+        for (n = 0; n < lanes; n++) {
+            ID3TagHeader *header = &headers[base + n];
+            
+            header->version = (uint8_t)probe.head[n];
+            header->revision = (uint8_t)(probe.mid[n] >> 24);
+            header->flags = (uint8_t)(probe.mid[n] >> 16);
+            header->size = probe.size[n];
+            valid[base + n] = (uint8_t)probe.ok[n];
+            found += probe.ok[n];
+        }
+    }
+    return found;
+}
+#else
+// Probe the headers of count in-memory buffers in one call. valid[n] is set
+// to 1 when headers[n] holds the decoded header of data[n]; the other
+// entries of headers may be overwritten. Returns the number of valid headers.
+// Without AVX2 this is one id3_probe_header() per buffer: branch-free scalar
+// lanes measured slower than the early exits of the plain checks.
+ID3_API size_t id3_probe_headers(const uint8_t *const *data, const size_t *len, size_t count,
+                                 ID3TagHeader *headers, uint8_t *valid) {
+    size_t found = 0;
+    size_t n;
+    
+    for (n = 0; n < count; n++) {
+        valid[n] = (uint8_t)id3_probe_header(data[n], len[n], &headers[n]);
+        found += valid[n];
+    }
+    return found;
+}
+#endif
+
+// Visitor for id3_walk_frames(); return nonzero to stop the walk
+typedef int (*ID3FrameVisitor)(const char *id, uint32_t offset, uint32_t size, void *ctx);
+
+// Frame size decoders for each major version
+static uint32_t id3_frame_size_v2(const uint8_t *header) {
+    return ((uint32_t)header[3] << 16) | ((uint32_t)header[4] << 8) | header[5];
+}
+
+static uint32_t id3_frame_size_v3(const uint8_t *header) {
+    return id3_bytes_to_uint32(&header[4]);
+}
+
+static uint32_t id3_frame_size_v4(const uint8_t *header) {
+    return id3_synchsafe_to_uint32(&header[4]);
+}
+
+// Frame header layout of each supported major version:
+// X(version, header size, ID length, size decoder)
+#define ID3_FRAME_LAYOUTS(X)                 \
+    X(2, 6, 3, id3_frame_size_v2)            \
+    X(3, 10, 4, id3_frame_size_v3)           \
+    X(4, 10, 4, id3_frame_size_v4)
+
+// ID3_FOURCC value of the frame ID at the start of a frame header
+#define ID3_FRAME_FOURCC(header, id_len) \
+    (id3_bytes_to_uint32(header) & ((id_len) == 4 ? 0xFFFFFFFFu : 0xFFFFFF00u))
+
+// Frame loop over a tag in memory, specialised per version so the loop body
+// has no version checks. Frames rejected by ID3_FRAME_WANTED are stepped
+// over. Walks up to end, the end of the tag or of the buffer if that comes
+// first. Returns ID3_DONE where the streaming parser would finish the tag (at
+// padding, at a frame running past tag_end, at tag_end, or when the visitor
+// asks to stop) and ID3_MORE if the buffer ends first.
+#define ID3_DEFINE_FRAME_WALKER(version, header_size, id_len, frame_size)     \
+static int id3_walk_frames_v##version(const uint8_t *tag, uint32_t pos,       \
+                                      uint32_t end, uint32_t tag_end,         \
+                                      ID3FrameVisitor visit, void *ctx) {     \
+    while (end - pos >= header_size && tag[pos] != 0) {                       \
+        uint32_t size = frame_size(&tag[pos]);                                \
+        int wanted = ID3_FRAME_WANTED(ID3_FRAME_FOURCC(&tag[pos], id_len));   \
+        char id[5];                                                           \
+                                                                              \
+        memcpy(id, &tag[pos], id_len);                                        \
+        id[id_len] = '\0';                                                    \
+        pos += header_size;                                                   \
+        if (size > tag_end - pos) {                                           \
+            return ID3_DONE;                                                  \
+        }                                                                     \
+        if (size > end - pos) {                                               \
+            return ID3_MORE;                                                  \
+        }                                                                     \
+        if (wanted && visit(id, pos, size, ctx)) {                            \
+            return ID3_DONE;                                                  \
+        }                                                                     \
+        pos += size;                                                          \
+    }                                                                         \
+    return (end - pos < header_size && end < tag_end) ? ID3_MORE : ID3_DONE;  \
+}
+
+ID3_FRAME_LAYOUTS(ID3_DEFINE_FRAME_WALKER)
+
+typedef struct {
+    uint32_t header_size;
+    uint32_t id_len;
+    uint32_t (*frame_size)(const uint8_t *header);
+    int (*walk)(const uint8_t *tag, uint32_t pos, uint32_t end, uint32_t tag_end,
+                ID3FrameVisitor visit, void *ctx);
+} ID3FrameLayout;
+
+#define ID3_FRAME_LAYOUT_ENTRY(version, header_size, id_len, frame_size)      \
+    { header_size, id_len, frame_size, id3_walk_frames_v##version },
+
+static const ID3FrameLayout id3_frame_layouts[] = { ID3_FRAME_LAYOUTS(ID3_FRAME_LAYOUT_ENTRY) };
+
+// Layout for a validated major version (2-4)
+#define ID3_LAYOUT(version) (&id3_frame_layouts[(version) - 2])
+
+// Walk the frames of a tag held in memory, with the same rules as the
+// streaming parser. Returns ID3_ERROR if tag does not start with a valid
+// header, otherwise ID3_DONE or ID3_MORE as id3_parser_feed() would after
+// being fed the buffer.
+static int id3_walk_frames(const uint8_t *tag, size_t len, ID3FrameVisitor visit, void *ctx) {
+    ID3TagHeader header;
+    uint32_t pos = 10;
+    uint32_t tag_end;
+    uint32_t end;
+    
+    if (!id3_probe_header(tag, len, &header)) {
+        return ID3_ERROR;
+    }
+    
+    // Only walk what is both inside the tag and inside the buffer
+    tag_end = header.size + 10;
+    end = (tag_end > len) ? (uint32_t)len : tag_end;
+    
+    // Skip extended header (ID3v2.3+)
+    if ((header.flags & 0x40) && header.version >= 3) {
+        uint32_t ext_size;
+        
+        if (end - pos < 4) {
+            return (end < tag_end) ? ID3_MORE : ID3_DONE;
+        }
+        if (header.version == 4) {
+            ext_size = id3_synchsafe_to_uint32(&tag[pos]); // Includes the size field
+        } else {
+            ext_size = id3_bytes_to_uint32(&tag[pos]) + 4;
+        }
+        if (ext_size > tag_end - pos) {
+            return ID3_DONE; // Corrupt extended header
+        }
+        if (ext_size > end - pos) {
+            return ID3_MORE;
+        }
+        pos += (ext_size > 4) ? ext_size : 4;
+    }
+    
+    // Version-specific loop, chosen once per tag
+    return ID3_LAYOUT(header.version)->walk(tag, pos, end, tag_end, visit, ctx);
+}
+
+typedef struct {
+    const uint8_t *tag;
+    ID3FrameCallback callback;
+    void *user_data;
+} ID3BufferState;
+
+static int id3_deliver_frame(const char *id, uint32_t offset, uint32_t size, void *ctx) {
+    ID3BufferState *buffer = (ID3BufferState *)ctx;
+    
+    if (buffer->callback) {
+        buffer->callback(id, buffer->tag + offset, size, buffer->user_data);
+    }
+    return 0;
+}
+
+// Parse a tag that is already in memory (tag points at the "ID3" header),
+// calling callback for each frame with a pointer into the buffer; nothing is
+// copied or allocated. Delivers the same frames as id3_parser_feed().
+// Returns ID3_DONE, ID3_MORE if the buffer ends before the tag does and more
+// frames could follow (frames that fit were delivered) or ID3_ERROR if there
+// is no valid tag header: the status id3_parser_feed() returns for the buffer.
+ID3_API int id3_parse_buffer(const uint8_t *tag, size_t len, ID3FrameCallback callback, void *user_data) {
+    ID3BufferState buffer = { tag, callback, user_data };
+    
+    return id3_walk_frames(tag, len, id3_deliver_frame, &buffer);
+}
+
+typedef struct {
+    ID3FrameRef *frames;
+    size_t max;
+    int count;
+} ID3IndexState;
+
+static int id3_index_frame(const char *id, uint32_t offset, uint32_t size, void *ctx) {
+    ID3IndexState *index = (ID3IndexState *)ctx;
+    
+    if ((size_t)index->count < index->max) {
+        ID3FrameRef *ref = &index->frames[index->count];
+        memcpy(ref->id, id, 5);
+        ref->offset = offset;
+        ref->size = size;
+    }
+    index->count++;
+    return 0;
+}
+
+// Build an index of the frames of a complete tag in memory (tag points at the
+// "ID3" header). Stores up to max entries and returns the total number of
+// frames, so a call with max = 0 sizes the array. Returns -1 if tag does not
+// start with a valid tag header.
+ID3_API int id3_index_frames(const uint8_t *tag, size_t len, ID3FrameRef *frames, size_t max) {
+    ID3IndexState index = { frames, max, 0 };
+    
+    if (id3_walk_frames(tag, len, id3_index_frame, &index) < 0) {
+        return -1;
+    }
+    return index.count;
+}
+
+// A header found by a scan is more likely a real tag if what follows is
+// sane: an extended header the version allows, or a first frame with
+// an ID of A-Z and 0-9 and a size that fits in the tag (all zeros for a tag
+// that starts with padding). Only checked when those bytes are in the buffer.
+static int id3_plausible_tag(const uint8_t *tag, size_t len, const ID3TagHeader *header) {
+    const ID3FrameLayout *layout = ID3_LAYOUT(header->version);
+    const uint8_t *frame = &tag[10];
+    uint8_t any = 0;
+    size_t i;
+    
+    if ((header->flags & 0x40) && header->version >= 3) {
+        uint32_t ext_size;
+        
+        if (len < 16) {
+            return 1;
+        }
+        if (header->version == 3) {
+            ext_size = id3_bytes_to_uint32(frame);
+            return (ext_size == 6 || ext_size == 10) && ext_size + 4 <= header->size;
+        }
+        // v2.4: 6 to 15 bytes, one flag byte with only 0x70 defined
+        ext_size = id3_synchsafe_to_uint32(frame);
+        return ext_size >= 6 && ext_size <= 15 && ext_size <= header->size &&
+               frame[0] == 0 && frame[1] == 0 && frame[2] == 0 &&
+               frame[4] == 1 && (frame[5] & 0x8F) == 0;
+    }
+    
+    if (len < 10 + layout->header_size || header->size < layout->header_size) {
+        return 1;
+    }
+    if (frame[0] == 0) {
+        for (i = 0; i < layout->header_size; i++) {
+            any |= frame[i];
+        }
+        return any == 0;
+    }
+    for (i = 0; i < layout->id_len; i++) {
+        if (!((frame[i] >= 'A' && frame[i] <= 'Z') || (frame[i] >= '0' && frame[i] <= '9'))) {
+            return 0;
+        }
+    }
+    return layout->frame_size(frame) <= header->size - layout->header_size;
+}
+
+// Find every valid tag header whose "ID3" starts in the first scan_len bytes
+// of data; data[0] is at stream offset base. To scan a large stream in
+// parallel ranges, give each range ID3_SCAN_OVERLAP bytes of the next one
+// beyond scan_len so headers across the boundary are validated like the
+// rest. Stores up to max locations in stream order and returns the total
+// found. Headers inside other tags are reported too: see id3_resolve_tags().
+ID3_API size_t id3_scan_tags(const uint8_t *data, size_t len, size_t scan_len, uint64_t base,
+                             ID3TagLocation *tags, size_t max) {
+    size_t count = 0;
+    size_t pos = 0;
+    
+    if (scan_len > len) {
+        scan_len = len;
+    }
+    while (pos < scan_len) {
+        const uint8_t *hit = (const uint8_t *)memchr(&data[pos], 'I', scan_len - pos);
+        ID3TagHeader header;
+        
+        if (!hit) {
+            break;
+        }
+        pos = (size_t)(hit - data);
+        if (id3_probe_header(hit, len - pos, &header) &&
+            id3_plausible_tag(hit, len - pos, &header)) {
+            if (count < max) {
+                tags[count].offset = base + pos;
+                tags[count].header = header;
+            }
+            count++;
+        }
+        pos++;
+    }
+    return count;
+}
+
+// Drop locations that start inside an earlier tag (including a v2.4
+// footer), e.g. "ID3" bytes in a cover picture. tags must be in stream
+// order, as the concatenated results of id3_scan_tags() over consecutive
+// ranges are. Compacts tags in place and returns how many are kept.
+ID3_API size_t id3_resolve_tags(ID3TagLocation *tags, size_t count) {
+    uint64_t end = 0;
+    size_t kept = 0;
+    size_t i;
+    
+    for (i = 0; i < count; i++) {
+        const ID3TagHeader *header = &tags[i].header;
+        
+        if (tags[i].offset < end) {
+            continue;
+        }
+        end = tags[i].offset + 10 + header->size;
+        if (header->version == 4 && (header->flags & 0x10)) {
+            end += 10;
+        }
+        tags[kept++] = tags[i];
+    }
+    return kept;
+}
+
+#ifdef ID3_FRAME_CACHE
+// Per-thread cache of freed frame buffers, enabled with -DID3_FRAME_CACHE.
+// Sizes are rounded up to power-of-two classes from 32 bytes to
+// ID3_FRAME_CACHE_MAX; each thread keeps up to ID3_FRAME_CACHE_DEPTH buffers
+// per class, linked through their first bytes. Each buffer carries a header
+// naming the cache it came from, and a buffer freed on another thread is
+// pushed onto its owner's remote list, lock-free, for the owner to take back
+// the next time a class runs dry. Once the owner flushes, buffers still out
+// go back to malloc, and the last one freed frees the cache itself.
+#ifndef ID3_FRAME_CACHE_MAX
+#define ID3_FRAME_CACHE_MAX 4096
+#endif
+#ifndef ID3_FRAME_CACHE_DEPTH
+#define ID3_FRAME_CACHE_DEPTH 8
+#endif
+
+#if defined(__cplusplus)
+#define ID3_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define ID3_THREAD_LOCAL _Thread_local
+#else
+#define ID3_THREAD_LOCAL __thread
+#endif
+
+// Remote frees publish the buffer they push; the owner acquires the list
+#if defined(__GNUC__)
+#define ID3_ATOMIC_PUSH(p, expected, desired) \
+    __atomic_compare_exchange_n(p, expected, desired, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#define ID3_ATOMIC_TAKE(p, v)   __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define ID3_ATOMIC_COUNT(p, v)  __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#else
+#define ID3_ATOMIC_PUSH(p, expected, desired) ID3_ATOMIC_CAS(p, expected, desired)
+#define ID3_ATOMIC_TAKE(p, v)   id3_cache_take(p, v)
+#define ID3_ATOMIC_COUNT(p, v)  ID3_ATOMIC_ADD(p, v)
+#endif
+
+#define ID3_CACHE_MIN_SHIFT 5
+#define ID3_CACHE_CLASSES 16
+
+typedef struct ID3CachedBuffer {
+    struct ID3CachedBuffer *next;
+} ID3CachedBuffer;
+
+typedef struct ID3FrameCache {
+    ID3CachedBuffer *lists[ID3_CACHE_CLASSES];
+    unsigned int counts[ID3_CACHE_CLASSES];
+    size_t out;                // Buffers handed out and not yet back
+    ID3CachedBuffer *remote;   // Freed on other threads; ID3_CACHE_CLOSED once flushed
+    size_t orphans;            // After the flush: out, less the frees since
+} ID3FrameCache;
+
+// Precedes every cacheable buffer
+typedef struct ID3CacheHeader {
+    ID3FrameCache *owner;      // NULL if no cache could be set up
+    size_t cls;
+} ID3CacheHeader;
+
+static ID3CachedBuffer id3_cache_closed;
+#define ID3_CACHE_CLOSED (&id3_cache_closed)
+
+static ID3_THREAD_LOCAL ID3FrameCache *id3_cache;
+
+#if !defined(__GNUC__)
+static ID3CachedBuffer *id3_cache_take(ID3CachedBuffer **list, ID3CachedBuffer *value) {
+    ID3CachedBuffer *taken = *list;
+    
+    *list = value;
+    return taken;
+}
+#endif
+
+static ID3CacheHeader *id3_cache_header(void *buffer) {
+    return (ID3CacheHeader *)buffer - 1;
+}
+
+// Size class of a cacheable buffer, or -1 if it is too large
+static int id3_cache_class(size_t size) {
+    int cls = 0;
+    
+    if (size > ID3_FRAME_CACHE_MAX) {
+        return -1;
+    }
+    while (((size_t)1 << (cls + ID3_CACHE_MIN_SHIFT)) < size) {
+        cls++;
+    }
+    return (cls < ID3_CACHE_CLASSES) ? cls : -1;
+}
+
+// Keep a buffer that came back to its owner, or free it if its class is full
+static void id3_cache_keep(ID3FrameCache *cache, ID3CachedBuffer *buffer) {
+    size_t cls = id3_cache_header(buffer)->cls;
+    
+    cache->out--;
+    if (cache->counts[cls] >= ID3_FRAME_CACHE_DEPTH) {
+        free(id3_cache_header(buffer));
+        return;
+    }
+    buffer->next = cache->lists[cls];
+    cache->lists[cls] = buffer;
+    cache->counts[cls]++;
+}
+
+static void *id3_default_alloc(size_t size, void *ctx) {
+    ID3FrameCache *cache = id3_cache;
+    ID3CacheHeader *header;
+    int cls = id3_cache_class(size);
+    (void)ctx;
+    
+    if (cls < 0) {
+        return malloc(size);
+    }
+    if (!cache) {
+        cache = (ID3FrameCache *)calloc(1, sizeof(ID3FrameCache));
+        id3_cache = cache;
+    }
+    if (cache && !cache->lists[cls] && ID3_ATOMIC_LOAD(&cache->remote)) {
+        ID3CachedBuffer *buffer = ID3_ATOMIC_TAKE(&cache->remote, (ID3CachedBuffer *)NULL);
+        
+        while (buffer) {
+            ID3CachedBuffer *next = buffer->next;
+            
+            id3_cache_keep(cache, buffer);
+            buffer = next;
+        }
+    }
+    if (cache && cache->lists[cls]) {
+        ID3CachedBuffer *buffer = cache->lists[cls];
+        cache->lists[cls] = buffer->next;
+        cache->counts[cls]--;
+        cache->out++;
+        return buffer;
+    }
+    header = (ID3CacheHeader *)malloc(sizeof(ID3CacheHeader) + ((size_t)1 << (cls + ID3_CACHE_MIN_SHIFT)));
+    if (!header) {
+        return NULL;
+    }
+    header->owner = cache;
+    header->cls = (size_t)cls;
+    if (cache) {
+        cache->out++;
+    }
+    return header + 1;
+}
+
+static void id3_default_free(void *ptr, size_t size, void *ctx) {
+    ID3CacheHeader *header;
+    ID3FrameCache *owner;
+    ID3CachedBuffer *head;
+    (void)ctx;
+    
+    if (id3_cache_class(size) < 0) {
+        free(ptr);
+        return;
+    }
+    header = id3_cache_header(ptr);
+    owner = header->owner;
+    if (!owner) {
+        free(header);
+        return;
+    }
+    if (owner == id3_cache) {
+        id3_cache_keep(owner, (ID3CachedBuffer *)ptr);
+        return;
+    }
+    
+    // Another thread's buffer: hand it back, unless that cache is flushed
+    head = ID3_ATOMIC_LOAD(&owner->remote);
+    do {
+        if (head == ID3_CACHE_CLOSED) {
+            free(header);
+            if (ID3_ATOMIC_COUNT(&owner->orphans, (size_t)-1) == 1) {
+                free(owner);
+            }
+            return;
+        }
+        ((ID3CachedBuffer *)ptr)->next = head;
+    } while (!ID3_ATOMIC_PUSH(&owner->remote, &head, (ID3CachedBuffer *)ptr));
+}
+
+// Free the buffers cached by the calling thread (call before a thread exits).
+// Buffers it allocated that are still in use stay valid and may be freed on
+// any thread.
+ID3_API void id3_frame_cache_flush(void) {
+    ID3FrameCache *cache = id3_cache;
+    ID3CachedBuffer *buffer;
+    size_t out;
+    int cls;
+    
+    if (!cache) {
+        return;
+    }
+    for (cls = 0; cls < ID3_CACHE_CLASSES; cls++) {
+        while (cache->lists[cls]) {
+            buffer = cache->lists[cls];
+            cache->lists[cls] = buffer->next;
+            free(id3_cache_header(buffer));
+        }
+    }
+    out = cache->out;
+    buffer = ID3_ATOMIC_TAKE(&cache->remote, ID3_CACHE_CLOSED);
+    while (buffer) {
+        ID3CachedBuffer *next = buffer->next;
+        
+        free(id3_cache_header(buffer));
+        out--;
+        buffer = next;
+    }
+    id3_cache = NULL;
+    
+    // Frees that found the cache closed have counted down from zero already
+    if (ID3_ATOMIC_COUNT(&cache->orphans, out) + out == 0) {
+        free(cache);
+    }
+}
+#else
+// Default allocator: plain malloc/free
+static void *id3_default_alloc(size_t size, void *ctx) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void id3_default_free(void *ptr, size_t size, void *ctx) {
+    (void)size;
+    (void)ctx;
+    free(ptr);
+}
+
+ID3_API void id3_frame_cache_flush(void) {
+}
+#endif
+
+static ID3Allocator id3_allocator = { id3_default_alloc, id3_default_free, NULL };
+
+// Install the allocator used for frame buffers (NULL restores malloc/free).
+// Must not be changed while any parser holds a frame buffer.
+ID3_API void id3_set_allocator(const ID3Allocator *alloc) {
+    if (alloc) {
+        id3_allocator = *alloc;
+    } else {
+        id3_allocator.alloc = id3_default_alloc;
+        id3_allocator.free = id3_default_free;
+        id3_allocator.ctx = NULL;
+    }
+}
+
+// Memory budget shared by all parsers (0 = unlimited)
+static size_t id3_budget_limit;
+static ID3BudgetPolicy id3_budget_policy = ID3_BUDGET_SKIP;
+static size_t id3_budget_in_use;
+static uint32_t id3_budget_skipped;
+static uint32_t id3_budget_failed;
+
+// Set the total size of frame buffers all parsers may hold at once, and what
+// happens to a frame that does not fit. A limit of 0 disables the budget.
+ID3_API void id3_set_memory_budget(size_t limit, ID3BudgetPolicy policy) {
+    id3_budget_limit = limit;
+    id3_budget_policy = policy;
+}
+
+// Policy set with id3_set_memory_budget()
+ID3_API ID3BudgetPolicy id3_get_budget_policy(void) {
+    return id3_budget_policy;
+}
+
+// Read the memory accounting counters
+ID3_API void id3_get_memory_stats(ID3MemoryStats *stats) {
+    stats->in_use = ID3_ATOMIC_LOAD(&id3_budget_in_use);
+    stats->skipped = ID3_ATOMIC_LOAD(&id3_budget_skipped);
+    stats->failed = ID3_ATOMIC_LOAD(&id3_budget_failed);
+}
+
+// Charge size bytes against the budget; returns 0 if they do not fit
+static int id3_budget_charge(size_t size) {
+    size_t used;
+    
+    // Without a limit there is nothing to check: count without a CAS loop
+    if (!id3_budget_limit) {
+        ID3_ATOMIC_ADD(&id3_budget_in_use, size);
+        return 1;
+    }
+    
+    used = ID3_ATOMIC_LOAD(&id3_budget_in_use);
+    do {
+        if (used > id3_budget_limit || size > id3_budget_limit - used) {
+            return 0;
+        }
+    } while (!ID3_ATOMIC_CAS(&id3_budget_in_use, &used, used + size));
+    return 1;
+}
+
+// Free a frame buffer and return its size to the budget
+static void id3_buffer_free(uint8_t *data, size_t size) {
+    id3_allocator.free(data, size, id3_allocator.ctx);
+    ID3_ATOMIC_SUB(&id3_budget_in_use, size);
+}
+
+// Detach and free the current frame buffer, if any
+static void id3_release_frame(ID3Parser *parser) {
+    if (parser->frame_data) {
+        id3_buffer_free(parser->frame_data, parser->size);
+        parser->frame_data = NULL;
+    }
+}
+
+// Batch results are written into one arena: the header, the entry table,
+// then frame records growing up and frame data growing down from the end.
+// When everything fits, the data is moved down to follow the records.
+typedef struct {
+    uint8_t *arena;            // NULL once the arena is known to be too small
+    size_t cap;
+    size_t frames_end;         // End of the frame records written so far
+    size_t pool_start;         // Start of the frame data written so far
+    size_t need;               // Arena size the complete result needs
+    const uint8_t *tag;        // Input being walked
+    uint32_t input;
+    uint32_t frame_count;
+    uint32_t data_limit;
+} ID3BatchWriter;
+
+static void id3_batch_begin(ID3BatchWriter *writer, size_t count, uint32_t data_limit,
+                            uint8_t *arena, size_t cap) {
+    size_t table = sizeof(ID3BatchHeader) + count * sizeof(ID3BatchEntry);
+    
+    if (cap > UINT32_MAX) {
+        cap = UINT32_MAX; // Offsets in the arena are 32-bit
+    }
+    writer->arena = (cap >= table) ? arena : NULL;
+    writer->cap = cap;
+    writer->frames_end = table;
+    writer->pool_start = cap;
+    writer->need = table;
+    writer->tag = NULL;
+    writer->input = 0;
+    writer->frame_count = 0;
+    writer->data_limit = data_limit;
+}
+
+static int id3_batch_frame(const char *id, uint32_t offset, uint32_t size, void *ctx) {
+    ID3BatchWriter *writer = (ID3BatchWriter *)ctx;
+    uint32_t stored = (size < writer->data_limit) ? size : writer->data_limit;
+    
+    writer->need += sizeof(ID3BatchFrame) + stored;
+    writer->frame_count++;
+    if (!writer->arena) {
+        return 0;
+    }
+    if (writer->pool_start - writer->frames_end < sizeof(ID3BatchFrame) + stored) {
+        writer->arena = NULL; // Keep counting to report the size needed
+        return 0;
+    }
+    
+    {
+        ID3BatchFrame *frame = (ID3BatchFrame *)&writer->arena[writer->frames_end];
+        
+        writer->pool_start -= stored;
+        memcpy(&writer->arena[writer->pool_start], writer->tag + offset, stored);
+        memset(frame, 0, sizeof(ID3BatchFrame));
+        frame->offset = offset;
+        memcpy(frame->id, id, 5);
+        frame->input = writer->input;
+        frame->size = size;
+        frame->data = (uint32_t)writer->pool_start; // Rebased by id3_batch_finish()
+        frame->stored = stored;
+        writer->frames_end += sizeof(ID3BatchFrame);
+    }
+    return 0;
+}
+
+// Record one input; tag is NULL if it could not be read
+static void id3_batch_add(ID3BatchWriter *writer, const uint8_t *tag, size_t len) {
+    ID3BatchEntry entry;
+    ID3TagHeader header;
+    
+    memset(&entry, 0, sizeof(entry));
+    entry.first_frame = writer->frame_count;
+    if (tag && id3_probe_header(tag, len, &header)) {
+        entry.tag_size = header.size;
+        entry.version = header.version;
+        entry.revision = header.revision;
+        entry.flags = header.flags;
+        writer->tag = tag;
+        entry.status = id3_walk_frames(tag, len, id3_batch_frame, writer);
+    } else {
+        entry.status = ID3_ERROR;
+    }
+    entry.frame_count = writer->frame_count - entry.first_frame;
+    
+    if (writer->arena) {
+        memcpy(&writer->arena[sizeof(ID3BatchHeader) + writer->input * sizeof(ID3BatchEntry)],
+               &entry, sizeof(entry));
+    }
+    writer->input++;
+}
+
+static size_t id3_batch_finish(ID3BatchWriter *writer) {
+    if (writer->arena) {
+        ID3BatchHeader header;
+        ID3BatchFrame *frames;
+        size_t table = sizeof(ID3BatchHeader) + writer->input * sizeof(ID3BatchEntry);
+        uint32_t i;
+        
+        memmove(&writer->arena[writer->frames_end], &writer->arena[writer->pool_start],
+                writer->cap - writer->pool_start);
+        frames = (ID3BatchFrame *)&writer->arena[table];
+        for (i = 0; i < writer->frame_count; i++) {
+            frames[i].data -= (uint32_t)writer->pool_start;
+        }
+        
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "I3B", 3);
+        header.magic[3] = ID3_BATCH_FORMAT;
+        header.count = writer->input;
+        header.frame_count = writer->frame_count;
+        header.entries = sizeof(ID3BatchHeader);
+        header.frames = (uint32_t)table;
+        header.pool = (uint32_t)writer->frames_end;
+        header.size = (uint32_t)writer->need;
+        memcpy(writer->arena, &header, sizeof(header));
+    }
+    return writer->need;
+}
+
+// Parse count in-memory tags (each buffer starts at the "ID3" header) into
+// one flat arena, copying up to data_limit bytes of each frame's data.
+// Returns the arena size the result needs: the arena holds the result only
+// if that is at most cap, so a call with cap = 0 sizes it. arena must be
+// 8-byte aligned.
+ID3_API size_t id3_parse_batch(const uint8_t *const *data, const size_t *len, size_t count,
+                               uint32_t data_limit, uint8_t *arena, size_t cap) {
+    ID3BatchWriter writer;
+    size_t i;
+    
+    id3_batch_begin(&writer, count, data_limit, arena, cap);
+    for (i = 0; i < count; i++) {
+        id3_batch_add(&writer, data[i], len[i]);
+    }
+    return id3_batch_finish(&writer);
+}
+
+#ifndef ID3_NO_STDIO
+// Like id3_parse_batch() for files whose tag is at the start. Each tag is
+// read into a temporary buffer from the frame allocator, within the memory
+// budget; files that cannot be opened or buffered get ID3_ERROR entries.
+ID3_API size_t id3_parse_batch_files(const char *const *paths, size_t count,
+                                     uint32_t data_limit, uint8_t *arena, size_t cap) {
+    ID3BatchWriter writer;
+    size_t i;
+    
+    id3_batch_begin(&writer, count, data_limit, arena, cap);
+    for (i = 0; i < count; i++) {
+        FILE *file = fopen(paths[i], "rb");
+        uint8_t head[10];
+        ID3TagHeader header;
+        uint8_t *tag = NULL;
+        size_t total = 0;
+        size_t len = 0;
+        
+        if (file && fread(head, 1, 10, file) == 10 && id3_probe_header(head, 10, &header)) {
+            total = (size_t)header.size + 10;
+            if (id3_budget_charge(total)) {
+                tag = (uint8_t *)id3_allocator.alloc(total, id3_allocator.ctx);
+                if (!tag) {
+                    ID3_ATOMIC_SUB(&id3_budget_in_use, total);
+                }
+            }
+        }
+        if (tag) {
+            memcpy(tag, head, 10);
+            len = 10 + fread(&tag[10], 1, header.size, file);
+        }
+        if (file) {
+            fclose(file);
+        }
+        
+        id3_batch_add(&writer, tag, len);
+        if (tag) {
+            id3_buffer_free(tag, total);
+        }
+    }
+    return id3_batch_finish(&writer);
+}
+#endif
+
+// Number of bytes the parser can use before its next event (frame, header or
+// end of tag). Lets a reader size its reads and stop at the end of the tag.
+ID3_API size_t id3_parser_need(const ID3Parser *parser) {
+    uint32_t need;
+    
+    switch (parser->state) {
+        case STATE_FIND_HEADER:
+        case STATE_READ_HEADER:
+            return 10 - parser->pos; // pos counts a partial "ID3" match too
+            
+        case STATE_READ_EXT_HEADER:
+            need = (parser->pos < 4) ? 4 - parser->pos : parser->size - parser->pos;
+            break;
+            
+        case STATE_READ_FRAME_HEADER:
+            need = ID3_LAYOUT(parser->version)->header_size - parser->pos;
+            if (need == 0) {
+                need = parser->size; // Retrying a frame after ID3_ERROR
+            }
+            break;
+            
+        case STATE_READ_FRAME_DATA:
+        case STATE_SKIP_FRAME_DATA:
+            return parser->size - parser->pos;
+            
+        case STATE_FRAME_READY:
+            need = ID3_LAYOUT(parser->version)->header_size;
+            break;
+            
+        default:
+            return 0;
+    }
+    
+    return (need < parser->tag_remaining) ? need : parser->tag_remaining;
+}
+
+// Saved state blob: "I3P", format version, then the fields below and the
+// partial frame bytes read so far. Integers are big-endian. Format 1 blobs,
+// which predate the stream offsets, are still accepted.
+#define ID3_SAVE_FORMAT         2
+#define ID3_SAVE_HEADER_SIZE    44
+#define ID3_SAVE_V1_HEADER_SIZE 28
+
+static void id3_put_uint32(uint8_t *buf, uint32_t value) {
+    buf[0] = (uint8_t)(value >> 24);
+    buf[1] = (uint8_t)(value >> 16);
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)value;
+}
+
+static void id3_put_uint64(uint8_t *buf, uint64_t value) {
+    id3_put_uint32(buf, (uint32_t)(value >> 32));
+    id3_put_uint32(&buf[4], (uint32_t)value);
+}
+
+static uint64_t id3_bytes_to_uint64(const uint8_t *buf) {
+    return ((uint64_t)id3_bytes_to_uint32(buf) << 32) | id3_bytes_to_uint32(&buf[4]);
+}
+
+// Serialize the parser state (not the callback) into out. Returns the blob
+// size; if cap is too small nothing is written, so call with cap = 0 to size
+// the buffer. A frame already returned by id3_parser_next() is not saved.
+ID3_API size_t id3_parser_save(const ID3Parser *parser, uint8_t *out, size_t cap) {
+    uint8_t state = parser->state;
+    uint32_t pos = parser->pos;
+    uint32_t partial = 0;
+    
+    if (state == STATE_FRAME_READY) {
+        state = parser->tag_remaining ? STATE_READ_FRAME_HEADER : STATE_DONE;
+        pos = 0;
+    } else if (state == STATE_READ_FRAME_DATA) {
+        partial = pos;
+    }
+    
+    if (cap < ID3_SAVE_HEADER_SIZE + (size_t)partial) {
+        return ID3_SAVE_HEADER_SIZE + (size_t)partial;
+    }
+    
+    memcpy(out, "I3P", 3);
+    out[3] = ID3_SAVE_FORMAT;
+    out[4] = state;
+    out[5] = parser->version;
+    memcpy(&out[6], parser->buffer, 10);
+    id3_put_uint32(&out[16], pos);
+    id3_put_uint32(&out[20], parser->size);
+    id3_put_uint32(&out[24], parser->tag_remaining);
+    id3_put_uint64(&out[28], parser->stream_pos);
+    id3_put_uint64(&out[36], parser->tag_offset);
+    if (partial > 0) {
+        memcpy(&out[ID3_SAVE_HEADER_SIZE], parser->frame_data, partial);
+    }
+    return ID3_SAVE_HEADER_SIZE + (size_t)partial;
+}
+
+// Restore state saved by id3_parser_save() into an initialized parser,
+// keeping its callback and user data. Returns 0 on success or ID3_ERROR if
+// the blob is invalid or the frame buffer cannot be allocated.
+ID3_API int id3_parser_restore(ID3Parser *parser, const uint8_t *blob, size_t len) {
+    uint8_t state;
+    uint32_t pos;
+    uint32_t size;
+    uint32_t tag_remaining;
+    uint32_t partial;
+    size_t header_size;
+    const ID3FrameLayout *layout;
+    int valid;
+    
+    if (len < ID3_SAVE_V1_HEADER_SIZE || memcmp(blob, "I3P", 3) != 0) {
+        return ID3_ERROR;
+    }
+    if (blob[3] == ID3_SAVE_FORMAT) {
+        header_size = ID3_SAVE_HEADER_SIZE;
+    } else if (blob[3] == 1) {
+        header_size = ID3_SAVE_V1_HEADER_SIZE;
+    } else {
+        return ID3_ERROR;
+    }
+    
+    state = blob[4];
+    pos = id3_bytes_to_uint32(&blob[16]);
+    size = id3_bytes_to_uint32(&blob[20]);
+    tag_remaining = id3_bytes_to_uint32(&blob[24]);
+    partial = (state == STATE_READ_FRAME_DATA) ? pos : 0;
+    
+    // States past the tag header index the layout table by version
+    if (state > STATE_READ_HEADER && state < STATE_DONE && (blob[5] < 2 || blob[5] > 4)) {
+        return ID3_ERROR;
+    }
+    
+    // Reject positions and sizes the state machine could never have saved,
+    // since restored values index buffer and count down tag_remaining
+    switch (state) {
+        case STATE_FIND_HEADER:
+            valid = pos < 3; // Length of a partial "ID3" match
+            break;
+            
+        case STATE_READ_HEADER:
+            valid = pos >= 3 && pos < 10;
+            break;
+            
+        case STATE_READ_EXT_HEADER:
+            // Past the size field, the rest of the extended header must fit in the tag
+            valid = pos <= 4 || (pos <= size && size - pos <= tag_remaining);
+            break;
+            
+        case STATE_READ_FRAME_HEADER:
+            // A whole header is saved after ID3_ERROR left its frame without
+            // a buffer; the retry decodes the size from it again
+            layout = ID3_LAYOUT(blob[5]);
+            valid = pos < layout->header_size ||
+                    (pos == layout->header_size && blob[6] != 0 &&
+                     size == layout->frame_size(&blob[6]) && size <= tag_remaining);
+            break;
+            
+        case STATE_READ_FRAME_DATA:
+        case STATE_SKIP_FRAME_DATA:
+            valid = pos <= size && size - pos <= tag_remaining;
+            break;
+            
+        case STATE_DONE:
+            valid = 1;
+            break;
+            
+        default:
+            valid = 0; // STATE_FRAME_READY is saved as the state after it
+            break;
+    }
+    if (!valid || len != header_size + (size_t)partial) {
+        return ID3_ERROR;
+    }
+    
+    id3_parser_reset(parser);
+    
+    // Reattach the partially read frame
+    if (state == STATE_READ_FRAME_DATA && size > 0) {
+        if (!id3_budget_charge(size)) {
+            ID3_ATOMIC_ADD(&id3_budget_failed, 1);
+            return ID3_ERROR;
+        }
+        parser->frame_data = (uint8_t *)id3_allocator.alloc(size, id3_allocator.ctx);
+        if (!parser->frame_data) {
+            ID3_ATOMIC_SUB(&id3_budget_in_use, size);
+            return ID3_ERROR;
+        }
+        memcpy(parser->frame_data, &blob[header_size], partial);
+    }
+    
+    parser->state = state;
+    parser->version = blob[5];
+    memcpy(parser->buffer, &blob[6], 10);
+    parser->pos = pos;
+    parser->size = size;
+    parser->tag_remaining = tag_remaining;
+    if (header_size == ID3_SAVE_HEADER_SIZE) {
+        parser->stream_pos = id3_bytes_to_uint64(&blob[28]);
+        parser->tag_offset = id3_bytes_to_uint64(&blob[36]);
+    }
+    return 0;
+}
+
+// Take ownership of the frame just returned by id3_parser_next() or passed to
+// the callback. Returns NULL for empty frames. Release with id3_free_frame().
+ID3_API uint8_t *id3_parser_take_frame(ID3Parser *parser) {
+    uint8_t *data = NULL;
+    
+    if (parser->state == STATE_FRAME_READY) {
+        data = parser->frame_data;
+        parser->frame_data = NULL;
+    }
+    return data;
+}
+
+// Allocate a frame buffer (size > 0) through the configured allocator and
+// within the memory budget, for front-ends that buffer frames themselves.
+// Returns NULL if the allocation fails or the frame does not fit, which
+// counts as skipped or failed under the budget policy. Release with
+// id3_free_frame().
+ID3_API uint8_t *id3_alloc_frame(uint32_t size) {
+    uint8_t *data;
+    
+    if (!id3_budget_reserve(size)) {
+        return NULL;
+    }
+    data = (uint8_t *)id3_allocator.alloc(size, id3_allocator.ctx);
+    if (!data) {
+        ID3_ATOMIC_SUB(&id3_budget_in_use, size);
+    }
+    return data;
+}
+
+// Charge size bytes of frame data the caller holds in its own memory, such
+// as a frame handled in place in its input, against the memory budget.
+// Returns 0 if they do not fit, which counts as skipped or failed under the
+// budget policy. Return the bytes with id3_budget_release().
+ID3_API int id3_budget_reserve(uint32_t size) {
+    if (!id3_budget_charge(size)) {
+        if (id3_budget_policy == ID3_BUDGET_FAIL) {
+            ID3_ATOMIC_ADD(&id3_budget_failed, 1);
+        } else {
+            ID3_ATOMIC_ADD(&id3_budget_skipped, 1);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+// Return bytes charged with id3_budget_reserve()
+ID3_API void id3_budget_release(uint32_t size) {
+    ID3_ATOMIC_SUB(&id3_budget_in_use, size);
+}
+
+// Free a frame buffer obtained from id3_parser_take_frame() or
+// id3_alloc_frame()
+ID3_API void id3_free_frame(uint8_t *data, uint32_t size) {
+    if (data) {
+        id3_buffer_free(data, size);
+    }
+}
+
+// Initialize parser
+ID3_API void id3_parser_init(ID3Parser *parser, ID3FrameCallback callback, void *user_data) {
+    memset(parser, 0, sizeof(ID3Parser));
+    parser->state = STATE_FIND_HEADER;
+    parser->frame_callback = callback;
+    parser->user_data = user_data;
+}
+
+// Rewind the parser to look for a new tag, keeping callback and user data.
+// Stream offsets keep counting from where they were; see id3_parser_set_offset().
+ID3_API void id3_parser_reset(ID3Parser *parser) {
+    id3_release_frame(parser);
+    parser->size = 0;
+    parser->pos = 0;
+    parser->tag_remaining = 0;
+    parser->state = STATE_FIND_HEADER;
+    parser->version = 0;
+}
+
+// Set the stream offset of the next byte fed, e.g. after seeking or when
+// starting a new stream with a reset parser
+ID3_API void id3_parser_set_offset(ID3Parser *parser, uint64_t offset) {
+    parser->stream_pos = offset;
+}
+
+// Stream offset of the "ID3" signature of the tag being parsed
+ID3_API uint64_t id3_parser_tag_offset(const ID3Parser *parser) {
+    return parser->tag_offset;
+}
+
+// Stream offset of the data of the frame just returned by id3_parser_next()
+// or passed to the callback; its header is 6 (v2.2) or 10 bytes before.
+// Only meaningful while that frame is current.
+ID3_API uint64_t id3_parser_frame_offset(const ID3Parser *parser) {
+    return parser->stream_pos - parser->size;
+}
+
+// Free any allocated memory
+ID3_API void id3_parser_cleanup(ID3Parser *parser) {
+    id3_release_frame(parser);
+}
+
+// Allocate and initialize a parser through the frame buffer allocator, so
+// that with ID3_FRAME_CACHE parsers are recycled per thread like frame
+// buffers. Returns NULL if the allocation fails.
+ID3_API ID3Parser *id3_parser_acquire(ID3FrameCallback callback, void *user_data) {
+    ID3Parser *parser = (ID3Parser *)id3_allocator.alloc(sizeof(ID3Parser), id3_allocator.ctx);
+    
+    if (parser) {
+        id3_parser_init(parser, callback, user_data);
+    }
+    return parser;
+}
+
+// Clean up and free a parser from id3_parser_acquire(), on any thread
+ID3_API void id3_parser_release(ID3Parser *parser) {
+    if (parser) {
+        id3_release_frame(parser);
+        id3_allocator.free(parser, sizeof(ID3Parser), id3_allocator.ctx);
+    }
+}
+
+// Force inlining where a constant argument should specialise the body
+#if defined(__GNUC__)
+#define ID3_ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define ID3_ALWAYS_INLINE __forceinline
+#else
+#define ID3_ALWAYS_INLINE inline
+#endif
+
+// Move past the frame returned by the last call, releasing its buffer
+static void id3_end_frame(ID3Parser *parser) {
+    id3_release_frame(parser);
+    parser->pos = 0;
+    parser->state = parser->tag_remaining ? STATE_READ_FRAME_HEADER : STATE_DONE;
+}
+
+// Run the states before the first frame header: find the tag, read its
+// header and skip the extended header. Returns the bytes used.
+static size_t id3_read_tag_head(ID3Parser *parser, const uint8_t *data, size_t len) {
+    size_t i = 0;
+    size_t n;
+    
+    while (i < len && parser->state < STATE_READ_FRAME_HEADER) {
+        switch (parser->state) {
+            case STATE_FIND_HEADER:
+                // Look for "ID3" signature; a partial match carries over to the next chunk
+                while (i < len && parser->pos < 3) {
+                    if (data[i] == "ID3"[parser->pos]) {
+                        parser->buffer[parser->pos++] = data[i++];
+                    } else if (parser->pos > 0) {
+                        parser->pos = 0; // Mismatch: this byte may start a new match
+                    } else {
+                        const uint8_t *next = (const uint8_t *)memchr(&data[i], 'I', len - i);
+                        i = next ? (size_t)(next - data) : len;
+                    }
+                }
+                
+                if (parser->pos == 3) {
+                    parser->tag_offset = parser->stream_pos + i - 3;
+                    parser->state = STATE_READ_HEADER;
+                }
+                break;
+                
+            case STATE_READ_HEADER:
+                // Read 10-byte ID3v2 header, in one copy unless split across chunks
+                n = id3_min_size(10 - parser->pos, len - i);
+                memcpy(&parser->buffer[parser->pos], &data[i], n);
+                parser->pos += n;
+                i += n;
+                
+                if (parser->pos == 10) {
+                    ID3TagHeader header;
+                    
+                    parser->pos = 0;
+                    
+                    // A false "ID3" match (e.g. inside audio data): keep scanning
+                    if (!id3_parse_tag_header(parser->buffer, &header)) {
+                        parser->state = STATE_FIND_HEADER;
+                        break;
+                    }
+                    parser->version = header.version;
+                    parser->tag_remaining = header.size;
+                    
+                    // Check for extended header (ID3v2.3+)
+                    if ((header.flags & 0x40) && parser->version >= 3) {
+                        parser->state = STATE_READ_EXT_HEADER;
+                    } else {
+                        parser->state = STATE_READ_FRAME_HEADER;
+                    }
+                }
+                break;
+                
+            default:
+                // STATE_READ_EXT_HEADER: read the size first (4 bytes for v2.3, synchsafe for v2.4)
+                if (parser->pos < 4) {
+                    n = id3_min_size(id3_min_size(4 - parser->pos, len - i), parser->tag_remaining);
+                    memcpy(&parser->buffer[parser->pos], &data[i], n);
+                    parser->pos += n;
+                    parser->tag_remaining -= n;
+                    i += n;
+                }
+                
+                if (parser->pos < 4) {
+                    if (parser->tag_remaining == 0) {
+                        parser->state = STATE_DONE;
+                    }
+                    break;
+                }
+                
+                if (parser->pos == 4) {
+                    if (parser->version == 4) {
+                        // v2.4 size includes the size field itself
+                        parser->size = id3_synchsafe_to_uint32(parser->buffer);
+                    } else {
+                        // v2.3 size excludes the size field
+                        parser->size = id3_bytes_to_uint32(parser->buffer) + 4;
+                    }
+                    if (parser->size > parser->tag_remaining + 4) {
+                        parser->state = STATE_DONE; // Corrupt extended header
+                        break;
+                    }
+                }
+                
+                // Skip rest of extended header
+                if (parser->pos < parser->size) {
+                    n = id3_min_size(parser->size - parser->pos, len - i);
+                    parser->pos += n;
+                    parser->tag_remaining -= n;
+                    i += n;
+                }
+                
+                if (parser->pos >= parser->size) {
+                    parser->state = STATE_READ_FRAME_HEADER;
+                    parser->pos = 0;
+                }
+                break;
+        }
+    }
+    
+    parser->stream_pos += i;
+    return i;
+}
+
+// Frame states up to the end of the next frame, for one frame header layout.
+// Only ever inlined with a constant layout into the per-version readers
+// below, so the loop has no version checks or indirect calls.
+static ID3_ALWAYS_INLINE int id3_read_frame(ID3Parser *parser, const uint8_t *data, size_t len,
+                                            size_t *consumed, ID3FrameView *frame,
+                                            uint32_t header_size, uint32_t id_len,
+                                            uint32_t (*frame_size)(const uint8_t *header)) {
+    size_t i = 0;
+    size_t n;
+    
+    while (i < len && parser->state != STATE_DONE) {
+        switch (parser->state) {
+            case STATE_READ_FRAME_HEADER:
+                // Check if we've processed all tag data
+                if (parser->tag_remaining == 0) {
+                    parser->state = STATE_DONE;
+                    break;
+                }
+                
+                // Read frame header, in one copy unless split across chunks
+                n = id3_min_size(id3_min_size(header_size - parser->pos, len - i),
+                             parser->tag_remaining);
+                memcpy(&parser->buffer[parser->pos], &data[i], n);
+                parser->pos += n;
+                parser->tag_remaining -= n;
+                i += n;
+                
+                if (parser->pos == header_size) {
+                    // Check for padding (all zeros)
+                    if (parser->buffer[0] == 0) {
+                        parser->state = STATE_DONE;
+                        break;
+                    }
+                    
+                    // Parse frame header
+                    parser->size = frame_size(parser->buffer);
+                    
+                    // A frame running past the end of the tag is corrupt
+                    if (parser->size > parser->tag_remaining) {
+                        parser->state = STATE_DONE;
+                        break;
+                    }
+                    
+                    // Frames excluded at build time are skipped without a buffer
+                    if (!ID3_FRAME_WANTED(ID3_FRAME_FOURCC(parser->buffer, id_len))) {
+                        parser->pos = 0;
+                        parser->state = STATE_SKIP_FRAME_DATA;
+                        break;
+                    }
+                    
+                    // Attach a buffer for frame data, within the memory budget.
+                    // On failure the header is consumed; calling id3_parser_next()
+                    // again on the rest of the input retries the frame.
+                    if (parser->size > 0) {
+                        if (!id3_budget_charge(parser->size)) {
+                            if (id3_budget_policy == ID3_BUDGET_FAIL) {
+                                ID3_ATOMIC_ADD(&id3_budget_failed, 1);
+                                parser->stream_pos += i;
+                                *consumed = i;
+                                return ID3_ERROR;
+                            }
+                            ID3_ATOMIC_ADD(&id3_budget_skipped, 1);
+                            parser->pos = 0;
+                            parser->state = STATE_SKIP_FRAME_DATA;
+                            break;
+                        }
+                        parser->frame_data = (uint8_t *)id3_allocator.alloc(parser->size, id3_allocator.ctx);
+                        if (!parser->frame_data) {
+                            ID3_ATOMIC_SUB(&id3_budget_in_use, parser->size);
+                            parser->stream_pos += i;
+                            *consumed = i;
+                            return ID3_ERROR; // Memory allocation failed
+                        }
+                    }
+                    
+                    // The ID stays in buffer, NUL-terminated over the decoded size
+                    parser->buffer[id_len] = '\0';
+                    parser->pos = 0;
+                    parser->state = STATE_READ_FRAME_DATA;
+                } else if (parser->tag_remaining == 0) {
+                    parser->state = STATE_DONE; // Tag ends inside a frame header
+                }
+                
+                // Go straight on to the data so empty frames complete without more input
+                if (parser->state != STATE_READ_FRAME_DATA) {
+                    break;
+                }
+                // fall through
+                
+            case STATE_READ_FRAME_DATA:
+                // Read frame data, as much as this chunk holds in one copy
+                if (parser->pos < parser->size) {
+                    n = id3_min_size(parser->size - parser->pos, len - i);
+                    memcpy(&parser->frame_data[parser->pos], &data[i], n);
+                    parser->pos += n;
+                    parser->tag_remaining -= n;
+                    i += n;
+                }
+                
+                // Check if frame is complete; it stays attached until the next call
+                if (parser->pos >= parser->size) {
+                    frame->id = (const char *)parser->buffer;
+                    frame->data = parser->frame_data;
+                    frame->size = parser->size;
+                    parser->stream_pos += i;
+                    frame->offset = parser->stream_pos - parser->size;
+                    frame->tag_offset = parser->tag_offset;
+                    parser->state = STATE_FRAME_READY;
+                    *consumed = i;
+                    return ID3_FRAME;
+                }
+                break;
+                
+            default:
+                // STATE_SKIP_FRAME_DATA: drop data of a filtered frame or one
+                // that did not fit in the budget
+                n = id3_min_size(parser->size - parser->pos, len - i);
+                parser->pos += n;
+                parser->tag_remaining -= n;
+                i += n;
+                
+                if (parser->pos >= parser->size) {
+                    parser->pos = 0;
+                    parser->state = STATE_READ_FRAME_HEADER;
+                }
+                break;
+        }
+    }
+    
+    // Report completion as soon as the tag ends, not on the next call
+    if (parser->state == STATE_READ_FRAME_HEADER && parser->pos == 0 &&
+        parser->tag_remaining == 0) {
+        parser->state = STATE_DONE;
+    }
+    parser->stream_pos += i;
+    *consumed = i;
+    return (parser->state == STATE_DONE) ? ID3_DONE : ID3_MORE;
+}
+
+// Per-version frame readers: one frame for id3_parser_next(), and every
+// frame of the chunk for id3_parser_feed(), which thus picks the version
+// once per call rather than once per frame
+#define ID3_DEFINE_FRAME_READER(version, header_size, id_len, frame_size)       \
+static int id3_read_frame_v##version(ID3Parser *parser, const uint8_t *data,   \
+                                     size_t len, size_t *consumed,             \
+                                     ID3FrameView *frame) {                    \
+    return id3_read_frame(parser, data, len, consumed, frame,                  \
+                          header_size, id_len, frame_size);                    \
+}                                                                              \
+                                                                               \
+static int id3_feed_frames_v##version(ID3Parser *parser, const uint8_t *data,  \
+                                      size_t len) {                            \
+    ID3FrameView frame;                                                        \
+    size_t used;                                                               \
+    int result;                                                                \
+                                                                               \
+    while ((result = id3_read_frame(parser, data, len, &used, &frame,          \
+                                    header_size, id_len, frame_size)) ==       \
+           ID3_FRAME) {                                                        \
+        if (parser->frame_callback) {                                          \
+            parser->frame_callback(frame.id, frame.data, frame.size,           \
+                                   parser->user_data);                         \
+        }                                                                      \
+        id3_end_frame(parser);                                                 \
+        data += used;                                                          \
+        len -= used;                                                           \
+    }                                                                          \
+    return result;                                                             \
+}
+
+ID3_FRAME_LAYOUTS(ID3_DEFINE_FRAME_READER)
+
+#define ID3_NEXT_FRAME_CASE(version, header_size, id_len, frame_size)           \
+    case version:                                                              \
+        result = id3_read_frame_v##version(parser, data + head, len - head,    \
+                                           &used, frame);                      \
+        break;
+        
+#define ID3_FEED_FRAMES_CASE(version, header_size, id_len, frame_size)          \
+    case version:                                                              \
+        return id3_feed_frames_v##version(parser, data + head, len - head);
+        
+// Release a frame left by id3_parser_next() and run the states before the
+// frame headers. Returns 1 if the frame states come next, with *head set to
+// the bytes used, or 0 with *result set to what the call returns.
+static int id3_begin_chunk(ID3Parser *parser, const uint8_t *data, size_t len,
+                           size_t *head, int *result) {
+    if (parser->state == STATE_FRAME_READY) {
+        id3_end_frame(parser);
+    }
+    *head = id3_read_tag_head(parser, data, len);
+    if (parser->state < STATE_READ_FRAME_HEADER || parser->state == STATE_DONE) {
+        *result = (parser->state == STATE_DONE) ? ID3_DONE : ID3_MORE;
+        return 0;
+    }
+    return 1;
+}
+
+// Process a chunk of data, delivering frames through the callback
+ID3_API int id3_parser_feed(ID3Parser *parser, const uint8_t *data, size_t len) {
+    size_t head;
+    int result;
+    
+    if (!id3_begin_chunk(parser, data, len, &head, &result)) {
+        return result;
+    }
+    
+    // The frame loop for this tag's version takes the rest of the chunk
+    switch (parser->version) {
+        ID3_FRAME_LAYOUTS(ID3_FEED_FRAMES_CASE)
+    }
+    return ID3_ERROR;
+}
+
+// Process a chunk of data up to the end of the next frame. Returns ID3_FRAME
+// with the frame in *frame, or ID3_MORE/ID3_DONE/ID3_ERROR like
+// id3_parser_feed(). *consumed is set to the number of bytes used.
+ID3_API int id3_parser_next(ID3Parser *parser, const uint8_t *data, size_t len,
+                            size_t *consumed, ID3FrameView *frame) {
+    size_t head;
+    size_t used = 0;
+    int result = ID3_ERROR;
+    
+    if (id3_begin_chunk(parser, data, len, &head, &result)) {
+        switch (parser->version) {
+            ID3_FRAME_LAYOUTS(ID3_NEXT_FRAME_CASE)
+        }
+    }
+    *consumed = head + used;
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
 
-int id3_parser_feed(ID3Parser *parser, const uint8_t *data, size_t len);
-void id3_parser_init(ID3Parser *parser, void (*callback)(const char*, const uint8_t*, uint32_t));
\ No newline at end of file
+#endif // ID3_IMPLEMENTATION
@@ -0,0 +1,763 @@
+#pragma once
+
+// C++ wrapper for the ID3v2 streaming parser. Requires C++11; frame views
+// gain std::string_view with C++17, std::span with C++20, and
+// id3::set_memory_resource() is available with C++17 <memory_resource>.
+// The compile-time engine id3::parser<Handlers...> needs C++17, and the
+// coroutine adapter (task, async_generator, frames(), read_tag()) C++20
+// coroutines.
+// Builds with -fno-exceptions: nothing here throws or catches then.
+
+#include "id3v2parser.h"
+
+#if __cplusplus >= 201703L
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define ID3_HAS_PMR 1
+#endif
+#endif
+
+#if __cplusplus >= 202002L
+#include <cstddef>
+#include <span>
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <vector>
+#define ID3_HAS_COROUTINES 1
+#endif
+
+namespace id3 {
+
+// Result of Parser::feed() and Parser::next()
+enum class Status {
+    Error = ID3_ERROR,
+    More = ID3_MORE,
+    Done = ID3_DONE,
+    Frame = ID3_FRAME
+};
+
+// A parsed frame. Points into parser-owned memory (or the caller's buffer
+// for parse_buffer()) and is valid until the next call on the parser.
+// Offsets are from the start of the stream, or of the buffer for
+// parse_buffer().
+struct FrameView {
+    const char *id;
+    const uint8_t *data;
+    uint32_t size;
+    uint64_t offset;            // Offset of the frame data
+    uint64_t tag_offset;        // Offset of the tag's "ID3" signature
+
+#if __cplusplus >= 201703L
+    std::string_view id_view() const { return std::string_view(id); }
+#endif
+#if __cplusplus >= 202002L
+    std::span<const std::byte> bytes() const {
+        return std::span<const std::byte>(reinterpret_cast<const std::byte *>(data), size);
+    }
+#endif
+};
+
+// Owning handle for a frame buffer detached with Parser::take_frame()
+class FrameBuffer {
+public:
+    FrameBuffer() : data_(nullptr), size_(0) {}
+    FrameBuffer(uint8_t *data, uint32_t size) : data_(data), size_(size) {}
+    FrameBuffer(FrameBuffer &&other) noexcept : data_(other.data_), size_(other.size_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    FrameBuffer &operator=(FrameBuffer &&other) noexcept {
+        if (this != &other) {
+            id3_free_frame(data_, size_);
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
+    ~FrameBuffer() { id3_free_frame(data_, size_); }
+
+    const uint8_t *data() const { return data_; }
+    uint32_t size() const { return size_; }
+
+private:
+    uint8_t *data_;
+    uint32_t size_;
+};
+
+// Movable, non-copyable owner of an ID3Parser. Any frame buffer is released
+// by the destructor, including when a handler throws out of feed().
+class Parser {
+public:
+    Parser() { id3_parser_init(&parser_, nullptr, nullptr); }
+    Parser(Parser &&other) noexcept : parser_(other.parser_) {
+        id3_parser_init(&other.parser_, nullptr, nullptr);
+    }
+    Parser &operator=(Parser &&other) noexcept {
+        if (this != &other) {
+            id3_parser_cleanup(&parser_);
+            parser_ = other.parser_;
+            id3_parser_init(&other.parser_, nullptr, nullptr);
+        }
+        return *this;
+    }
+    Parser(const Parser &) = delete;
+    Parser &operator=(const Parser &) = delete;
+    ~Parser() { id3_parser_cleanup(&parser_); }
+
+    // Parse a chunk, calling handler(const FrameView &) for each frame.
+    // The handler is a template parameter, so calls are inlined.
+    template <typename Handler>
+    Status feed(const uint8_t *data, size_t len, Handler &&handler) {
+        ID3FrameView view;
+        size_t used;
+        int result;
+
+        while ((result = id3_parser_next(&parser_, data, len, &used, &view)) == ID3_FRAME) {
+            FrameView frame = { view.id, view.data, view.size, view.offset, view.tag_offset };
+            handler(frame);
+            data += used;
+            len -= used;
+        }
+        return static_cast<Status>(result);
+    }
+
+    // Parse up to the end of the next frame; see id3_parser_next()
+    Status next(const uint8_t *data, size_t len, size_t &consumed, FrameView &frame) {
+        ID3FrameView view;
+        int result = id3_parser_next(&parser_, data, len, &consumed, &view);
+
+        if (result == ID3_FRAME) {
+            frame.id = view.id;
+            frame.data = view.data;
+            frame.size = view.size;
+            frame.offset = view.offset;
+            frame.tag_offset = view.tag_offset;
+        }
+        return static_cast<Status>(result);
+    }
+
+    // Keep the frame just returned by next() or passed to the handler
+    FrameBuffer take_frame() {
+        uint32_t size = parser_.size;
+        uint8_t *data = id3_parser_take_frame(&parser_);
+        return FrameBuffer(data, data ? size : 0);
+    }
+
+    size_t need() const { return id3_parser_need(&parser_); }
+    void set_offset(uint64_t offset) { id3_parser_set_offset(&parser_, offset); }
+    void reset() { id3_parser_reset(&parser_); }
+
+    ID3Parser *get() { return &parser_; }
+    const ID3Parser *get() const { return &parser_; }
+
+private:
+    ID3Parser parser_;
+};
+
+namespace detail {
+
+// C callback forwarding to a C++ handler passed as user data
+template <typename Handler>
+struct BufferThunk {
+    Handler *handler;
+    const uint8_t *tag;
+
+    static void call(const char *id, const uint8_t *data, uint32_t size, void *user) {
+        BufferThunk *thunk = static_cast<BufferThunk *>(user);
+        FrameView frame = { id, data, size, static_cast<uint64_t>(data - thunk->tag), 0 };
+        (*thunk->handler)(frame);
+    }
+};
+
+} // namespace detail
+
+// Parse a tag already in memory; frames point into data. See id3_parse_buffer().
+template <typename Handler>
+Status parse_buffer(const uint8_t *data, size_t len, Handler handler) {
+    detail::BufferThunk<Handler> thunk = { &handler, data };
+
+    return static_cast<Status>(
+        id3_parse_buffer(data, len, &detail::BufferThunk<Handler>::call, &thunk));
+}
+
+#if __cplusplus >= 201703L
+// Frame IDs a handler of id3::parser takes, as ID3_FOURCC() values
+template <uint32_t... Ids>
+struct frame_ids {
+    static constexpr bool contains(uint32_t id) { return ((id == Ids) || ...); }
+};
+
+// Every frame ID
+struct any_frame {
+    static constexpr bool contains(uint32_t) { return true; }
+};
+
+namespace detail {
+
+// Frame header layout of each major version
+template <int Version>
+struct frame_layout {
+    static constexpr size_t header_size = 10;
+    static constexpr size_t id_len = 4;
+
+    static uint32_t size(const uint8_t *h) {
+        if constexpr (Version == 4) {
+            return (uint32_t)h[4] << 21 | (uint32_t)h[5] << 14 | (uint32_t)h[6] << 7 | h[7];
+        }
+        return (uint32_t)h[4] << 24 | (uint32_t)h[5] << 16 | (uint32_t)h[6] << 8 | h[7];
+    }
+    static uint32_t fourcc(const uint8_t *h) { return ID3_FOURCC(h[0], h[1], h[2], h[3]); }
+};
+
+template <>
+struct frame_layout<2> {
+    static constexpr size_t header_size = 6;
+    static constexpr size_t id_len = 3;
+
+    static uint32_t size(const uint8_t *h) { return (uint32_t)h[3] << 16 | (uint32_t)h[4] << 8 | h[5]; }
+    static uint32_t fourcc(const uint8_t *h) { return ID3_FOURCC(h[0], h[1], h[2], 0); }
+};
+
+} // namespace detail
+
+// Streaming parser with its handlers fixed at compile time. Each handler
+// type names the frames it takes with a member type ids (frame_ids<...> or
+// any_frame) and is called as handler(const FrameView &). Which frames are
+// wanted and which handlers they go to are constant comparisons inlined into
+// the frame loop, which is picked once per call for the tag's version: no
+// function pointers or filter tables. Frames nobody takes are skipped
+// without being buffered, and frames that lie whole in the chunk being fed
+// are delivered from it without a copy.
+//
+// Frames, offsets and return values are those of id3_parser_feed() built
+// with the same frames wanted. Every wanted frame is charged against the
+// memory budget while it is handled, in place or in a buffer from
+// id3_alloc_frame(); one that does not fit is skipped or fails by the
+// policy. After Status::Error the frame's header has been read, and feeding
+// the rest of the input once memory has been released retries the frame.
+template <typename... Handlers>
+class parser {
+public:
+    explicit parser(Handlers... handlers) : handlers_(std::move(handlers)...) {
+        id3_parser_init(&head_, nullptr, nullptr);
+    }
+    parser(const parser &) = delete;
+    parser &operator=(const parser &) = delete;
+    ~parser() { release(); }
+
+    // Whether some handler takes frames with this ID
+    static constexpr bool wanted(uint32_t fourcc) { return (Handlers::ids::contains(fourcc) || ...); }
+
+    // Parse a chunk, passing each wanted frame to its handlers
+    Status feed(const uint8_t *data, size_t len) {
+        size_t used;
+
+        return feed(data, len, used);
+    }
+
+    // Same, setting used to the bytes consumed: all of them, except after
+    // Status::Error, where the rest of the chunk has to be fed again
+    Status feed(const uint8_t *data, size_t len, size_t &used) {
+        size_t i = read_head(data, len);
+        Status status = Status::More;
+
+        if (state_ >= State::frame_header && state_ != State::done) {
+            switch (version_) {
+                case 2: status = read_frames<2>(data, len, i); break;
+                case 3: status = read_frames<3>(data, len, i); break;
+                default: status = read_frames<4>(data, len, i); break;
+            }
+        }
+        if (status != Status::Error) {
+            if (state_ == State::frame_header && pos_ == 0 && tag_remaining_ == 0) {
+                state_ = State::done; // Report the end of the tag right away
+            }
+            status = (state_ == State::done) ? Status::Done : Status::More;
+        }
+        stream_pos_ += i;
+        used = i;
+        return status;
+    }
+
+    // Look for a new tag, keeping the handlers and the stream offset
+    void reset() {
+        release();
+        id3_parser_reset(&head_);
+        state_ = State::head;
+        pos_ = 0;
+        tag_remaining_ = 0;
+    }
+
+    void set_offset(uint64_t offset) { stream_pos_ = offset; }
+
+    template <typename Handler>
+    Handler &handler() { return std::get<Handler>(handlers_); }
+
+private:
+    // pending: a wanted frame's header is read and its data not yet started
+    enum class State : uint8_t { head, frame_header, pending, frame_data, skip, done };
+
+    template <size_t... Is>
+    void dispatch(uint32_t fourcc, const FrameView &frame, std::index_sequence<Is...>) {
+        ((std::tuple_element_t<Is, std::tuple<Handlers...>>::ids::contains(fourcc)
+              ? (void)std::get<Is>(handlers_)(frame)
+              : (void)0),
+         ...);
+    }
+
+    void deliver(uint32_t fourcc, const uint8_t *data, uint64_t offset) {
+        FrameView frame = { id_, data, size_, offset, tag_offset_ };
+
+        dispatch(fourcc, frame, std::index_sequence_for<Handlers...>());
+    }
+
+    void release() {
+        id3_free_frame(frame_data_, size_);
+        frame_data_ = nullptr;
+    }
+
+    // Signature, tag header and extended header, run by the C parser in
+    // head_ and fed no more than it needs, so it stops at the first frame
+    // header
+    size_t read_head(const uint8_t *data, size_t len) {
+        size_t i = 0;
+
+        id3_parser_set_offset(&head_, stream_pos_);
+        while (i < len && state_ == State::head) {
+            // need() is 0 only where one more byte ends the tag
+            size_t n = std::min<size_t>(std::max<size_t>(id3_parser_need(&head_), 1), len - i);
+            size_t used;
+            ID3FrameView frame;
+
+            if (id3_parser_next(&head_, &data[i], n, &used, &frame) == ID3_DONE) {
+                state_ = State::done;
+            } else if (head_.state == STATE_READ_FRAME_HEADER) {
+                version_ = head_.version;
+                tag_remaining_ = head_.tag_remaining;
+                tag_offset_ = id3_parser_tag_offset(&head_);
+                state_ = State::frame_header;
+            }
+            i += used;
+        }
+        return i;
+    }
+
+    // Frames of a tag of one version, from data[i] on
+    template <int Version>
+    Status read_frames(const uint8_t *data, size_t len, size_t &i) {
+        typedef detail::frame_layout<Version> Layout;
+
+        while (state_ != State::done) {
+            if (state_ == State::frame_header) {
+                const uint8_t *header = &data[i];
+
+                if (tag_remaining_ == 0) {
+                    state_ = State::done;
+                    break;
+                }
+                if (pos_ == 0 && len - i >= Layout::header_size &&
+                    tag_remaining_ >= Layout::header_size) {
+                    i += Layout::header_size; // Whole header in the chunk: read it in place
+                    tag_remaining_ -= Layout::header_size;
+                } else {
+                    size_t n = std::min<size_t>(std::min<size_t>(Layout::header_size - pos_, len - i),
+                                                tag_remaining_);
+
+                    if (n == 0) {
+                        break;
+                    }
+                    std::memcpy(&buffer_[pos_], &data[i], n);
+                    pos_ += (uint32_t)n;
+                    i += n;
+                    tag_remaining_ -= (uint32_t)n;
+                    if (pos_ < Layout::header_size) {
+                        if (tag_remaining_ == 0) {
+                            state_ = State::done; // Tag ends inside a frame header
+                        }
+                        continue;
+                    }
+                    header = buffer_;
+                    pos_ = 0;
+                }
+
+                if (header[0] == 0) {
+                    state_ = State::done; // Padding
+                    break;
+                }
+                size_ = Layout::size(header);
+                if (size_ > tag_remaining_) {
+                    state_ = State::done; // Runs past the end of the tag
+                    break;
+                }
+                fourcc_ = Layout::fourcc(header);
+                std::memcpy(id_, header, Layout::id_len);
+                id_[Layout::id_len] = '\0';
+                state_ = wanted(fourcc_) ? State::pending : State::skip;
+            } else if (state_ == State::pending) {
+                if (len - i >= size_) {
+                    // Whole frame in the chunk: deliver it from there, charged
+                    // against the budget as a buffer would be
+                    if (size_ > 0 && !id3_budget_reserve(size_)) {
+                        if (id3_get_budget_policy() == ID3_BUDGET_FAIL) {
+                            return Status::Error;
+                        }
+                        state_ = State::skip;
+                        continue;
+                    }
+                    i += size_;
+                    tag_remaining_ -= size_;
+                    state_ = State::frame_header;
+                    deliver(fourcc_, &data[i - size_], stream_pos_ + i - size_);
+                    id3_budget_release(size_);
+                } else if ((frame_data_ = id3_alloc_frame(size_)) != nullptr) {
+                    state_ = State::frame_data;
+                } else if (id3_get_budget_policy() == ID3_BUDGET_SKIP) {
+                    state_ = State::skip;
+                } else {
+                    return Status::Error; // Still pending: the next feed() retries
+                }
+            } else {
+                size_t n = std::min<size_t>(size_ - pos_, len - i);
+
+                if (n == 0 && pos_ < size_) {
+                    break;
+                }
+                if (state_ == State::frame_data) {
+                    std::memcpy(&frame_data_[pos_], &data[i], n);
+                }
+                pos_ += (uint32_t)n;
+                i += n;
+                tag_remaining_ -= (uint32_t)n;
+                if (pos_ == size_) {
+                    if (state_ == State::frame_data) {
+                        deliver(fourcc_, frame_data_, stream_pos_ + i - size_);
+                        release();
+                    }
+                    pos_ = 0;
+                    state_ = State::frame_header;
+                }
+            }
+        }
+        return Status::More;
+    }
+
+    std::tuple<Handlers...> handlers_;
+    ID3Parser head_;
+    uint64_t stream_pos_ = 0;
+    uint64_t tag_offset_ = 0;
+    uint8_t *frame_data_ = nullptr;
+    uint32_t size_ = 0;
+    uint32_t pos_ = 0;
+    uint32_t tag_remaining_ = 0;
+    uint32_t fourcc_ = 0;
+    uint8_t buffer_[10] = {};
+    char id_[5] = {};
+    State state_ = State::head;
+    uint8_t version_ = 0;
+};
+#endif
+
+#ifdef ID3_HAS_PMR
+// Serve all frame buffers from a memory resource (nullptr restores
+// malloc/free). Like id3_set_allocator(), this is process-wide.
+inline void set_memory_resource(std::pmr::memory_resource *resource) {
+    struct Adapter {
+        static void *alloc(size_t size, void *ctx) {
+            std::pmr::memory_resource *resource = static_cast<std::pmr::memory_resource *>(ctx);
+
+#if defined(__cpp_exceptions)
+            try {
+                return resource->allocate(size);
+            } catch (...) {
+                return nullptr; // The parser reports ID3_ERROR
+            }
+#else
+            return resource->allocate(size); // A failure cannot be caught without exceptions
+#endif
+        }
+        static void free(void *ptr, size_t size, void *ctx) {
+            static_cast<std::pmr::memory_resource *>(ctx)->deallocate(ptr, size);
+        }
+    };
+
+    if (resource) {
+        ID3Allocator allocator = { &Adapter::alloc, &Adapter::free, resource };
+        id3_set_allocator(&allocator);
+    } else {
+        id3_set_allocator(nullptr);
+    }
+}
+#endif
+
+#ifdef ID3_HAS_COROUTINES
+namespace detail {
+
+// Final suspend of task and async_generator: hand control back to the
+// coroutine waiting on the result, if any
+struct resume_continuation {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) const noexcept {
+        std::coroutine_handle<> continuation = self.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+// Exception slot of a promise; without exceptions nothing can be thrown
+struct promise_error {
+#if defined(__cpp_exceptions)
+    std::exception_ptr error;
+
+    void unhandled_exception() { error = std::current_exception(); }
+    void rethrow() const {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+#else
+    void unhandled_exception() { std::terminate(); }
+    void rethrow() const {}
+#endif
+};
+
+} // namespace detail
+
+// Lazy coroutine producing a T. co_await it from another coroutine, or
+// start() it from plain code and collect result() once done().
+template <typename T>
+class task {
+public:
+    struct promise_type : detail::promise_error {
+        std::optional<T> value;
+        std::coroutine_handle<> continuation;
+
+        task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        detail::resume_continuation final_suspend() const noexcept { return {}; }
+        void return_value(T result) { value.emplace(std::move(result)); }
+    };
+
+    task(task &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    ~task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return result(); }
+
+    // Run until the first suspension that is not ready yet
+    void start() { handle_.resume(); }
+    bool done() const { return handle_.done(); }
+    T result() {
+        handle_.promise().rethrow();
+        return std::move(*handle_.promise().value);
+    }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Coroutine that co_yields values and may co_await in between. Consumers
+// loop on co_await next(), which gives a pointer to the value, valid until
+// the next call, or nullptr once the generator has finished.
+template <typename T>
+class async_generator {
+public:
+    struct promise_type : detail::promise_error {
+        const T *current = nullptr;
+        std::coroutine_handle<> continuation;
+
+        struct yield_awaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) const noexcept {
+                return self.promise().continuation;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        async_generator get_return_object() {
+            return async_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        detail::resume_continuation final_suspend() const noexcept { return {}; }
+        yield_awaiter yield_value(const T &value) noexcept {
+            current = &value;
+            return {};
+        }
+        void return_void() noexcept { current = nullptr; }
+    };
+
+    struct next_awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) const noexcept {
+            handle.promise().continuation = consumer;
+            return handle;
+        }
+        const T *await_resume() const {
+            handle.promise().rethrow();
+            return handle.done() ? nullptr : handle.promise().current;
+        }
+    };
+
+    async_generator(async_generator &&other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    async_generator(const async_generator &) = delete;
+    async_generator &operator=(const async_generator &) = delete;
+    ~async_generator() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    next_awaiter next() { return next_awaiter{ handle_ }; }
+
+private:
+    explicit async_generator(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// A byte source for frames() and read_tag() is any type with
+//
+//     awaitable read(uint8_t *buffer, size_t cap);
+//
+// whose co_await gives the number of bytes read into buffer as size_t, 0 at
+// the end of the input. An awaitable that has no data yet suspends the
+// parsing coroutine, and whoever sees the data arrive (an event loop, a
+// completion callback) resumes it; no thread blocks.
+
+// Byte source over memory, cap bytes at a time, that never suspends
+class memory_source {
+public:
+    struct read_awaiter {
+        size_t size;
+
+        bool await_ready() const noexcept { return true; }
+        void await_suspend(std::coroutine_handle<>) const noexcept {}
+        size_t await_resume() const noexcept { return size; }
+    };
+
+    memory_source(const uint8_t *data, size_t len) : data_(data), len_(len) {}
+
+    read_awaiter read(uint8_t *buffer, size_t cap) {
+        size_t n = len_ < cap ? len_ : cap;
+
+        std::memcpy(buffer, data_, n);
+        data_ += n;
+        len_ -= n;
+        return read_awaiter{ n };
+    }
+
+private:
+    const uint8_t *data_;
+    size_t len_;
+};
+
+// Frames of the first tag read from source, in chunks of up to buffer_size
+// bytes. Each FrameView is valid until the next co_await next(). When the
+// generator finishes, status holds Done, Error, or More if the source ended
+// inside the tag. Bytes read past the end of the tag are dropped.
+template <typename Source>
+async_generator<FrameView> frames(Source &source, Status &status, size_t buffer_size = 4096) {
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[buffer_size]);
+    Parser parser;
+    size_t start = 0;
+    size_t end = 0;
+
+    for (;;) {
+        FrameView frame;
+        size_t used;
+
+        // The parser sees what is left first, as the tag may end with it
+        status = parser.next(buffer.get() + start, end - start, used, frame);
+        start += used;
+        if (status == Status::Frame) {
+            status = Status::More;
+            co_yield frame;
+        } else if (status != Status::More) {
+            co_return;
+        } else {
+            start = 0;
+            end = co_await source.read(buffer.get(), buffer_size);
+            if (end == 0) {
+                co_return;
+            }
+        }
+    }
+}
+
+// A frame kept by read_tag(), owning its data
+struct tag_frame {
+    char id[5];
+    FrameBuffer data;
+    uint64_t offset;
+};
+
+// A whole tag: its frames, and Done, Error, or More if the source ended
+// inside the tag
+struct tag {
+    std::vector<tag_frame> frames;
+    Status status = Status::More;
+};
+
+// Read the first tag from source, taking ownership of every frame buffer
+template <typename Source>
+task<tag> read_tag(Source &source, size_t buffer_size = 4096) {
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[buffer_size]);
+    Parser parser;
+    tag result;
+    size_t start = 0;
+    size_t end = 0;
+
+    for (;;) {
+        FrameView frame;
+        size_t used;
+
+        result.status = parser.next(buffer.get() + start, end - start, used, frame);
+        start += used;
+        if (result.status == Status::Frame) {
+            tag_frame kept = { {}, parser.take_frame(), frame.offset };
+
+            std::memcpy(kept.id, frame.id, std::strlen(frame.id) + 1);
+            result.frames.push_back(std::move(kept));
+            result.status = Status::More;
+        } else if (result.status != Status::More) {
+            co_return result;
+        } else {
+            start = 0;
+            end = co_await source.read(buffer.get(), buffer_size);
+            if (end == 0) {
+                co_return result;
+            }
+        }
+    }
+}
+#endif
+
+} // namespace id3
@@ -0,0 +1,334 @@
+#pragma once
+
+// Staged pipelines over the frame queues, for C++11 and later, e.g. read ->
+// parse -> decode -> sink. Each stage runs its function on its own threads,
+// taking items from a bounded channel and pushing results to the next one.
+// A full channel makes the stage feeding it wait, so a slow stage throttles
+// every stage before it instead of letting queues grow. Per-stage counters
+// show where the time goes while the pipeline runs.
+// decode_frames() runs the frames of one large tag through such a pipeline.
+// Builds with -fno-exceptions; stage functions must not throw.
+
+#include "id3v2queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace id3 {
+
+// Bounded channel between stages, allocated once
+template <typename T>
+using channel = mpmc_queue<T, blocking_wait>;
+
+namespace detail {
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Counters of one stage thread, written by that thread only and read by
+// pipeline::stats() at any time. Padded rather than aligned, as arrays of
+// over-aligned types need C++17 new.
+struct stage_counters {
+    std::atomic<uint64_t> items{ 0 };
+    std::atomic<uint64_t> busy_ns{ 0 };
+    std::atomic<uint64_t> blocked_ns{ 0 };
+    std::atomic<uint64_t> depth_sum{ 0 };
+    std::atomic<uint64_t> depth_max{ 0 };
+    uint8_t padding[cache_line - 5 * sizeof(std::atomic<uint64_t>)];
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+} // namespace detail
+
+// Where a stage function sends its results
+template <typename T>
+class output {
+public:
+    explicit output(channel<T> &next) : next_(next) {}
+
+    // Waits while the next stage's channel is full. Returns false if it was
+    // closed, which only happens once the pipeline is shutting down.
+    bool push(T &&value) {
+        if (next_.try_push(std::move(value))) {
+            return true;
+        }
+
+        uint64_t start = detail::now_ns();
+        bool pushed = next_.push(std::move(value));
+
+        blocked_ns_ += detail::now_ns() - start;
+        return pushed;
+    }
+
+    // Time spent waiting in push() so far
+    uint64_t blocked_ns() const { return blocked_ns_; }
+
+private:
+    channel<T> &next_;
+    uint64_t blocked_ns_ = 0;
+};
+
+// Snapshot of one stage. The shares are of the stage's thread time since
+// start(), up to now or to when the stage finished; what is left is time
+// spent waiting for input.
+struct stage_stats {
+    std::string name;
+    unsigned threads;
+    uint64_t items;             // Items taken from the input channel
+    double busy;                // Share spent in the stage function
+    double blocked;             // Share spent waiting on a full output channel
+    double depth;               // Mean input channel depth when taking an item
+    size_t max_depth;
+    size_t capacity;            // Of the input channel
+};
+
+// Stages added with add_stage() and add_sink() start together with start().
+// Feed the first stage's channel from any thread and close it once done;
+// each stage closes its output when its last thread has drained its input,
+// so the close travels down the pipeline and wait() returns when the sink
+// is done. The destructor waits too.
+class pipeline {
+public:
+    pipeline() {}
+    pipeline(const pipeline &) = delete;
+    pipeline &operator=(const pipeline &) = delete;
+    ~pipeline() { wait(); }
+
+    // A stage of threads threads running fn(In &item, output<Out> &out) for
+    // every item, which may push any number of results. Each thread has its
+    // own copy of fn, so per-thread state (a parser, a decoder) can live in
+    // it.
+    template <typename In, typename Out, typename Fn>
+    void add_stage(const char *name, unsigned threads, channel<In> &input, channel<Out> &next, Fn fn) {
+        stage *added = new_stage(name, threads, input.capacity());
+
+        added->run = [added, &input, &next, fn](unsigned thread) mutable {
+            detail::stage_counters &counters = added->counters[thread];
+            output<Out> out(next);
+            In item;
+
+            for (;;) {
+                uint64_t depth = input.size();
+
+                if (!input.pop(item)) {
+                    break;
+                }
+
+                uint64_t start = detail::now_ns();
+                uint64_t blocked = out.blocked_ns();
+
+                fn(item, out);
+                blocked = out.blocked_ns() - blocked;
+                record(counters, depth, detail::now_ns() - start - blocked, blocked);
+            }
+            if (added->running.fetch_sub(1) == 1) {
+                added->end_ns.store(detail::now_ns(), std::memory_order_relaxed);
+                next.close();
+            }
+        };
+    }
+
+    // The last stage: fn(In &item) for every item
+    template <typename In, typename Fn>
+    void add_sink(const char *name, unsigned threads, channel<In> &input, Fn fn) {
+        stage *added = new_stage(name, threads, input.capacity());
+
+        added->run = [added, &input, fn](unsigned thread) mutable {
+            detail::stage_counters &counters = added->counters[thread];
+            In item;
+
+            for (;;) {
+                uint64_t depth = input.size();
+
+                if (!input.pop(item)) {
+                    break;
+                }
+
+                uint64_t start = detail::now_ns();
+
+                fn(item);
+                record(counters, depth, detail::now_ns() - start, 0);
+            }
+            if (added->running.fetch_sub(1) == 1) {
+                added->end_ns.store(detail::now_ns(), std::memory_order_relaxed);
+            }
+        };
+    }
+
+    void start() {
+        start_ns_ = detail::now_ns();
+        for (std::unique_ptr<stage> &added : stages_) {
+            for (unsigned thread = 0; thread < added->threads; thread++) {
+                threads_.emplace_back(added->run, thread);
+            }
+        }
+    }
+
+    void wait() {
+        for (std::thread &thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+    }
+
+    // Safe to call from any thread while the pipeline runs
+    std::vector<stage_stats> stats() const {
+        std::vector<stage_stats> result;
+        uint64_t now = detail::now_ns();
+
+        for (const std::unique_ptr<stage> &added : stages_) {
+            stage_stats snapshot = { added->name, added->threads, 0, 0, 0, 0, 0, added->capacity };
+            uint64_t end = added->end_ns.load(std::memory_order_relaxed);
+            double total = static_cast<double>(((end ? end : now) - start_ns_) * added->threads);
+            uint64_t busy = 0;
+            uint64_t blocked = 0;
+            uint64_t depth = 0;
+
+            for (unsigned thread = 0; thread < added->threads; thread++) {
+                const detail::stage_counters &counters = added->counters[thread];
+
+                snapshot.items += counters.items.load(std::memory_order_relaxed);
+                busy += counters.busy_ns.load(std::memory_order_relaxed);
+                blocked += counters.blocked_ns.load(std::memory_order_relaxed);
+                depth += counters.depth_sum.load(std::memory_order_relaxed);
+                snapshot.max_depth = std::max<size_t>(snapshot.max_depth,
+                                                      counters.depth_max.load(std::memory_order_relaxed));
+            }
+            if (total > 0) {
+                snapshot.busy = busy / total;
+                snapshot.blocked = blocked / total;
+            }
+            if (snapshot.items) {
+                snapshot.depth = static_cast<double>(depth) / snapshot.items;
+            }
+            result.push_back(snapshot);
+        }
+        return result;
+    }
+
+private:
+    struct stage {
+        std::string name;
+        unsigned threads;
+        size_t capacity;
+        std::unique_ptr<detail::stage_counters[]> counters;
+        std::atomic<unsigned> running;
+        std::atomic<uint64_t> end_ns{ 0 };
+        std::function<void(unsigned)> run;
+    };
+
+    stage *new_stage(const char *name, unsigned threads, size_t capacity) {
+        stage *added = new stage;
+
+        added->name = name;
+        added->threads = threads ? threads : 1;
+        added->capacity = capacity;
+        added->counters.reset(new detail::stage_counters[added->threads]);
+        added->running.store(added->threads, std::memory_order_relaxed);
+        stages_.emplace_back(added);
+        return added;
+    }
+
+    static void record(detail::stage_counters &counters, uint64_t depth, uint64_t busy, uint64_t blocked) {
+        detail::stage_counters::add(counters.items, 1);
+        detail::stage_counters::add(counters.busy_ns, busy);
+        detail::stage_counters::add(counters.blocked_ns, blocked);
+        detail::stage_counters::add(counters.depth_sum, depth);
+        if (depth > counters.depth_max.load(std::memory_order_relaxed)) {
+            counters.depth_max.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::unique_ptr<stage>> stages_;
+    std::vector<std::thread> threads_;
+    uint64_t start_ns_ = 0;
+};
+
+// An item with its position in the input, for stages whose threads finish
+// items out of order
+template <typename T>
+struct sequenced {
+    size_t seq = 0;
+    T value;
+};
+
+// Sink function putting sequenced items back in order: fn(T &) sees them
+// as 0, 1, 2, ... Items that arrive early wait in a map, so memory grows
+// with how far the stage before runs ahead. Use with a single sink thread.
+template <typename T, typename Fn>
+class in_order {
+public:
+    explicit in_order(Fn fn) : fn_(std::move(fn)) {}
+
+    void operator()(sequenced<T> &item) {
+        if (item.seq != next_) {
+            early_.insert(std::make_pair(item.seq, std::move(item.value)));
+            return;
+        }
+        fn_(item.value);
+        next_++;
+        for (auto it = early_.find(next_); it != early_.end(); it = early_.find(next_)) {
+            fn_(it->second);
+            early_.erase(it);
+            next_++;
+        }
+    }
+
+private:
+    Fn fn_;
+    size_t next_ = 0;
+    std::map<size_t, T> early_;
+};
+
+// Decode the frames of a tag held in memory (tag points at "ID3") in
+// parallel: index them with id3_index_frames(), run decode(const FrameView &)
+// for each on threads threads, and pass what it returns to sink(R &) in tag
+// order, on one more thread. R must be default-constructible and movable.
+// Frame views point into tag; their offsets are from its start. Returns the number of frames, or -1 if tag does not start
+// with a valid tag header. Starting the threads costs tens of microseconds,
+// so this pays off for tags whose frames take longer than that to decode.
+template <typename Decode, typename Sink>
+int decode_frames(const uint8_t *tag, size_t len, unsigned threads, Decode decode, Sink sink) {
+    typedef decltype(std::declval<Decode &>()(std::declval<const FrameView &>())) Result;
+    int count = id3_index_frames(tag, len, nullptr, 0);
+
+    if (count <= 0) {
+        return count;
+    }
+
+    std::vector<ID3FrameRef> refs(static_cast<size_t>(count));
+    channel<size_t> frames(64);
+    channel<sequenced<Result>> results(64);
+    pipeline pipeline;
+
+    id3_index_frames(tag, len, refs.data(), refs.size());
+    pipeline.add_stage("decode", threads, frames, results,
+                       [tag, &refs, decode](size_t &index, output<sequenced<Result>> &out) mutable {
+        const ID3FrameRef &ref = refs[index];
+        FrameView frame = { ref.id, tag + ref.offset, ref.size, ref.offset, 0 };
+        sequenced<Result> result;
+
+        result.seq = index;
+        result.value = decode(frame);
+        out.push(std::move(result));
+    });
+    pipeline.add_sink("deliver", 1, results, in_order<Result, Sink>(std::move(sink)));
+    pipeline.start();
+    for (size_t i = 0; i < refs.size(); i++) {
+        frames.push(size_t(i));
+    }
+    frames.close();
+    pipeline.wait();
+    return count;
+}
+
+} // namespace id3
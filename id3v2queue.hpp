@@ -0,0 +1,333 @@
+#pragma once
+
+// Bounded lock-free queues for handing frames from parsing threads to
+// worker threads, for C++11 and later. Builds with -fno-exceptions.
+//
+// id3::spsc_queue<T, Wait> is for one producer and one consumer thread,
+// id3::mpmc_queue<T, Wait> for any number of each. Both hold up to
+// capacity() values of T, which must be default-constructible and movable,
+// in a ring allocated once. try_push() and try_pop() never wait; push() and
+// pop() wait on a full or empty queue as Wait says: id3::spin_wait or
+// id3::blocking_wait.
+
+#include "id3v2parser.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace id3 {
+
+// A frame handed from a parser to a worker: its ID as an ID3_FOURCC() value,
+// its data, owned and freed through the configured allocator, and the
+// caller's stream ID
+struct frame_desc {
+    uint32_t id = 0;
+    FrameBuffer payload;
+    uint64_t source = 0;
+
+    frame_desc() {}
+    frame_desc(const FrameView &frame, FrameBuffer data, uint64_t source)
+        : id(ID3_FOURCC(frame.id[0], frame.id[1], frame.id[2], frame.id[3])),
+          payload(std::move(data)), source(source) {}
+};
+
+namespace detail {
+
+// Producer and consumer indexes live on separate cache lines
+constexpr size_t cache_line = 64;
+
+inline void cpu_relax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+inline size_t ring_size(size_t capacity) {
+    size_t size = 2;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+} // namespace detail
+
+// Busy-wait, yielding the CPU after a while. Lowest latency when producers
+// and consumers each have a core; burns it while they wait.
+class spin_wait {
+public:
+    template <typename Ready>
+    void wait(Ready ready) {
+        for (unsigned spins = 0; !ready(); spins++) {
+            if (spins < 64) {
+                detail::cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+    void notify() {}
+};
+
+// Spin briefly, then sleep on a condition variable. While nobody sleeps,
+// notify() is a fence and a load, and takes no lock; after waking the
+// sleepers it is that again until one of them goes back to sleep.
+class blocking_wait {
+public:
+    template <typename Ready>
+    void wait(Ready ready) {
+        for (unsigned spins = 0; spins < 64; spins++) {
+            if (ready()) {
+                return;
+            }
+            detail::cpu_relax();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        // Either notify() sees the sleeper, or ready() sees its change. A
+        // notify() wakes every sleeper, which registers again if it has to.
+        for (;;) {
+            sleepers_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                return;
+            }
+            cond_.wait(lock);
+        }
+    }
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed)) {
+            // A sleeper between its ready() check and its wait holds the lock
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                sleepers_.store(false, std::memory_order_relaxed);
+            }
+            cond_.notify_all();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::atomic<bool> sleepers_{ false };
+};
+
+namespace detail {
+
+// Waiting push() and pop() and close(), over the derived queue's try_push(),
+// try_pop() and size()
+template <typename Queue, typename T, typename Wait>
+class queue_waits {
+public:
+    // Move value in, waiting while the queue is full. Returns false, leaving
+    // value alone, if the queue is closed.
+    bool push(T &&value) {
+        Queue &queue = static_cast<Queue &>(*this);
+
+        for (;;) {
+            if (closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (queue.try_push(std::move(value))) {
+                return true;
+            }
+            not_full_.wait([&] {
+                return closed_.load(std::memory_order_acquire) || queue.size() < queue.capacity();
+            });
+        }
+    }
+
+    // Move the oldest value out, waiting while the queue is empty. Returns
+    // false once the queue is closed and empty.
+    bool pop(T &value) {
+        Queue &queue = static_cast<Queue &>(*this);
+
+        for (;;) {
+            if (queue.try_pop(value)) {
+                return true;
+            }
+            if (closed_.load(std::memory_order_acquire)) {
+                return queue.try_pop(value);
+            }
+            not_empty_.wait([&] { return closed_.load(std::memory_order_acquire) || queue.size() > 0; });
+        }
+    }
+
+    // No more pushes: waiting producers give up and consumers drain what is
+    // left. Call once the producers are done.
+    void close() {
+        closed_.store(true, std::memory_order_release);
+        not_empty_.notify();
+        not_full_.notify();
+    }
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+protected:
+    Wait not_empty_;
+    Wait not_full_;
+    std::atomic<bool> closed_{ false };
+};
+
+} // namespace detail
+
+// Single-producer, single-consumer ring. Each side caches the other's index
+// and reads it again only when the ring looks full or empty.
+template <typename T, typename Wait = blocking_wait>
+class spsc_queue : public detail::queue_waits<spsc_queue<T, Wait>, T, Wait> {
+public:
+    // capacity is rounded up to a power of two
+    explicit spsc_queue(size_t capacity) : mask_(detail::ring_size(capacity) - 1), slots_(new T[mask_ + 1]) {}
+    spsc_queue(const spsc_queue &) = delete;
+    spsc_queue &operator=(const spsc_queue &) = delete;
+
+    // Producer thread only. Moves from value only if there is room.
+    bool try_push(T &&value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        this->not_empty_.notify();
+        return true;
+    }
+
+    // Consumer thread only
+    bool try_pop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        this->not_full_.notify();
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Values queued; exact only on a quiet queue
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    alignas(detail::cache_line) std::atomic<size_t> head_{ 0 };
+    size_t tail_cache_ = 0;
+    alignas(detail::cache_line) std::atomic<size_t> tail_{ 0 };
+    size_t head_cache_ = 0;
+};
+
+// Multi-producer, multi-consumer ring. Each slot carries a sequence number
+// that says whether it is a producer's or a consumer's turn, so either side
+// claims a slot with one compare-and-swap and copies without holding a lock.
+template <typename T, typename Wait = blocking_wait>
+class mpmc_queue : public detail::queue_waits<mpmc_queue<T, Wait>, T, Wait> {
+public:
+    // capacity is rounded up to a power of two
+    explicit mpmc_queue(size_t capacity)
+        : mask_(detail::ring_size(capacity) - 1), cells_(new cell[mask_ + 1]) {
+        for (size_t i = 0; i <= mask_; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    // Moves from value only if there is room
+    bool try_push(T &&value) {
+        size_t pos = enqueue_.load(std::memory_order_relaxed);
+        cell *target;
+
+        for (;;) {
+            target = &cells_[pos & mask_];
+            size_t sequence = target->sequence.load(std::memory_order_acquire);
+            ptrdiff_t turn = static_cast<ptrdiff_t>(sequence - pos);
+
+            if (turn == 0) {
+                if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (turn < 0) {
+                return false;
+            } else {
+                pos = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+        target->value = std::move(value);
+        target->sequence.store(pos + 1, std::memory_order_release);
+        this->not_empty_.notify();
+        return true;
+    }
+
+    bool try_pop(T &value) {
+        size_t pos = dequeue_.load(std::memory_order_relaxed);
+        cell *source;
+
+        for (;;) {
+            source = &cells_[pos & mask_];
+            size_t sequence = source->sequence.load(std::memory_order_acquire);
+            ptrdiff_t turn = static_cast<ptrdiff_t>(sequence - (pos + 1));
+
+            if (turn == 0) {
+                if (dequeue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (turn < 0) {
+                return false;
+            } else {
+                pos = dequeue_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(source->value);
+        source->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        this->not_full_.notify();
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Values queued or being copied in or out; exact only on a quiet queue
+    size_t size() const {
+        size_t dequeued = dequeue_.load(std::memory_order_acquire);
+        size_t enqueued = enqueue_.load(std::memory_order_acquire);
+
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+    alignas(detail::cache_line) std::atomic<size_t> enqueue_{ 0 };
+    alignas(detail::cache_line) std::atomic<size_t> dequeue_{ 0 };
+};
+
+} // namespace id3
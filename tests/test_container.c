@@ -0,0 +1,697 @@
+// Container front-end tests: tags carried in synthetic transport streams,
+// fragmented MP4, WAV, AIFF and DSF files and tar archives must come out with
+// the same frames as the bare tags, whatever the chunk size, and damaged tags
+// must be dropped without losing the others.
+
+#include "id3v2container.h"
+#include "synth_mp4.h"
+#include "synth_tag.h"
+#include "synth_tar.h"
+#include "synth_ts.h"
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+#define MAX_TAGS 16
+
+// Order-sensitive digest of the frames seen
+typedef struct {
+    uint32_t count;
+    uint64_t hash;
+} Digest;
+
+// Frames and timing of every tag reported
+typedef struct {
+    Digest current;
+    Digest tags[MAX_TAGS];
+    uint64_t pts[MAX_TAGS];    // PTS or emsg presentation time
+    uint32_t ids[MAX_TAGS];    // emsg event IDs
+    int results[MAX_TAGS];     // tar member results
+    char names[MAX_TAGS][ID3_TAR_NAME_MAX];
+    size_t count;
+    size_t dropped;            // Tags cut short
+} Collector;
+
+static void digest_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    Digest *digest = (Digest *)user_data;
+    uint64_t hash = digest->hash * 1099511628211u;
+    uint32_t i;
+
+    for (; *id; id++) {
+        hash = (hash ^ (uint8_t)*id) * 1099511628211u;
+    }
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211u;
+    }
+    digest->hash = hash ^ size;
+    digest->count++;
+}
+
+static void collect_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    digest_frame(id, data, size, &((Collector *)user_data)->current);
+}
+
+static void collect_tag(uint64_t pts, int complete, void *user_data) {
+    Collector *collector = (Collector *)user_data;
+
+    if (!complete) {
+        collector->dropped++;
+    } else if (collector->count < MAX_TAGS) {
+        collector->tags[collector->count] = collector->current;
+        collector->pts[collector->count] = pts;
+    }
+    collector->count += complete;
+    collector->current.count = 0;
+    collector->current.hash = 0;
+}
+
+static void collect_event(const ID3EmsgEvent *event, int complete, void *user_data) {
+    Collector *collector = (Collector *)user_data;
+
+    if (complete && collector->count < MAX_TAGS) {
+        collector->ids[collector->count] = event->id;
+    }
+    collect_tag(event->presentation_time, complete, user_data);
+}
+
+static void collect_member(const char *name, uint64_t size, int result, void *user_data) {
+    Collector *collector = (Collector *)user_data;
+
+    (void)size;
+    if (collector->count < MAX_TAGS) {
+        collector->results[collector->count] = result;
+        strcpy(collector->names[collector->count], name);
+    }
+    collect_tag(0, 1, user_data);
+}
+
+static const SynthTagSpec test_tags[] = {
+    { 2, 0, 10, 0, 0, 11 },
+    { 3, 0, 10, 0, 128, 13 },
+    { 3, 1, 20, 3000, 0, 14 },
+    { 4, 0, 0, 0, 20, 17 },
+    { 4, 1, 8, 5000, 300, 16 },
+};
+
+#define TEST_TAG_COUNT (sizeof(test_tags) / sizeof(test_tags[0]))
+
+// The third tag spans many packets; its second packet is what the gap test drops
+#define SPANNING_TAG 2
+
+static uint8_t stream[256 * 1024];
+static uint8_t mp4[256 * 1024];
+static uint8_t archive[256 * 1024];
+static uint8_t tag[64 * 1024];
+
+static uint64_t test_pts(size_t t) {
+    return t == 1 ? 0x1FFFFFFF0u : 90000u * (t + 1); // One near the 33-bit limit
+}
+
+// Noise, a metadata PES before the PSI that must be ignored, PAT and PMT,
+// then the tags between media packets. Returns the stream length and the
+// offset of the packet the gap test drops.
+static size_t build_stream(Digest *expected, size_t *gap) {
+    SynthTs ts;
+    size_t len = 0;
+    size_t t;
+    int i;
+
+    memset(&ts, 0, sizeof(ts));
+    ts.state = 0x2468ACE1u;
+    len += synth_ts_noise(&ts, &stream[len]);
+    len += synth_ts_tag(&ts, &stream[len], 1, tag, synth_tag(tag, sizeof(tag), &test_tags[0]));
+    len += synth_ts_psi(&ts, &stream[len]);
+    for (t = 0; t < TEST_TAG_COUNT; t++) {
+        size_t n = synth_tag(tag, sizeof(tag), &test_tags[t]);
+
+        expected[t].count = 0;
+        expected[t].hash = 0;
+        CHECK(id3_parse_buffer(tag, n, digest_frame, &expected[t]) == ID3_DONE);
+        for (i = 0; i < 3; i++) {
+            len += synth_ts_noise(&ts, &stream[len]);
+        }
+        if (t == SPANNING_TAG) {
+            *gap = len + 188;
+        }
+        len += synth_ts_tag(&ts, &stream[len], test_pts(t), tag, n);
+    }
+    len += synth_ts_noise(&ts, &stream[len]);
+    return len;
+}
+
+static void demux_chunked(const uint8_t *data, size_t len, size_t chunk, Collector *collector) {
+    ID3TsDemux demux;
+    size_t off;
+
+    memset(collector, 0, sizeof(Collector));
+    id3_ts_init(&demux, collect_frame, collect_tag, collector);
+    for (off = 0; off < len; off += chunk) {
+        CHECK(id3_ts_feed(&demux, data + off, len - off < chunk ? len - off : chunk) == ID3_MORE);
+    }
+    id3_ts_cleanup(&demux);
+}
+
+static void test_ts_chunk_sizes(const uint8_t *data, size_t len, const Digest *expected) {
+    static const size_t chunks[] = { 1, 7, 187, 188, 189, 4096, 65536 };
+    size_t c;
+    size_t t;
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        Collector collector;
+
+        demux_chunked(data, len, chunks[c], &collector);
+        CHECK(collector.count == TEST_TAG_COUNT && collector.dropped == 0);
+        for (t = 0; t < TEST_TAG_COUNT && t < collector.count; t++) {
+            CHECK(collector.pts[t] == test_pts(t));
+            CHECK(collector.tags[t].count == expected[t].count &&
+                  collector.tags[t].hash == expected[t].hash);
+        }
+    }
+}
+
+// A lost packet inside a tag drops that tag only
+static void test_ts_gap(const uint8_t *data, size_t len, size_t gap, const Digest *expected) {
+    static uint8_t damaged[sizeof(stream)];
+    Collector collector;
+    size_t t;
+    size_t i;
+
+    memcpy(damaged, data, gap);
+    memcpy(&damaged[gap], &data[gap + 188], len - gap - 188);
+    demux_chunked(damaged, len - 188, 4096, &collector);
+    CHECK(collector.count == TEST_TAG_COUNT - 1 && collector.dropped == 1);
+    for (t = 0, i = 0; t < TEST_TAG_COUNT && i < collector.count; t++) {
+        if (t != SPANNING_TAG) {
+            CHECK(collector.pts[i] == test_pts(t));
+            CHECK(collector.tags[i].hash == expected[t].hash);
+            i++;
+        }
+    }
+}
+
+// A metadata packet sent twice, as the continuity rules allow, is read
+// once; sent three times it counts as a gap and drops its tag
+static void test_ts_duplicate(const uint8_t *data, size_t len, size_t gap, const Digest *expected) {
+    static uint8_t repeated[sizeof(stream) + 3 * 188];
+    Collector collector;
+    size_t packet;
+    size_t t;
+    int copies;
+
+    // The start of the spanning tag's PES, and the packet after it
+    for (packet = gap - 188; packet <= gap; packet += 188) {
+        for (copies = 2; copies <= 3; copies++) {
+            size_t n = packet + 188;
+            int c;
+
+            memcpy(repeated, data, n);
+            for (c = 1; c < copies; c++) {
+                memcpy(&repeated[n], &data[packet], 188);
+                n += 188;
+            }
+            memcpy(&repeated[n], &data[packet + 188], len - packet - 188);
+            n += len - packet - 188;
+            demux_chunked(repeated, n, 4096, &collector);
+
+            if (copies == 2) {
+                CHECK(collector.count == TEST_TAG_COUNT && collector.dropped == 0);
+                for (t = 0; t < TEST_TAG_COUNT && t < collector.count; t++) {
+                    CHECK(collector.pts[t] == test_pts(t));
+                    CHECK(collector.tags[t].count == expected[t].count &&
+                          collector.tags[t].hash == expected[t].hash);
+                }
+            } else if (packet == gap) {
+                CHECK(collector.count == TEST_TAG_COUNT - 1 && collector.dropped == 1);
+            }
+        }
+    }
+}
+
+// Garbage before the first packet is skipped by resyncing on 0x47
+static void test_ts_resync(const uint8_t *data, size_t len, const Digest *expected) {
+    static uint8_t shifted[sizeof(stream) + 8];
+    Collector collector;
+
+    memcpy(shifted, "\x12\x34\x56", 3);
+    memcpy(&shifted[3], data, len);
+    demux_chunked(shifted, len + 3, 1000, &collector);
+    CHECK(collector.count == TEST_TAG_COUNT);
+    CHECK(collector.count > 0 && collector.tags[0].hash == expected[0].hash);
+}
+
+// ID3 events among other boxes: a styp, an event with another scheme,
+// fragments with 32- and 64-bit mdat sizes and an event whose box ends
+// inside its tag. Events 0, 2 and 4 carry test tags 0, 2 and 4.
+static size_t build_mp4(void) {
+    static const uint8_t styp[16] = { 'c', 'm', 'f', 'c' };
+    uint32_t state = 0x1234567u;
+    size_t len = 0;
+    size_t n;
+
+    len += synth_mp4_header(&mp4[len], "styp", sizeof(styp), 0);
+    memcpy(&mp4[len], styp, sizeof(styp));
+    len += sizeof(styp);
+    n = synth_tag(tag, sizeof(tag), &test_tags[0]);
+    len += synth_mp4_emsg(&mp4[len], 1, SYNTH_MP4_ID3_SCHEME, 0x123456789u, 0, tag, n);
+    n = synth_tag(tag, sizeof(tag), &test_tags[1]);
+    len += synth_mp4_emsg(&mp4[len], 0, "urn:scte:scte35:2013:bin", 10, 1, tag, n);
+    len += synth_mp4_fragment(&mp4[len], &state, 100000, 0);
+    n = synth_tag(tag, sizeof(tag), &test_tags[2]);
+    len += synth_mp4_emsg(&mp4[len], 0, SYNTH_MP4_ID3_SCHEME, 180000, 2, tag, n);
+    len += synth_mp4_fragment(&mp4[len], &state, 5000, 1);
+    n = synth_tag(tag, sizeof(tag), &test_tags[3]);
+    len += synth_mp4_emsg(&mp4[len], 1, SYNTH_MP4_ID3_SCHEME, 270000, 3, tag, n / 2);
+    n = synth_tag(tag, sizeof(tag), &test_tags[4]);
+    len += synth_mp4_emsg(&mp4[len], 1, SYNTH_MP4_ID3_SCHEME, 360000, 4, tag, n);
+    len += synth_mp4_fragment(&mp4[len], &state, 20000, 0);
+    return len;
+}
+
+static void check_events(const Collector *collector, const Digest *expected) {
+    static const uint64_t times[] = { 0x123456789u, 180000, 360000 };
+    size_t e;
+
+    CHECK(collector->count == 3 && collector->dropped == 1);
+    for (e = 0; e < 3 && e < collector->count; e++) {
+        CHECK(collector->pts[e] == times[e]);
+        CHECK(collector->ids[e] == e * 2);
+        CHECK(collector->tags[e].count == expected[e * 2].count &&
+              collector->tags[e].hash == expected[e * 2].hash);
+    }
+}
+
+static void test_emsg_chunk_sizes(const uint8_t *data, size_t len, const Digest *expected) {
+    static const size_t chunks[] = { 1, 7, 16, 500, 4096, 65536, 1 << 20 };
+    size_t c;
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        ID3EmsgDemux demux;
+        Collector collector;
+        size_t chunk = chunks[c];
+        size_t off;
+
+        memset(&collector, 0, sizeof(collector));
+        id3_emsg_init(&demux, collect_frame, collect_event, &collector);
+        for (off = 0; off < len; off += chunk) {
+            CHECK(id3_emsg_feed(&demux, data + off, len - off < chunk ? len - off : chunk) == ID3_MORE);
+        }
+        id3_emsg_cleanup(&demux);
+        check_events(&collector, expected);
+    }
+}
+
+// Seeking past the boxes the walker skips must find the same events
+static void test_emsg_skip(const uint8_t *data, size_t len, const Digest *expected) {
+    ID3EmsgDemux demux;
+    Collector collector;
+    size_t fed = 0;
+    size_t off = 0;
+
+    memset(&collector, 0, sizeof(collector));
+    id3_emsg_init(&demux, collect_frame, collect_event, &collector);
+    while (off < len) {
+        size_t n = len - off < 256 ? len - off : 256;
+
+        CHECK(id3_emsg_feed(&demux, data + off, n) == ID3_MORE);
+        fed += n;
+        off += n + (size_t)id3_emsg_skip(&demux);
+    }
+    id3_emsg_cleanup(&demux);
+    check_events(&collector, expected);
+    CHECK(off == len && fed < len / 4);
+}
+
+// A box smaller than its own header stops the walk
+static void test_emsg_broken(void) {
+    static const uint8_t broken[] = { 0, 0, 0, 4, 'f', 'r', 'e', 'e', 0, 0, 0, 0 };
+    ID3EmsgDemux demux;
+
+    id3_emsg_init(&demux, NULL, NULL, NULL);
+    CHECK(id3_emsg_feed(&demux, broken, sizeof(broken)) == ID3_ERROR);
+    CHECK(id3_emsg_feed(&demux, broken, sizeof(broken)) == ID3_ERROR);
+    id3_emsg_cleanup(&demux);
+}
+
+// Timestamp and audio sync from packed audio segment heads
+static void test_segment_head(void) {
+    uint8_t head[512];
+    ID3SegmentHead result;
+    size_t len = synth_ts_audio_head(head, 0xFFFFFFFF00000001u, 1, 0);
+    size_t cut;
+
+    CHECK(id3_segment_head(head, len, &result) == ID3_DONE);
+    CHECK(result.timestamp == 0x100000001u && result.audio == ID3_AUDIO_ADTS);
+    CHECK(result.audio_offset == len - 7);
+
+    len = synth_ts_audio_head(head, 8100000, 0, 100);
+    CHECK(id3_segment_head(head, len, &result) == ID3_DONE);
+    CHECK(result.timestamp == 8100000 && result.audio == ID3_AUDIO_MPEG);
+
+    // Cut in the padding the timestamp is known, but not the audio
+    cut = (size_t)result.audio_offset - 50;
+    CHECK(id3_segment_head(head, cut, &result) == ID3_MORE);
+    CHECK(result.timestamp == 8100000 && result.audio_offset == cut + 50);
+
+    // Garbage after the tag, a tag without the PRIV frame, no tag
+    head[len - 4] = 0x47;
+    CHECK(id3_segment_head(head, len, &result) == ID3_DONE && result.audio == ID3_AUDIO_NONE);
+    len = synth_tag(tag, sizeof(tag), &test_tags[1]);
+    CHECK(id3_segment_head(tag, len + 3, &result) == ID3_DONE && result.timestamp == ID3_TS_NO_PTS);
+    CHECK(id3_segment_head(&head[1], 100, &result) == ID3_ERROR);
+}
+
+// A file of head bytes, gap zero bytes and tail bytes, so multi-gigabyte
+// containers cost nothing to build
+typedef struct {
+    const uint8_t *head;
+    size_t head_len;
+    uint64_t gap;
+    const uint8_t *tail;
+    size_t tail_len;
+    int reads;
+} VirtualFile;
+
+static size_t virtual_read_at(uint64_t offset, uint8_t *buf, size_t len, void *ctx) {
+    VirtualFile *file = (VirtualFile *)ctx;
+    uint64_t tail_start = file->head_len + file->gap;
+    size_t i;
+
+    file->reads++;
+    for (i = 0; i < len; i++, offset++) {
+        if (offset < file->head_len) {
+            buf[i] = file->head[offset];
+        } else if (offset < tail_start) {
+            buf[i] = 0;
+        } else if (offset - tail_start < file->tail_len) {
+            buf[i] = file->tail[offset - tail_start];
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+static void put_le32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static void put_le64(uint8_t *out, uint64_t value) {
+    put_le32(out, (uint32_t)value);
+    put_le32(&out[4], (uint32_t)(value >> 32));
+}
+
+// Locate the tag in file, check the number of reads, then parse the region
+static void check_located(VirtualFile *file, uint64_t offset, int max_reads, const Digest *expected) {
+    ID3TagLocation location;
+    Digest digest = { 0, 0 };
+
+    file->reads = 0;
+    CHECK(id3_locate_tag(virtual_read_at, file, &location) == 1);
+    CHECK(file->reads <= max_reads);
+    CHECK(location.offset == offset);
+    CHECK(id3_parse_region(virtual_read_at, file, &location, digest_frame, &digest) == ID3_DONE);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+}
+
+static void test_locators(const Digest *expected) {
+    static uint8_t tail[16 * 1024];
+    uint8_t head[128];
+    size_t len = synth_tag(tag, sizeof(tag), &test_tags[2]);
+    uint64_t gap = (uint64_t)1 << 30;
+    VirtualFile file;
+    ID3TagLocation location;
+
+    // WAV: fmt, a 1 GB data chunk, an odd-sized LIST chunk, then "id3 "
+    memcpy(head, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0", 20);
+    memset(&head[20], 1, 16);
+    memcpy(&head[36], "data", 4);
+    put_le32(&head[40], (uint32_t)gap);
+    memcpy(tail, "LIST\x03\0\0\0abc\0id3 ", 16);
+    put_le32(&tail[16], (uint32_t)len);
+    memcpy(&tail[20], tag, len);
+    file.head = head;
+    file.head_len = 44;
+    file.gap = gap;
+    file.tail = tail;
+    file.tail_len = 20 + len;
+    check_located(&file, 44 + gap + 20, 2, &expected[2]);
+
+    // RF64: the data size is in the ds64 chunk, here 5 GB
+    gap = (uint64_t)5 << 30;
+    memcpy(head, "RF64\xFF\xFF\xFF\xFFWAVEds64\x1C\0\0\0", 20);
+    put_le64(&head[20], 0);
+    put_le64(&head[28], gap);
+    memset(&head[36], 0, 12);
+    memcpy(&head[48], "data\xFF\xFF\xFF\xFF", 8);
+    memcpy(tail, "ID3 ", 4);
+    put_le32(&tail[4], (uint32_t)len);
+    memcpy(&tail[8], tag, len);
+    file.head_len = 56;
+    file.gap = gap;
+    file.tail_len = 8 + len;
+    check_located(&file, 56 + gap + 8, 2, &expected[2]);
+
+    // AIFF: big-endian sizes, an odd-sized NAME chunk before the sound data
+    gap = (uint64_t)1 << 30;
+    memcpy(head, "FORM\0\0\0\0AIFFNAME\0\0\0\x05title\0SSND", 30);
+    head[30] = (uint8_t)(gap >> 24);
+    head[31] = (uint8_t)(gap >> 16);
+    head[32] = (uint8_t)(gap >> 8);
+    head[33] = (uint8_t)gap;
+    memcpy(tail, "ID3 ", 4);
+    tail[4] = 0;
+    tail[5] = (uint8_t)(len >> 16);
+    tail[6] = (uint8_t)(len >> 8);
+    tail[7] = (uint8_t)len;
+    file.head_len = 34;
+    file.gap = gap;
+    check_located(&file, 34 + gap + 8, 2, &expected[2]);
+
+    // DSF: the metadata pointer in the DSD chunk leads to the tag at the end
+    memcpy(head, "DSD \x1C\0\0\0\0\0\0\0", 12);
+    put_le64(&head[12], 28 + gap + len);
+    put_le64(&head[20], 28 + gap);
+    memcpy(tail, tag, len);
+    file.head_len = 28;
+    file.tail_len = len;
+    check_located(&file, 28 + gap, 2, &expected[2]);
+
+    // A tag at the start, as in MP3
+    file.head = tag;
+    file.head_len = len;
+    file.gap = 0;
+    file.tail_len = 0;
+    check_located(&file, 0, 1, &expected[2]);
+
+    // DSF without metadata and WAV without an ID3 chunk
+    put_le64(&head[20], 0);
+    file.head = head;
+    file.head_len = 28;
+    CHECK(id3_locate_tag(virtual_read_at, &file, &location) == 0);
+    memcpy(head, "RIFF\0\0\0\0WAVEdata\x10\0\0\0", 20);
+    file.head_len = 20;
+    file.gap = 16;
+    CHECK(id3_locate_tag(virtual_read_at, &file, &location) == 0);
+}
+
+// The stdio path over a small WAV file
+static void test_parse_file(const Digest *expected) {
+    static const char path[] = "id3_container_test.wav";
+    uint8_t head[20];
+    size_t len = synth_tag(tag, sizeof(tag), &test_tags[0]);
+    Digest digest = { 0, 0 };
+    FILE *file = fopen(path, "wb");
+
+    CHECK(file != NULL);
+    if (!file) {
+        return;
+    }
+    memcpy(head, "RIFF\0\0\0\0WAVEdata\x03\0\0\0", 20);
+    fwrite(head, 1, 20, file);
+    fwrite("\1\2\3\0id3 ", 1, 8, file);
+    put_le32(head, (uint32_t)len);
+    fwrite(head, 1, 4, file);
+    fwrite(tag, 1, len, file);
+    fclose(file);
+
+    CHECK(id3_parse_file(path, digest_frame, &digest) == ID3_DONE);
+    CHECK(digest.count == expected[0].count && digest.hash == expected[0].hash);
+    remove(path);
+    CHECK(id3_parse_file(path, digest_frame, &digest) == ID3_ERROR);
+}
+
+// Members of the test archive: name, test tag (-1 for none), bytes of the
+// tag kept (0 for all), audio bytes after it
+typedef struct {
+    const char *name;
+    int tag;
+    size_t cut;
+    size_t audio;
+} TarMember;
+
+static const TarMember tar_members[] = {
+    { "delivery/01.mp3", 0, 0, 3000 },
+    { "delivery/cover.jpg", -1, 0, 2000 },
+    { "delivery/a-rather-long-directory-name-for-the-release/with-a-second-level-that-"
+      "pushes-the-path-past-one-hundred-bytes/02 - Track.mp3", 2, 0, 40000 },
+    { "delivery/03.mp3", 4, 0, 512 },
+    { "delivery/04.mp3", 3, 200, 0 },
+    { "delivery/tiny", -1, 0, 5 },
+    { "delivery/another-long-directory-name-for-a-release/that-only-fits-with-the-ustar-prefix/"
+      "05.mp3", 1, 0, 100 },
+};
+
+#define TAR_MEMBER_COUNT (sizeof(tar_members) / sizeof(tar_members[0]))
+
+// A directory, then the members: the long name once through a pax header
+// and once through the ustar prefix, then the end blocks and trailing junk
+static size_t build_tar(void) {
+    uint32_t state = 0x9E3779B9u;
+    size_t len = 0;
+    size_t m;
+
+    len += synth_tar_header(&archive[len], "delivery/", 0, '5');
+    for (m = 0; m < TAR_MEMBER_COUNT; m++) {
+        const TarMember *member = &tar_members[m];
+        size_t size = 0;
+        size_t i;
+
+        if (member->tag >= 0) {
+            size = synth_tag(tag, sizeof(tag), &test_tags[member->tag]);
+            size = member->cut ? member->cut : size;
+        }
+        for (i = 0; i < member->audio; i++) {
+            tag[size + i] = (uint8_t)synth_next(&state);
+        }
+        size += member->audio;
+        if (m == 2) {
+            len += synth_tar_pax(&archive[len], member->name, size);
+            len += synth_tar_header(&archive[len], "02 - Track.mp3", size, '0');
+        } else {
+            len += synth_tar_header(&archive[len], member->name, size, '0');
+        }
+        memcpy(&archive[len], tag, size);
+        len += size;
+        len += synth_tar_pad(&archive[len], size);
+    }
+    memset(&archive[len], 0, 1024);
+    len += 1024;
+    memset(&archive[len], 0x55, 100);
+    return len + 100;
+}
+
+static void check_members(const Collector *collector, const Digest *expected) {
+    size_t m;
+
+    CHECK(collector->count == TAR_MEMBER_COUNT);
+    for (m = 0; m < TAR_MEMBER_COUNT && m < collector->count; m++) {
+        const TarMember *member = &tar_members[m];
+        int result = member->tag < 0 ? ID3_ERROR : member->cut ? ID3_MORE : ID3_DONE;
+
+        CHECK(strcmp(collector->names[m], member->name) == 0);
+        CHECK(collector->results[m] == result);
+        if (result == ID3_DONE) {
+            CHECK(collector->tags[m].count == expected[member->tag].count &&
+                  collector->tags[m].hash == expected[member->tag].hash);
+        }
+    }
+}
+
+static void test_tar(const uint8_t *data, size_t len, const Digest *expected) {
+    static const size_t chunks[] = { 1, 100, 512, 4096, 1 << 20 };
+    size_t c;
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        ID3TarWalker walker;
+        Collector collector;
+        size_t chunk = chunks[c];
+        int result = ID3_MORE;
+        size_t off;
+
+        memset(&collector, 0, sizeof(collector));
+        id3_tar_init(&walker, collect_frame, collect_member, &collector);
+        for (off = 0; off < len; off += chunk) {
+            result = id3_tar_feed(&walker, data + off, len - off < chunk ? len - off : chunk);
+            CHECK(result != ID3_ERROR);
+        }
+        id3_tar_cleanup(&walker);
+        CHECK(result == ID3_DONE);
+        check_members(&collector, expected);
+    }
+}
+
+// Seeking past member bodies must report the same members
+static void test_tar_skip(const uint8_t *data, size_t len, const Digest *expected) {
+    ID3TarWalker walker;
+    Collector collector;
+    int result = ID3_MORE;
+    size_t fed = 0;
+    size_t off = 0;
+
+    memset(&collector, 0, sizeof(collector));
+    id3_tar_init(&walker, collect_frame, collect_member, &collector);
+    while (off < len && result == ID3_MORE) {
+        size_t n = len - off < 512 ? len - off : 512;
+
+        result = id3_tar_feed(&walker, data + off, n);
+        fed += n;
+        off += n + (size_t)id3_tar_skip(&walker);
+    }
+    id3_tar_cleanup(&walker);
+    CHECK(result == ID3_DONE);
+    CHECK(fed < len / 2);
+    check_members(&collector, expected);
+}
+
+// A damaged header stops the walk
+static void test_tar_broken(const uint8_t *data, size_t len) {
+    static uint8_t damaged[sizeof(archive)];
+    ID3TarWalker walker;
+
+    memcpy(damaged, data, len);
+    damaged[512 + 10] ^= 1; // Name of the first member
+    id3_tar_init(&walker, NULL, NULL, NULL);
+    CHECK(id3_tar_feed(&walker, damaged, len) == ID3_ERROR);
+    id3_tar_cleanup(&walker);
+}
+
+int main(void) {
+    Digest expected[TEST_TAG_COUNT];
+    size_t gap = 0;
+    size_t len = build_stream(expected, &gap);
+
+    test_ts_chunk_sizes(stream, len, expected);
+    test_ts_gap(stream, len, gap, expected);
+    test_ts_duplicate(stream, len, gap, expected);
+    test_ts_resync(stream, len, expected);
+
+    len = build_mp4();
+    test_emsg_chunk_sizes(mp4, len, expected);
+    test_emsg_skip(mp4, len, expected);
+    test_emsg_broken();
+    test_segment_head();
+    test_locators(expected);
+    test_parse_file(expected);
+
+    len = build_tar();
+    test_tar(archive, len, expected);
+    test_tar_skip(archive, len, expected);
+    test_tar_broken(archive, len);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Stream loop tests: socketpairs and pipes stand in for network peers. Tags
+// written a few hundred bytes at a time, interleaved across streams, must
+// arrive whole and in order on each stream; peers that hang up early and
+// frames over the memory budget must end their streams; and every stream
+// must end exactly once with its descriptor closed and its memory freed.
+
+#include "id3v2epoll.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sys/socket.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+// Order-sensitive digest of the frames seen
+struct Digest {
+    uint32_t count = 0;
+    uint64_t hash = 0;
+
+    void add(const char *id, const uint8_t *data, uint32_t size) {
+        uint64_t h = hash * 1099511628211u;
+
+        for (; *id; id++) {
+            h = (h ^ static_cast<uint8_t>(*id)) * 1099511628211u;
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            h = (h ^ data[i]) * 1099511628211u;
+        }
+        hash = h ^ size;
+        count++;
+    }
+
+    bool operator==(const Digest &other) const {
+        return count == other.count && hash == other.hash;
+    }
+};
+
+static void digest_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    static_cast<Digest *>(user_data)->add(id, data, size);
+}
+
+static size_t in_use() {
+    ID3MemoryStats stats;
+
+    id3_get_memory_stats(&stats);
+    return stats.in_use;
+}
+
+struct Sink {
+    std::vector<Digest> digests;
+    std::vector<int> ends;
+    std::vector<id3::Status> status;
+
+    explicit Sink(size_t streams) : digests(streams), ends(streams), status(streams, id3::Status::Error) {}
+
+    void frame(uint64_t stream, const char *id, const uint8_t *data, uint32_t size) {
+        digests[stream].add(id, data, size);
+    }
+    void end(uint64_t stream, id3::Status result) {
+        ends[stream]++;
+        status[stream] = result;
+    }
+};
+
+// A connected pair of descriptors: [0] for the loop, [1] for the peer
+static bool open_pair(size_t stream, int fds[2]) {
+    if (stream % 2) {
+        return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+    }
+    int pipe_fds[2];
+
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+    fds[0] = pipe_fds[0];
+    fds[1] = pipe_fds[1];
+    return true;
+}
+
+struct Peer {
+    int fd = -1;
+    std::vector<uint8_t> bytes;
+    size_t written = 0;
+    size_t chunk = 0;
+};
+
+static void test_streams() {
+    const size_t streams = 400;
+    id3::Status expected_status[streams];
+    Digest expected[streams];
+    std::vector<Peer> peers(streams);
+    Sink sink(streams);
+    id3::stream_loop<Sink> loop(sink, streams, 128);
+    uint8_t tag[16 * 1024];
+
+    CHECK(loop.valid());
+    for (size_t s = 0; s < streams; s++) {
+        SynthTagSpec spec = { static_cast<uint8_t>(2 + s % 3), static_cast<uint8_t>(s % 4 == 1),
+                              static_cast<uint16_t>(3 + s % 20), s % 9 == 0 ? 3000u : 0u,
+                              s % 5 == 0 ? 200u : 0u, static_cast<uint32_t>(s + 1) };
+        size_t len = synth_tag(tag, sizeof(tag), &spec);
+        int fds[2];
+
+        CHECK(id3_parse_buffer(tag, len, digest_frame, &expected[s]) == ID3_DONE);
+        expected_status[s] = id3::Status::Done;
+        peers[s].bytes.assign(tag, tag + len);
+        if (s % 10 == 7) {
+            // Audio after the tag is never handed to the parser's frames
+            peers[s].bytes.insert(peers[s].bytes.end(), 3000, 0xFF);
+        } else if (s % 10 == 9) {
+            // The peer hangs up part way through
+            ID3FrameRef refs[64];
+            int count = id3_index_frames(tag, len, refs, 64);
+
+            peers[s].bytes.resize(refs[count / 2].offset);
+            expected[s] = Digest();
+            CHECK(id3_parse_buffer(tag, refs[count / 2].offset, digest_frame, &expected[s]) == ID3_MORE);
+            expected_status[s] = id3::Status::More;
+        }
+        peers[s].chunk = 1 + (s * 37) % 700;
+        CHECK(open_pair(s, fds));
+        CHECK(loop.add(fds[0], s));
+        peers[s].fd = fds[1];
+    }
+    CHECK(loop.streams() == streams);
+
+    // Each round writes the next chunk of every stream, then lets the loop
+    // parse what arrived
+    for (bool writing = true; writing;) {
+        writing = false;
+        for (Peer &peer : peers) {
+            if (peer.fd < 0) {
+                continue;
+            }
+            size_t n = std::min(peer.chunk, peer.bytes.size() - peer.written);
+            ssize_t sent = write(peer.fd, &peer.bytes[peer.written], n);
+
+            if (sent > 0) {
+                peer.written += static_cast<size_t>(sent);
+            } else {
+                peer.written = peer.bytes.size(); // The loop has closed its end
+            }
+            if (peer.written == peer.bytes.size()) {
+                close(peer.fd);
+                peer.fd = -1;
+            } else {
+                writing = true;
+            }
+        }
+        CHECK(loop.run_once(0) >= 0);
+    }
+    for (int turns = 0; loop.streams() > 0 && turns < 1000; turns++) {
+        CHECK(loop.run_once(100) >= 0);
+    }
+
+    CHECK(loop.streams() == 0);
+    for (size_t s = 0; s < streams; s++) {
+        CHECK(sink.ends[s] == 1);
+        CHECK(sink.status[s] == expected_status[s]);
+        CHECK(sink.digests[s] == expected[s]);
+    }
+    CHECK(in_use() == 0);
+}
+
+// A frame over the budget under ID3_BUDGET_FAIL ends its stream with
+// Status::Error; one that stalls keeps it open until the loop goes
+static void test_budget_and_limits() {
+    SynthTagSpec spec = { 4, 0, 5, 3000, 0, 77 };
+    uint8_t tag[8 * 1024];
+    size_t len = synth_tag(tag, sizeof(tag), &spec);
+    Sink sink(3);
+    int fds[3][2];
+
+    {
+        id3::stream_loop<Sink> loop(sink, 2);
+
+        for (int s = 0; s < 3; s++) {
+            CHECK(open_pair(static_cast<size_t>(s), fds[s]));
+        }
+        CHECK(loop.add(fds[0][0], 0));
+        CHECK(loop.add(fds[1][0], 1));
+        CHECK(!loop.add(fds[2][0], 2)); // Full
+
+        id3_set_memory_budget(1000, ID3_BUDGET_FAIL);
+        CHECK(write(fds[0][1], tag, len) == static_cast<ssize_t>(len));
+        CHECK(write(fds[1][1], tag, 100) == 100);
+        for (int turns = 0; loop.streams() > 1 && turns < 100; turns++) {
+            CHECK(loop.run_once(100) >= 0);
+        }
+        id3_set_memory_budget(0, ID3_BUDGET_SKIP);
+
+        CHECK(sink.ends[0] == 1 && sink.status[0] == id3::Status::Error);
+        CHECK(sink.ends[1] == 0 && loop.streams() == 1);
+        CHECK(loop.add(fds[2][0], 2)); // Room again
+    }
+
+    // The loop closed the streams it still had, without ending them
+    CHECK(sink.ends[1] == 0 && sink.ends[2] == 0);
+    CHECK(write(fds[1][1], tag, 1) < 0);
+    for (int s = 0; s < 3; s++) {
+        close(fds[s][1]);
+    }
+    CHECK(in_use() == 0);
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    test_streams();
+    test_budget_and_limits();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
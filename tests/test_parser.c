@@ -0,0 +1,798 @@
+// Parser tests: every entry point must agree on the frames of the synthetic
+// tags, whatever the chunk size, and must survive corrupted input.
+
+#include "id3v2parser.h"
+#include "synth_tag.h"
+
+#ifdef ID3_FRAME_CACHE
+#include <pthread.h>
+#endif
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+// Order-sensitive digest of the frames seen
+typedef struct {
+    uint32_t count;
+    uint64_t hash;
+} Digest;
+
+static void digest_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    Digest *digest = (Digest *)user_data;
+    uint64_t hash = digest->hash * 1099511628211u;
+    uint32_t i;
+
+    for (; *id; id++) {
+        hash = (hash ^ (uint8_t)*id) * 1099511628211u;
+    }
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211u;
+    }
+    digest->hash = hash ^ size;
+    digest->count++;
+}
+
+static const SynthTagSpec test_tags[] = {
+    { 2, 0, 10, 0, 0, 11 },
+    { 2, 0, 3, 700, 64, 12 },
+    { 3, 0, 10, 0, 128, 13 },
+    { 3, 1, 20, 3000, 0, 14 },
+    { 4, 0, 15, 0, 0, 15 },
+    { 4, 1, 8, 5000, 300, 16 },
+    { 4, 0, 0, 0, 20, 17 },
+};
+
+static uint8_t tag[64 * 1024];
+
+static int feed_chunked(const uint8_t *data, size_t len, size_t chunk, Digest *digest) {
+    ID3Parser parser;
+    int result = ID3_MORE;
+    size_t off;
+
+    id3_parser_init(&parser, digest_frame, digest);
+    for (off = 0; off < len && result == ID3_MORE; off += chunk) {
+        result = id3_parser_feed(&parser, data + off, len - off < chunk ? len - off : chunk);
+    }
+    id3_parser_cleanup(&parser);
+    return result;
+}
+
+// Every chunk size from one byte to the whole tag, so each header and frame
+// boundary falls at every position within a chunk
+static void test_chunk_sizes(const uint8_t *data, size_t len, const Digest *expected) {
+    size_t chunk;
+
+    for (chunk = 1; chunk <= len; chunk++) {
+        Digest digest = { 0, 0 };
+
+        CHECK(feed_chunked(data, len, chunk, &digest) == ID3_DONE);
+        CHECK(digest.count == expected->count && digest.hash == expected->hash);
+    }
+}
+
+static void test_pull(const uint8_t *data, size_t len, const Digest *expected) {
+    ID3Parser parser;
+    ID3FrameView frame;
+    Digest digest = { 0, 0 };
+    size_t used;
+    int result;
+
+    id3_parser_init(&parser, NULL, NULL);
+    while ((result = id3_parser_next(&parser, data, len, &used, &frame)) == ID3_FRAME) {
+        digest_frame(frame.id, frame.data, frame.size, &digest);
+        data += used;
+        len -= used;
+    }
+    id3_parser_cleanup(&parser);
+    CHECK(result == ID3_DONE);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+}
+
+static void test_save_restore(const uint8_t *data, size_t len, const Digest *expected) {
+    Digest digest = { 0, 0 };
+    ID3Parser parser;
+    static uint8_t blob[8192];
+    int result = ID3_MORE;
+    size_t off;
+
+    // Move the state to a fresh parser after every 5 bytes
+    id3_parser_init(&parser, digest_frame, &digest);
+    for (off = 0; off < len && result == ID3_MORE; off += 5) {
+        size_t saved = id3_parser_save(&parser, blob, sizeof(blob));
+
+        CHECK(saved > 0 && saved <= sizeof(blob));
+        id3_parser_cleanup(&parser);
+        id3_parser_init(&parser, digest_frame, &digest);
+        CHECK(id3_parser_restore(&parser, blob, saved) == 0);
+        result = id3_parser_feed(&parser, data + off, len - off < 5 ? len - off : 5);
+    }
+    id3_parser_cleanup(&parser);
+    CHECK(result == ID3_DONE);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+}
+
+// Blobs whose position or size would index past the header buffer or
+// underflow the tag count must be rejected, leaving the parser usable
+static void test_restore_rejects(void) {
+    static const struct {
+        uint8_t state;
+        uint8_t version;
+        uint32_t pos;
+        uint32_t size;
+        uint32_t tag_remaining;
+        int ok;
+    } cases[] = {
+        { STATE_READ_FRAME_HEADER, 2, 5, 0, 100, 1 },
+        { STATE_READ_FRAME_HEADER, 2, 6, 0, 100, 0 },  // Past a v2.2 frame header
+        { STATE_READ_FRAME_HEADER, 2, 9, 0, 100, 0 },
+        { STATE_READ_FRAME_HEADER, 3, 9, 0, 100, 1 },
+        { STATE_READ_FRAME_HEADER, 4, 10, 0, 100, 0 },
+        { STATE_READ_FRAME_HEADER, 5, 0, 0, 100, 0 },  // Unknown version
+        { STATE_READ_HEADER, 0, 10, 0, 0, 0 },
+        { STATE_READ_EXT_HEADER, 4, 6, 10, 4, 1 },
+        { STATE_READ_EXT_HEADER, 4, 6, 10, 3, 0 },     // Rest of ext header exceeds the tag
+        { STATE_READ_EXT_HEADER, 3, 6, 0xFFFFFFFFu, 100, 0 },
+        { STATE_READ_EXT_HEADER, 3, 11, 10, 100, 0 },
+        { STATE_SKIP_FRAME_DATA, 3, 0, 200, 100, 0 },
+        { STATE_FRAME_READY, 3, 0, 0, 100, 0 },
+        { STATE_DONE + 1, 3, 0, 0, 100, 0 },
+    };
+    static const uint8_t data[4] = { 'T', 'I', 'T', '2' };
+    uint8_t blob[64];
+    ID3Parser parser;
+    size_t len;
+    size_t c;
+
+    id3_parser_init(&parser, NULL, NULL);
+    len = id3_parser_save(&parser, blob, sizeof(blob));
+    CHECK(len == 44);
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t used;
+        ID3FrameView frame;
+
+        blob[4] = cases[c].state;
+        blob[5] = cases[c].version;
+        synth_put_size(&blob[16], cases[c].pos, 0);
+        synth_put_size(&blob[20], cases[c].size, 0);
+        synth_put_size(&blob[24], cases[c].tag_remaining, 0);
+        CHECK((id3_parser_restore(&parser, blob, len) == 0) == cases[c].ok);
+        if (cases[c].ok) {
+            id3_parser_next(&parser, data, sizeof(data), &used, &frame);
+            id3_parser_reset(&parser);
+        }
+    }
+    id3_parser_cleanup(&parser);
+}
+
+static void test_index(const uint8_t *data, size_t len, const Digest *expected) {
+    ID3FrameRef frames[64];
+    Digest digest = { 0, 0 };
+    int count = id3_index_frames(data, len, frames, 64);
+    int i;
+
+    CHECK(count == (int)expected->count);
+    for (i = 0; i < count && i < 64; i++) {
+        digest_frame(frames[i].id, data + frames[i].offset, frames[i].size, &digest);
+    }
+    CHECK(count > 64 || digest.hash == expected->hash);
+}
+
+// Frames fed after junk, from a stream position past 4 GB, must report the
+// same offsets as the in-memory index
+static void test_offsets(const uint8_t *data, size_t len) {
+    static uint8_t stream[sizeof(tag) + 100];
+    const uint64_t base = 0x123456789ull;
+    const size_t junk = 77;
+    ID3FrameRef frames[64];
+    int count = id3_index_frames(data, len, frames, 64);
+    ID3Parser parser;
+    ID3FrameView frame;
+    const uint8_t *in = stream;
+    size_t left = junk + len;
+    size_t used;
+    int seen = 0;
+
+    memset(stream, 'I', junk);
+    memcpy(stream + junk, data, len);
+    id3_parser_init(&parser, NULL, NULL);
+    id3_parser_set_offset(&parser, base);
+    while (left > 0) {
+        int result = id3_parser_next(&parser, in, left < 13 ? left : 13, &used, &frame);
+
+        in += used;
+        left -= used;
+        if (result == ID3_FRAME && seen < 64) {
+            CHECK(frame.tag_offset == base + junk);
+            CHECK(frame.offset == base + junk + frames[seen].offset);
+            CHECK(id3_parser_frame_offset(&parser) == frame.offset);
+            seen++;
+        } else if (result != ID3_MORE && result != ID3_FRAME) {
+            break;
+        }
+    }
+    CHECK(id3_parser_tag_offset(&parser) == base + junk);
+    CHECK(seen == count);
+    id3_parser_cleanup(&parser);
+}
+
+static void test_probe(void) {
+    static const uint8_t good[10] = { 'I', 'D', '3', 4, 0, 0, 0, 0, 1, 0 };
+    uint8_t bad[10];
+    ID3TagHeader header;
+
+    CHECK(id3_probe_header(good, sizeof(good), &header));
+    CHECK(header.version == 4 && header.size == 128);
+    CHECK(!id3_probe_header(good, 9, &header));
+
+    memcpy(bad, good, sizeof(bad));
+    bad[3] = 5;
+    CHECK(!id3_probe_header(bad, sizeof(bad), &header));
+    memcpy(bad, good, sizeof(bad));
+    bad[8] = 0x80;
+    CHECK(!id3_probe_header(bad, sizeof(bad), &header));
+}
+
+// The batch probe must agree with id3_probe_header() on every buffer,
+// including short ones and a count that leaves a partial group of lanes
+static void test_probe_batch(void) {
+    static uint8_t blobs[1003][10];
+    static const uint8_t *data[1003];
+    static size_t len[1003];
+    static ID3TagHeader headers[1003];
+    static uint8_t valid[1003];
+    uint32_t state = 0xC0FFEE11u;
+    size_t expected = 0;
+    size_t n;
+
+    for (n = 0; n < 1003; n++) {
+        uint8_t *blob = blobs[n];
+        int flips = synth_next(&state) % 3;
+
+        memcpy(blob, "ID3", 3);
+        blob[3] = (uint8_t)(2 + synth_next(&state) % 3);
+        blob[4] = 0;
+        blob[5] = (uint8_t)(synth_next(&state) & 0xF0);
+        synth_put_size(&blob[6], synth_next(&state) % 0x10000000u, 1);
+        while (flips-- > 0) {
+            blob[synth_next(&state) % 10] ^= (uint8_t)(1u << (synth_next(&state) % 8));
+        }
+        data[n] = blob;
+        len[n] = (synth_next(&state) % 16 == 0) ? synth_next(&state) % 10 : 10;
+    }
+    CHECK(id3_probe_headers(data, len, 1003, headers, valid) > 0);
+    for (n = 0; n < 1003; n++) {
+        ID3TagHeader header;
+        int ok = id3_probe_header(data[n], len[n], &header);
+
+        CHECK(valid[n] == ok);
+        if (ok && valid[n]) {
+            CHECK(headers[n].version == header.version && headers[n].revision == header.revision &&
+                  headers[n].flags == header.flags && headers[n].size == header.size);
+        }
+        expected += (size_t)ok;
+    }
+    CHECK(id3_probe_headers(data, len, 1003, headers, valid) == expected);
+    CHECK(id3_probe_headers(data, len, 0, headers, valid) == 0);
+}
+
+// Flip bytes and truncate: results may be anything but the parser must not
+// read out of bounds or leak (run under sanitizers to catch either)
+static void test_corrupt(const uint8_t *data, size_t len) {
+    static uint8_t copy[sizeof(tag)];
+    uint32_t state = 0x9E3779B9u;
+    ID3MemoryStats stats;
+    int round;
+
+    for (round = 0; round < 200; round++) {
+        size_t cut = 1 + synth_next(&state) % len;
+        Digest digest = { 0, 0 };
+        int flips;
+
+        memcpy(copy, data, len);
+        for (flips = 0; flips < 4; flips++) {
+            copy[synth_next(&state) % (cut < 64 ? cut : 64)] ^= (uint8_t)synth_next(&state);
+        }
+        feed_chunked(copy, cut, 1 + synth_next(&state) % 97, &digest);
+        id3_parse_buffer(copy, cut, digest_frame, &digest);
+    }
+    id3_get_memory_stats(&stats);
+    CHECK(stats.in_use == 0);
+}
+
+// Seeded corruption and truncation behind an intact signature: the one-shot
+// parser and the streaming parser, fed in random chunks, must agree on the
+// frames and on the status. Size and flag bytes of the tag header are
+// corrupted too; when that invalidates the header, id3_parse_buffer() must
+// report an error.
+static void test_differential(const uint8_t *data, size_t len, uint32_t seed) {
+    static uint8_t copy[sizeof(tag)];
+    uint32_t state = seed;
+    int round;
+
+    for (round = 0; round < 500; round++) {
+        size_t cut = 10 + synth_next(&state) % (len - 9);
+        size_t chunk = 1 + synth_next(&state) % 257;
+        Digest whole = { 0, 0 };
+        Digest chunked = { 0, 0 };
+        ID3TagHeader header;
+        int flips = synth_next(&state) % 6;
+        int result;
+        int fed;
+
+        memcpy(copy, data, len);
+        while (flips-- > 0) {
+            size_t at = 5 + synth_next(&state) % (cut - 5);
+
+            copy[at] ^= (uint8_t)(1u << (synth_next(&state) % 8));
+        }
+        result = id3_parse_buffer(copy, cut, digest_frame, &whole);
+        if (!id3_probe_header(copy, cut, &header)) {
+            CHECK(result == ID3_ERROR && whole.count == 0);
+            continue;
+        }
+        fed = feed_chunked(copy, cut, chunk, &chunked);
+        CHECK(fed == result);
+        CHECK(chunked.count == whole.count && chunked.hash == whole.hash);
+    }
+}
+
+// A budget too small for the cover picture: skipping drops just that frame,
+// failing lets id3_parser_next() resume after the header, also from a saved
+// state, and id3_parser_feed() start over after a reset
+static void test_budget(const uint8_t *data, size_t len, const Digest *expected) {
+    ID3MemoryStats before;
+    ID3MemoryStats after;
+    ID3Parser parser;
+    ID3FrameView frame;
+    Digest digest = { 0, 0 };
+    const uint8_t *in = data;
+    size_t left = len;
+    size_t used;
+    int result;
+    int errors = 0;
+    size_t pending = 0;
+
+    id3_get_memory_stats(&before);
+    id3_set_memory_budget(1000, ID3_BUDGET_SKIP);
+    CHECK(feed_chunked(data, len, 64, &digest) == ID3_DONE);
+    CHECK(digest.count == expected->count - 1);
+    id3_get_memory_stats(&after);
+    CHECK(after.skipped == before.skipped + 1 && after.in_use == 0);
+
+    digest.count = 0;
+    digest.hash = 0;
+    id3_set_memory_budget(1000, ID3_BUDGET_FAIL);
+    id3_parser_init(&parser, NULL, NULL);
+    while ((result = id3_parser_next(&parser, in, left, &used, &frame)) != ID3_DONE && left > 0) {
+        if (result == ID3_FRAME) {
+            // A need()-driven reader is asked for the failed frame's data
+            CHECK(pending == 0 || frame.size == pending);
+            pending = 0;
+            digest_frame(frame.id, frame.data, frame.size, &digest);
+        } else if (result == ID3_ERROR) {
+            // The state left for the retry survives a save and restore
+            uint8_t blob[64];
+            size_t saved = id3_parser_save(&parser, blob, sizeof(blob));
+
+            errors++;
+            CHECK(saved == 44);
+            id3_parser_cleanup(&parser);
+            id3_parser_init(&parser, NULL, NULL);
+            CHECK(id3_parser_restore(&parser, blob, saved) == 0);
+            pending = id3_parser_need(&parser);
+            CHECK(pending > 1000 && pending <= left - used);
+            id3_set_memory_budget(0, ID3_BUDGET_FAIL); // Memory released elsewhere
+        }
+        in += used;
+        left -= used;
+    }
+    id3_parser_cleanup(&parser);
+    CHECK(result == ID3_DONE && errors == 1);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+
+    digest.count = 0;
+    digest.hash = 0;
+    id3_set_memory_budget(1000, ID3_BUDGET_FAIL);
+    id3_parser_init(&parser, digest_frame, &digest);
+    CHECK(id3_parser_feed(&parser, data, len) == ID3_ERROR);
+    id3_set_memory_budget(0, ID3_BUDGET_SKIP);
+    id3_parser_reset(&parser);
+    digest.count = 0;
+    digest.hash = 0;
+    CHECK(id3_parser_feed(&parser, data, len) == ID3_DONE);
+    id3_parser_cleanup(&parser);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+
+    id3_get_memory_stats(&after);
+    CHECK(after.failed == before.failed + 2 && after.in_use == 0);
+}
+
+// Frames taken from the parser outlive it, keep their contents and count
+// against the budget until released with id3_free_frame()
+static void test_take_frame(const uint8_t *data, size_t len, const Digest *expected) {
+    uint8_t *kept[4];
+    uint32_t sizes[4];
+    Digest digest = { 0, 0 };
+    Digest taken = { 0, 0 };
+    Digest again = { 0, 0 };
+    ID3MemoryStats stats;
+    ID3Parser parser;
+    ID3FrameView frame;
+    size_t count = 0;
+    size_t held = 0;
+    size_t used;
+    size_t i;
+
+    id3_parser_init(&parser, NULL, NULL);
+    CHECK(id3_parser_take_frame(&parser) == NULL);
+    while (id3_parser_next(&parser, data, len, &used, &frame) == ID3_FRAME) {
+        digest_frame(frame.id, frame.data, frame.size, &digest);
+        if (count < 4 && frame.size > 0) {
+            kept[count] = id3_parser_take_frame(&parser);
+            CHECK(kept[count] == frame.data);
+            CHECK(id3_parser_take_frame(&parser) == NULL);
+            digest_frame("", kept[count], frame.size, &taken);
+            sizes[count] = frame.size;
+            held += frame.size;
+            count++;
+        }
+        data += used;
+        len -= used;
+    }
+    id3_parser_cleanup(&parser);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+    CHECK(count == 4);
+
+    id3_get_memory_stats(&stats);
+    CHECK(stats.in_use == held);
+    for (i = 0; i < count; i++) {
+        digest_frame("", kept[i], sizes[i], &again);
+        id3_free_frame(kept[i], sizes[i]);
+    }
+    id3_free_frame(NULL, 0);
+    CHECK(again.count == taken.count && again.hash == taken.hash);
+    id3_get_memory_stats(&stats);
+    CHECK(stats.in_use == 0);
+}
+
+#ifdef ID3_FRAME_CACHE
+// Freed buffers are reused within their size class, at most
+// ID3_FRAME_CACHE_DEPTH of them per class, most recently freed first
+static void test_frame_cache(void) {
+    static uint8_t *buffers[ID3_FRAME_CACHE_DEPTH + 1];
+    ID3MemoryStats stats;
+    uint8_t *first;
+    uint8_t *reused;
+    size_t i;
+
+    id3_frame_cache_flush();
+    first = id3_alloc_frame(100);
+    CHECK(first != NULL);
+    id3_free_frame(first, 100);
+    reused = id3_alloc_frame(120);
+    CHECK(reused == first);
+    memset(reused, 0, 120);
+    id3_free_frame(reused, 120);
+
+    // One more than the depth: the last buffer freed is not kept
+    for (i = 0; i <= ID3_FRAME_CACHE_DEPTH; i++) {
+        buffers[i] = id3_alloc_frame(20);
+    }
+    for (i = 0; i <= ID3_FRAME_CACHE_DEPTH; i++) {
+        id3_free_frame(buffers[i], 20);
+    }
+    reused = id3_alloc_frame(20);
+    CHECK(reused == buffers[ID3_FRAME_CACHE_DEPTH - 1]);
+    id3_free_frame(reused, 20);
+
+    id3_frame_cache_flush();
+    id3_get_memory_stats(&stats);
+    CHECK(stats.in_use == 0);
+}
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    int flush;
+} CacheJob;
+
+// Free job->data, or allocate it when job->data is NULL, then flush if asked.
+// A size of 0 releases job->data as a parser.
+static void *cache_job(void *arg) {
+    CacheJob *job = (CacheJob *)arg;
+
+    if (job->size == 0) {
+        id3_parser_release((ID3Parser *)job->data);
+    } else if (job->data) {
+        id3_free_frame(job->data, job->size);
+    } else {
+        job->data = id3_alloc_frame(job->size);
+    }
+    if (job->flush) {
+        id3_frame_cache_flush();
+    }
+    return NULL;
+}
+
+static void run_cache_job(uint8_t *data, uint32_t size, int flush, uint8_t **allocated) {
+    CacheJob job;
+    pthread_t thread;
+
+    job.data = data;
+    job.size = size;
+    job.flush = flush;
+    CHECK(pthread_create(&thread, NULL, cache_job, &job) == 0);
+    pthread_join(thread, NULL);
+    if (allocated) {
+        *allocated = job.data;
+    }
+}
+
+// A buffer or parser freed on another thread goes back to the thread that
+// allocated it; a buffer allocated by a thread that has since flushed is freed outright
+static void test_frame_cache_threads(void) {
+    ID3Parser *parser;
+    uint8_t *first;
+    uint8_t *second;
+    uint8_t *reused;
+    ID3MemoryStats stats;
+
+    id3_frame_cache_flush();
+    parser = id3_parser_acquire(NULL, NULL);
+    CHECK(parser != NULL);
+    run_cache_job((uint8_t *)parser, 0, 0, NULL);
+    CHECK(id3_parser_acquire(NULL, NULL) == parser);
+    id3_parser_release(parser);
+
+    first = id3_alloc_frame(100);
+    CHECK(first != NULL);
+    run_cache_job(first, 100, 1, NULL);
+    reused = id3_alloc_frame(100);
+    CHECK(reused == first);
+    id3_free_frame(reused, 100);
+
+    // Out on two threads when their owner flushes and exits
+    run_cache_job(NULL, 200, 1, &first);
+    run_cache_job(NULL, 200, 1, &second);
+    CHECK(first != NULL && second != NULL);
+    memset(first, 1, 200);
+    id3_free_frame(first, 200);
+    run_cache_job(second, 200, 1, NULL);
+    reused = id3_alloc_frame(200);
+    CHECK(reused != NULL);
+    id3_free_frame(reused, 200);
+
+    id3_frame_cache_flush();
+    id3_get_memory_stats(&stats);
+    CHECK(stats.in_use == 0);
+}
+#endif
+
+// Parsers from id3_parser_acquire() start clean, and with the cache the one
+// released last is handed out again, even if released on another thread
+static void test_parser_pool(const uint8_t *tag, size_t len, const Digest *expected) {
+    ID3Parser *parser = id3_parser_acquire(digest_frame, NULL);
+    ID3Parser *again;
+    Digest digest = { 0, 0 };
+    size_t i;
+
+    CHECK(parser != NULL);
+    parser->user_data = &digest;
+    for (i = 0; i < len; i += 100) {
+        id3_parser_feed(parser, tag + i, len - i < 100 ? len - i : 100);
+    }
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+
+    // Released part way through a frame
+    id3_parser_reset(parser);
+    CHECK(id3_parser_feed(parser, tag, len / 2) == ID3_MORE);
+    id3_parser_release(parser);
+
+    digest.count = 0;
+    digest.hash = 0;
+    again = id3_parser_acquire(digest_frame, &digest);
+    CHECK(again != NULL);
+#ifdef ID3_FRAME_CACHE
+    CHECK(again == parser);
+#endif
+    CHECK(id3_parse_buffer(tag, len, digest_frame, &digest) == ID3_DONE);
+    digest.count = 0;
+    digest.hash = 0;
+    CHECK(id3_parser_feed(again, tag, len) == ID3_DONE);
+    CHECK(digest.count == expected->count && digest.hash == expected->hash);
+    id3_parser_release(again);
+}
+
+#define TEST_TAG_COUNT (sizeof(test_tags) / sizeof(test_tags[0]))
+
+// Tags between junk, one holding a valid-looking header in its frame data,
+// must be found at the same offsets however the stream is split into ranges
+static void test_scan(void) {
+    static uint8_t stream[4 * sizeof(tag)];
+    static const uint8_t fake[] = { 'I', 'D', '3', 3, 0, 0, 0, 0, 0, 20,
+                                    'T', 'I', 'T', '2', 0, 0, 0, 1, 0, 0 };
+    ID3TagLocation whole[16];
+    ID3TagLocation split[64];
+    uint64_t offsets[3];
+    size_t len = 0;
+    size_t found;
+    size_t range;
+    size_t t;
+
+    for (t = 0; t < 3; t++) {
+        size_t n;
+
+        memset(stream + len, 'I', 50 + t); // Junk full of partial matches
+        len += 50 + t;
+        stream[len++] = 'D';
+        stream[len++] = '3'; // Signature without a valid header
+        offsets[t] = len;
+        n = synth_tag(stream + len, sizeof(stream) - len, &test_tags[3 + t]);
+        if (t == 0) {
+            memcpy(stream + len + 60, fake, sizeof(fake)); // Inside frame data
+        }
+        len += n;
+    }
+
+    found = id3_scan_tags(stream, len, len, 1000, whole, 16);
+    CHECK(found == 4);
+    found = id3_resolve_tags(whole, found);
+    CHECK(found == 3);
+    for (t = 0; t < 3 && t < found; t++) {
+        CHECK(whole[t].offset == 1000 + offsets[t]);
+        CHECK(whole[t].header.version == test_tags[3 + t].version);
+    }
+
+    for (range = 1; range < 200; range += 7) {
+        size_t start;
+        size_t total = 0;
+
+        for (start = 0; start < len; start += range) {
+            size_t scan = len - start < range ? len - start : range;
+            size_t avail = len - start < scan + ID3_SCAN_OVERLAP ? len - start : scan + ID3_SCAN_OVERLAP;
+
+            total += id3_scan_tags(stream + start, avail, scan, 1000 + start, split + total, 64 - total);
+        }
+        CHECK(total == 4);
+        CHECK(id3_resolve_tags(split, total) == found);
+        for (t = 0; t < found; t++) {
+            CHECK(split[t].offset == whole[t].offset && split[t].header.size == whole[t].header.size);
+        }
+    }
+}
+
+// Check a batch arena against the digests of the same inputs, the last of
+// which holds no tag
+static void check_batch(const uint8_t *arena, size_t count, const Digest *expected) {
+    ID3BatchHeader header;
+    const ID3BatchEntry *entries;
+    const ID3BatchFrame *frames;
+    size_t i;
+    uint32_t f;
+
+    memcpy(&header, arena, sizeof(header));
+    CHECK(memcmp(header.magic, "I3B", 3) == 0 && header.magic[3] == ID3_BATCH_FORMAT);
+    CHECK(header.count == count);
+    entries = (const ID3BatchEntry *)(arena + header.entries);
+    frames = (const ID3BatchFrame *)(arena + header.frames);
+    for (i = 0; i < count; i++) {
+        Digest digest = { 0, 0 };
+
+        if (i == count - 1) {
+            CHECK(entries[i].status == ID3_ERROR && entries[i].frame_count == 0);
+            continue;
+        }
+        CHECK(entries[i].status == ID3_DONE && entries[i].version == test_tags[i].version);
+        for (f = entries[i].first_frame; f < entries[i].first_frame + entries[i].frame_count; f++) {
+            CHECK(frames[f].input == i && frames[f].stored == frames[f].size);
+            digest_frame(frames[f].id, arena + header.pool + frames[f].data, frames[f].stored, &digest);
+        }
+        CHECK(digest.count == expected[i].count && digest.hash == expected[i].hash);
+    }
+}
+
+static void test_batch(const Digest *expected) {
+    static uint8_t tags[TEST_TAG_COUNT][sizeof(tag)];
+    static const uint8_t junk[] = "not a tag";
+    const uint8_t *data[TEST_TAG_COUNT + 1];
+    const char *paths[TEST_TAG_COUNT + 1];
+    char names[TEST_TAG_COUNT][32];
+    size_t len[TEST_TAG_COUNT + 1];
+    size_t need;
+    size_t i;
+    uint8_t *arena;
+
+    for (i = 0; i < TEST_TAG_COUNT; i++) {
+        FILE *file;
+
+        len[i] = synth_tag(tags[i], sizeof(tags[i]), &test_tags[i]);
+        data[i] = tags[i];
+        sprintf(names[i], "id3_test_batch_%u.tmp", (unsigned)i);
+        paths[i] = names[i];
+        file = fopen(names[i], "wb");
+        CHECK(file && fwrite(tags[i], 1, len[i], file) == len[i]);
+        if (file) {
+            fclose(file);
+        }
+    }
+    data[i] = junk;
+    len[i] = sizeof(junk);
+    paths[i] = "id3_test_batch_missing.tmp";
+
+    // Too small an arena is left alone; the returned size is enough
+    need = id3_parse_batch(data, len, TEST_TAG_COUNT + 1, UINT32_MAX, NULL, 0);
+    arena = (uint8_t *)malloc(need);
+    CHECK(arena != NULL);
+    if (!arena) {
+        return;
+    }
+    CHECK(id3_parse_batch(data, len, TEST_TAG_COUNT + 1, UINT32_MAX, arena, need - 1) == need);
+    CHECK(id3_parse_batch(data, len, TEST_TAG_COUNT + 1, UINT32_MAX, arena, need) == need);
+    check_batch(arena, TEST_TAG_COUNT + 1, expected);
+
+    memset(arena, 0, need);
+    CHECK(id3_parse_batch_files(paths, TEST_TAG_COUNT + 1, UINT32_MAX, arena, need) == need);
+    check_batch(arena, TEST_TAG_COUNT + 1, expected);
+
+    // Records only
+    CHECK(id3_parse_batch(data, len, TEST_TAG_COUNT + 1, 0, arena, need) < need);
+    free(arena);
+
+    for (i = 0; i < TEST_TAG_COUNT; i++) {
+        remove(names[i]);
+    }
+}
+
+int main(void) {
+    Digest digests[TEST_TAG_COUNT];
+    size_t t;
+
+    test_probe();
+    test_probe_batch();
+    test_restore_rejects();
+#ifdef ID3_FRAME_CACHE
+    test_frame_cache();
+    test_frame_cache_threads();
+#endif
+    test_scan();
+    for (t = 0; t < TEST_TAG_COUNT; t++) {
+        size_t len = synth_tag(tag, sizeof(tag), &test_tags[t]);
+        uint32_t frames = test_tags[t].text_frames + 1 +
+                          (test_tags[t].version > 2) + (test_tags[t].picture_size > 0);
+        Digest expected = { 0, 0 };
+
+        CHECK(len > 0);
+        CHECK(id3_parse_buffer(tag, len, digest_frame, &expected) == ID3_DONE);
+        CHECK(expected.count == frames);
+
+        test_chunk_sizes(tag, len, &expected);
+        test_pull(tag, len, &expected);
+        if (expected.count >= 4) {
+            test_take_frame(tag, len, &expected);
+        }
+        test_save_restore(tag, len, &expected);
+        test_parser_pool(tag, len, &expected);
+        test_index(tag, len, &expected);
+        test_offsets(tag, len);
+        test_corrupt(tag, len);
+        test_differential(tag, len, 0x5EED0000u + (uint32_t)t);
+        if (test_tags[t].picture_size > 1000) {
+            test_budget(tag, len, &expected);
+        }
+        digests[t] = expected;
+    }
+    test_batch(digests);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
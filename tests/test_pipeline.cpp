@@ -0,0 +1,222 @@
+// Pipeline tests: a read -> parse -> decode -> sink scan must see every frame
+// of every file once and free them all, a slow sink must hold back the
+// stages before it, the stage counters must add up, and frames of one tag
+// decoded in parallel must come out in tag order.
+
+#include "id3v2pipeline.hpp"
+#include "synth_tag.h"
+
+#include <cstdio>
+#include <vector>
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+struct Totals {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t text = 0;
+};
+
+static void add_frame(const char *id, const uint8_t *, uint32_t size, void *user_data) {
+    Totals *totals = static_cast<Totals *>(user_data);
+
+    totals->frames++;
+    totals->bytes += size;
+    if (id[0] == 'T' && size > 0) {
+        totals->text += size - 1;
+    }
+}
+
+static size_t in_use() {
+    ID3MemoryStats stats;
+
+    id3_get_memory_stats(&stats);
+    return stats.in_use;
+}
+
+struct File {
+    size_t index = 0;
+    std::vector<uint8_t> bytes;
+};
+
+// Text of a text frame, without its encoding byte
+struct Text {
+    uint64_t source = 0;
+    std::string value;
+};
+
+static void test_scan(const std::vector<std::vector<uint8_t>> &files, const Totals &expected) {
+    id3::channel<size_t> paths(8);
+    id3::channel<File> read(4);
+    id3::channel<id3::frame_desc> frames(64);
+    id3::channel<Text> texts(64);
+    std::atomic<uint64_t> decoded{ 0 };
+    std::atomic<uint64_t> decoded_bytes{ 0 };
+    uint64_t text = 0;
+    id3::pipeline pipeline;
+
+    pipeline.add_stage("read", 1, paths, read, [&](size_t &index, id3::output<File> &out) {
+        File file;
+
+        file.index = index;
+        file.bytes = files[index];
+        out.push(std::move(file));
+    });
+    pipeline.add_stage("parse", 3, read, frames, [](File &file, id3::output<id3::frame_desc> &out) {
+        id3::Parser parser;
+        id3::FrameView frame;
+        const uint8_t *data = file.bytes.data();
+        size_t len = file.bytes.size();
+        size_t used;
+
+        while (parser.next(data, len, used, frame) == id3::Status::Frame) {
+            out.push(id3::frame_desc(frame, parser.take_frame(), file.index));
+            data += used;
+            len -= used;
+        }
+    });
+    pipeline.add_stage("decode", 2, frames, texts, [&](id3::frame_desc &desc, id3::output<Text> &out) {
+        uint32_t size = desc.payload.size();
+
+        decoded++;
+        decoded_bytes += size;
+        if ((desc.id >> 24) == 'T' && size > 0) {
+            Text text;
+
+            text.source = desc.source;
+            text.value.assign(reinterpret_cast<const char *>(desc.payload.data()) + 1, size - 1);
+            out.push(std::move(text));
+        }
+        desc.payload = id3::FrameBuffer();
+    });
+    pipeline.add_sink("sink", 1, texts, [&text](Text &value) { text += value.value.size(); });
+    pipeline.start();
+    for (size_t i = 0; i < files.size(); i++) {
+        CHECK(paths.push(std::move(i)));
+    }
+    paths.close();
+    pipeline.wait();
+
+    CHECK(decoded == expected.frames);
+    CHECK(decoded_bytes == expected.bytes);
+    CHECK(text == expected.text);
+    CHECK(in_use() == 0);
+
+    std::vector<id3::stage_stats> stats = pipeline.stats();
+
+    CHECK(stats.size() == 4);
+    CHECK(stats[0].name == "read" && stats[0].threads == 1 && stats[0].items == files.size());
+    CHECK(stats[1].name == "parse" && stats[1].threads == 3 && stats[1].items == files.size());
+    CHECK(stats[2].items == expected.frames);
+    for (const id3::stage_stats &stage : stats) {
+        CHECK(stage.busy >= 0 && stage.blocked >= 0 && stage.busy + stage.blocked <= 1.0001);
+        CHECK(stage.max_depth <= stage.capacity && stage.depth <= stage.max_depth);
+    }
+}
+
+// With a sink much slower than the rest, the stage feeding it spends its
+// time waiting on the full channel, and the channels stay bounded
+static void test_backpressure() {
+    id3::channel<uint32_t> input(4);
+    id3::channel<uint32_t> middle(4);
+    uint64_t sum = 0;
+    id3::pipeline pipeline;
+
+    pipeline.add_stage("pass", 1, input, middle, [](uint32_t &value, id3::output<uint32_t> &out) {
+        out.push(std::move(value));
+    });
+    pipeline.add_sink("slow", 1, middle, [&sum](uint32_t &value) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+
+        while (std::chrono::steady_clock::now() < until) {
+        }
+        sum += value;
+    });
+    pipeline.start();
+    for (uint32_t i = 0; i < 2000; i++) {
+        CHECK(input.push(std::move(i)));
+        CHECK(input.size() <= input.capacity() && middle.size() <= middle.capacity());
+    }
+    input.close();
+    pipeline.wait();
+
+    std::vector<id3::stage_stats> stats = pipeline.stats();
+
+    CHECK(sum == 2000u * 1999u / 2);
+    CHECK(stats[0].items == 2000 && stats[1].items == 2000);
+    CHECK(stats[1].busy > 0.5);
+    CHECK(stats[0].blocked > 0.2);
+    CHECK(stats[0].busy < stats[1].busy);
+}
+
+// Frames take from 0 to 6 us to decode, so the decoders finish them out of
+// order
+static void test_decode_frames() {
+    static uint8_t tag[256 * 1024];
+    SynthTagSpec spec = { 4, 1, 600, 20000, 100, 99 };
+    size_t len = synth_tag(tag, sizeof(tag), &spec);
+    int count = id3_index_frames(tag, len, nullptr, 0);
+    std::vector<ID3FrameRef> refs(static_cast<size_t>(count));
+    std::vector<uint64_t> seen;
+
+    CHECK(count == 600 + 2 + 1);
+    id3_index_frames(tag, len, refs.data(), refs.size());
+    int decoded = id3::decode_frames(tag, len, 3, [](const id3::FrameView &frame) {
+        uint64_t hash = 14695981039346656037u;
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(frame.offset % 7);
+
+        for (uint32_t i = 0; i < frame.size; i++) {
+            hash = (hash ^ frame.data[i]) * 1099511628211u;
+        }
+        while (std::chrono::steady_clock::now() < until) {
+        }
+        return (hash ^ frame.offset) | (static_cast<uint64_t>(frame.id[0]) << 56);
+    }, [&seen](uint64_t &hash) { seen.push_back(hash); });
+
+    CHECK(decoded == count);
+    CHECK(seen.size() == refs.size());
+    for (size_t i = 0; i < refs.size() && i < seen.size(); i++) {
+        uint64_t hash = 14695981039346656037u;
+
+        for (uint32_t b = 0; b < refs[i].size; b++) {
+            hash = (hash ^ tag[refs[i].offset + b]) * 1099511628211u;
+        }
+        CHECK(seen[i] == ((hash ^ refs[i].offset) | (static_cast<uint64_t>(refs[i].id[0]) << 56)));
+    }
+    CHECK(id3::decode_frames(tag + 1, len - 1, 2, [](const id3::FrameView &) { return 0; },
+                             [](int &) {}) == -1);
+}
+
+int main() {
+    std::vector<std::vector<uint8_t>> files;
+    Totals expected;
+    static uint8_t tag[16 * 1024];
+
+    for (uint32_t i = 0; i < 300; i++) {
+        SynthTagSpec spec = { static_cast<uint8_t>(2 + i % 3), 0, static_cast<uint16_t>(5 + i % 30),
+                              i % 7 == 0 ? 4000u : 0u, i % 5 == 0 ? 256u : 0u, i + 1 };
+        size_t len = synth_tag(tag, sizeof(tag), &spec);
+
+        CHECK(id3_parse_buffer(tag, len, add_frame, &expected) == ID3_DONE);
+        files.emplace_back(tag, tag + len);
+    }
+
+    test_scan(files, expected);
+    test_backpressure();
+    test_decode_frames();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Frame queue tests: both rings must keep FIFO order per producer, lose and
+// duplicate nothing under contention with either wait strategy, and free
+// the frames they still hold.
+
+#include "id3v2queue.hpp"
+#include "synth_tag.h"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+// Order-sensitive digest of the frames seen
+struct Digest {
+    uint32_t count = 0;
+    uint64_t hash = 0;
+
+    void add(const char *id, const uint8_t *data, uint32_t size) {
+        uint64_t h = hash * 1099511628211u;
+
+        for (; *id; id++) {
+            h = (h ^ static_cast<uint8_t>(*id)) * 1099511628211u;
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            h = (h ^ data[i]) * 1099511628211u;
+        }
+        hash = h ^ size;
+        count++;
+    }
+
+    bool operator==(const Digest &other) const {
+        return count == other.count && hash == other.hash;
+    }
+};
+
+static void digest_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    static_cast<Digest *>(user_data)->add(id, data, size);
+}
+
+static size_t in_use() {
+    ID3MemoryStats stats;
+
+    id3_get_memory_stats(&stats);
+    return stats.in_use;
+}
+
+// Capacity, full and empty rings, FIFO order, close(), and frames left in
+// the ring when it is destroyed
+template <typename Queue>
+static void test_single_thread() {
+    {
+        Queue queue(5);
+        id3::frame_desc desc;
+
+        CHECK(queue.capacity() == 8);
+        CHECK(!queue.try_pop(desc));
+        for (uint64_t i = 0; i < 8; i++) {
+            id3::frame_desc in;
+
+            in.id = ID3_FOURCC('T', 'I', 'T', '2');
+            in.payload = id3::FrameBuffer(id3_alloc_frame(100), 100);
+            in.source = i;
+            CHECK(queue.try_push(std::move(in)));
+            CHECK(in.payload.data() == nullptr);
+        }
+        CHECK(queue.size() == 8);
+
+        id3::frame_desc extra;
+
+        extra.payload = id3::FrameBuffer(id3_alloc_frame(10), 10);
+        extra.source = 99;
+        CHECK(!queue.try_push(std::move(extra)));
+        CHECK(extra.source == 99 && extra.payload.size() == 10);
+        for (uint64_t i = 0; i < 3; i++) {
+            CHECK(queue.pop(desc) && desc.source == i && desc.payload.size() == 100);
+        }
+        CHECK(queue.push(std::move(extra)));
+        CHECK(queue.size() == 6);
+        queue.close();
+        CHECK(!queue.push(id3::frame_desc()));
+        CHECK(queue.pop(desc) && desc.source == 3);
+    }
+    CHECK(in_use() == 0);
+
+    {
+        Queue queue(4);
+        id3::frame_desc desc;
+
+        queue.close();
+        CHECK(!queue.pop(desc));
+    }
+}
+
+// Frames taken from a parser and handed to a consumer thread through a small
+// ring arrive whole and in order, and are all freed
+template <typename Queue>
+static void test_frames(const uint8_t *tag, size_t len, const Digest &expected) {
+    Queue queue(4);
+    Digest digest;
+    std::thread consumer([&] {
+        id3::frame_desc desc;
+
+        while (queue.pop(desc)) {
+            char id[5] = { static_cast<char>(desc.id >> 24), static_cast<char>(desc.id >> 16),
+                           static_cast<char>(desc.id >> 8), static_cast<char>(desc.id), 0 };
+
+            digest.add(id, desc.payload.data(), desc.payload.size());
+            desc.payload = id3::FrameBuffer();
+        }
+    });
+    id3::Parser parser;
+    id3::FrameView frame;
+    size_t used;
+
+    while (parser.next(tag, len, used, frame) == id3::Status::Frame) {
+        CHECK(queue.push(id3::frame_desc(frame, parser.take_frame(), 7)));
+        tag += used;
+        len -= used;
+    }
+    queue.close();
+    consumer.join();
+    CHECK(digest == expected);
+    CHECK(in_use() == 0);
+}
+
+// Producers push count descriptors each, numbered in id; every consumer must
+// see each producer's numbers increasing, and all of them together every
+// number once
+template <typename Queue>
+static void test_threads(size_t producers, size_t consumers, uint32_t count) {
+    Queue queue(16);
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> sums(consumers);
+    std::vector<size_t> received(consumers);
+    int order_errors = 0;
+    std::mutex errors_mutex;
+
+    for (size_t c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c] {
+            std::vector<int64_t> last(producers, -1);
+            id3::frame_desc desc;
+            int errors = 0;
+
+            while (queue.pop(desc)) {
+                if (desc.source >= producers || static_cast<int64_t>(desc.id) <= last[desc.source]) {
+                    errors++;
+                } else {
+                    last[desc.source] = desc.id;
+                }
+                sums[c] += desc.id;
+                received[c]++;
+            }
+            std::lock_guard<std::mutex> lock(errors_mutex);
+            order_errors += errors;
+        });
+    }
+
+    std::vector<std::thread> writers;
+
+    for (size_t p = 0; p < producers; p++) {
+        writers.emplace_back([&, p] {
+            for (uint32_t i = 0; i < count; i++) {
+                id3::frame_desc desc;
+
+                desc.id = i;
+                desc.source = p;
+                queue.push(std::move(desc));
+            }
+        });
+    }
+    for (std::thread &writer : writers) {
+        writer.join();
+    }
+    queue.close();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    uint64_t sum = 0;
+    size_t total = 0;
+
+    for (size_t c = 0; c < consumers; c++) {
+        sum += sums[c];
+        total += received[c];
+    }
+    CHECK(order_errors == 0);
+    CHECK(total == producers * count);
+    CHECK(sum == producers * (static_cast<uint64_t>(count) * (count - 1) / 2));
+}
+
+int main() {
+    typedef id3::spsc_queue<id3::frame_desc, id3::spin_wait> spsc_spin;
+    typedef id3::spsc_queue<id3::frame_desc, id3::blocking_wait> spsc_blocking;
+    typedef id3::mpmc_queue<id3::frame_desc, id3::spin_wait> mpmc_spin;
+    typedef id3::mpmc_queue<id3::frame_desc, id3::blocking_wait> mpmc_blocking;
+    static const SynthTagSpec spec = { 3, 0, 40, 3000, 0, 31 };
+    static uint8_t tag[16 * 1024];
+    size_t len = synth_tag(tag, sizeof(tag), &spec);
+    Digest expected;
+
+    CHECK(id3_parse_buffer(tag, len, digest_frame, &expected) == ID3_DONE);
+
+    test_single_thread<spsc_spin>();
+    test_single_thread<spsc_blocking>();
+    test_single_thread<mpmc_spin>();
+    test_single_thread<mpmc_blocking>();
+    test_frames<spsc_blocking>(tag, len, expected);
+    test_frames<mpmc_spin>(tag, len, expected);
+    test_threads<spsc_spin>(1, 1, 200000);
+    test_threads<spsc_blocking>(1, 1, 200000);
+    test_threads<mpmc_spin>(3, 3, 50000);
+    test_threads<mpmc_blocking>(3, 3, 50000);
+    test_threads<mpmc_blocking>(1, 4, 50000);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,420 @@
+// C++ wrapper tests: the wrapper must deliver the same frames as the C API,
+// own and release frame buffers, and build with and without exceptions.
+
+#include "id3v2parser.hpp"
+#include "synth_tag.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+static int failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+// Order-sensitive digest of the frames seen
+struct Digest {
+    uint32_t count = 0;
+    uint64_t hash = 0;
+
+    void add(const char *id, const uint8_t *data, uint32_t size) {
+        uint64_t h = hash * 1099511628211u;
+
+        for (; *id; id++) {
+            h = (h ^ static_cast<uint8_t>(*id)) * 1099511628211u;
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            h = (h ^ data[i]) * 1099511628211u;
+        }
+        hash = h ^ size;
+        count++;
+    }
+
+    bool operator==(const Digest &other) const {
+        return count == other.count && hash == other.hash;
+    }
+};
+
+static void digest_frame(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    static_cast<Digest *>(user_data)->add(id, data, size);
+}
+
+static size_t in_use() {
+    ID3MemoryStats stats;
+
+    id3_get_memory_stats(&stats);
+    return stats.in_use;
+}
+
+static void test_feed(const uint8_t *tag, size_t len, const Digest &expected) {
+    for (size_t chunk = 1; chunk <= len; chunk = chunk * 3 + 1) {
+        id3::Parser parser;
+        id3::Status status = id3::Status::More;
+        Digest digest;
+
+        for (size_t off = 0; off < len && status == id3::Status::More; off += chunk) {
+            status = parser.feed(tag + off, len - off < chunk ? len - off : chunk,
+                                 [&](const id3::FrameView &frame) {
+                                     digest.add(frame.id, frame.data, frame.size);
+                                 });
+        }
+        CHECK(status == id3::Status::Done);
+        CHECK(digest == expected);
+    }
+}
+
+// Frames taken with take_frame() outlive the parser and move between owners
+static void test_take_frame(const uint8_t *tag, size_t len, const Digest &expected) {
+    id3::FrameBuffer kept[4];
+    Digest digest;
+    size_t taken = 0;
+
+    {
+        id3::Parser parser;
+        id3::FrameView frame;
+        size_t used;
+
+        while (parser.next(tag, len, used, frame) == id3::Status::Frame) {
+            digest.add(frame.id, frame.data, frame.size);
+            if (taken < 4 && frame.size > 0) {
+                id3::FrameBuffer buffer = parser.take_frame();
+
+                CHECK(buffer.data() == frame.data && buffer.size() == frame.size);
+                kept[taken++] = std::move(buffer);
+            }
+            tag += used;
+            len -= used;
+        }
+        id3::Parser moved(std::move(parser));
+        CHECK(moved.need() == 0);
+    }
+    CHECK(digest == expected);
+    CHECK(taken == 4 && kept[0].data() != nullptr);
+    CHECK(in_use() > 0);
+    for (size_t i = 0; i < taken; i++) {
+        kept[i] = id3::FrameBuffer();
+    }
+    CHECK(in_use() == 0);
+}
+
+static void test_parse_buffer(const uint8_t *tag, size_t len, const Digest &expected) {
+    ID3FrameRef refs[64];
+    int count = id3_index_frames(tag, len, refs, 64);
+    Digest digest;
+    int seen = 0;
+
+    CHECK(id3::parse_buffer(tag, len, [&](const id3::FrameView &frame) {
+        digest.add(frame.id, frame.data, frame.size);
+        CHECK(seen >= 64 || frame.offset == refs[seen].offset);
+        seen++;
+    }) == id3::Status::Done);
+    CHECK(seen == count);
+    CHECK(digest == expected);
+}
+
+#if defined(__cpp_exceptions)
+// A handler that throws must not leak the frame buffer being delivered
+static void test_throw(const uint8_t *tag, size_t len) {
+    bool caught = false;
+
+    try {
+        id3::Parser parser;
+
+        parser.feed(tag, len, [](const id3::FrameView &frame) {
+            if (frame.size > 0) {
+                throw frame.size;
+            }
+        });
+    } catch (uint32_t) {
+        caught = true;
+    }
+    CHECK(caught);
+    CHECK(in_use() == 0);
+}
+#endif
+
+#ifdef ID3_HAS_PMR
+static void test_memory_resource(const uint8_t *tag, size_t len, const Digest &expected) {
+    std::pmr::unsynchronized_pool_resource pool;
+    id3::Parser parser;
+    Digest digest;
+
+    id3::set_memory_resource(&pool);
+    CHECK(parser.feed(tag, len, [&](const id3::FrameView &frame) {
+        digest.add(frame.id, frame.data, frame.size);
+    }) == id3::Status::Done);
+    id3::set_memory_resource(nullptr);
+    CHECK(digest == expected);
+}
+#endif
+
+#if __cplusplus >= 201703L
+// Compile-time engine handlers: every frame, and the title and artist only
+struct AllFrames {
+    using ids = id3::any_frame;
+
+    Digest digest;
+    uint64_t offsets[64] = {};
+
+    void operator()(const id3::FrameView &frame) {
+        if (digest.count < 64) {
+            offsets[digest.count] = frame.offset;
+        }
+        digest.add(frame.id, frame.data, frame.size);
+    }
+};
+
+struct TitleArtist {
+    using ids = id3::frame_ids<ID3_FOURCC('T', 'I', 'T', '2'), ID3_FOURCC('T', 'P', 'E', '1'),
+                               ID3_FOURCC('T', 'T', '2', 0), ID3_FOURCC('T', 'P', '1', 0)>;
+
+    Digest digest;
+
+    void operator()(const id3::FrameView &frame) { digest.add(frame.id, frame.data, frame.size); }
+};
+
+static void digest_title_artist(const char *id, const uint8_t *data, uint32_t size, void *user_data) {
+    static const char *const ids[] = { "TIT2", "TPE1", "TT2", "TP1" };
+
+    for (const char *wanted : ids) {
+        if (std::strcmp(id, wanted) == 0) {
+            static_cast<Digest *>(user_data)->add(id, data, size);
+        }
+    }
+}
+
+// At every chunk size, the engine must deliver what id3_parser_feed() does,
+// at the same offsets, and its filtered handler what a filtering callback sees
+static void test_engine(const uint8_t *tag, size_t len, const Digest &expected) {
+    static uint8_t stream[16 * 1024 + 40];
+    const size_t junk = 37;
+    ID3FrameRef refs[64];
+    int count = id3_index_frames(tag, len, refs, 64);
+    Digest filtered;
+
+    static_assert(id3::parser<TitleArtist>::wanted(ID3_FOURCC('T', 'I', 'T', '2')), "wanted");
+    static_assert(!id3::parser<TitleArtist>::wanted(ID3_FOURCC('A', 'P', 'I', 'C')), "not wanted");
+    id3_parse_buffer(tag, len, digest_title_artist, &filtered);
+    std::memset(stream, 'I', junk);
+    std::memcpy(stream + junk, tag, len);
+
+    for (size_t chunk = 1; chunk <= junk + len; chunk++) {
+        id3::parser<AllFrames, TitleArtist> parser{ AllFrames(), TitleArtist() };
+        id3::Status status = id3::Status::More;
+
+        parser.set_offset(1000);
+        for (size_t off = 0; off < junk + len && status == id3::Status::More; off += chunk) {
+            status = parser.feed(stream + off, std::min(chunk, junk + len - off));
+        }
+        CHECK(status == id3::Status::Done);
+        CHECK(parser.handler<AllFrames>().digest == expected);
+        CHECK(parser.handler<TitleArtist>().digest == filtered);
+        for (int f = 0; f < count && f < 64; f++) {
+            CHECK(parser.handler<AllFrames>().offsets[f] == 1000 + junk + refs[f].offset);
+        }
+    }
+    CHECK(in_use() == 0);
+}
+
+// Every wanted frame counts against the budget, buffered or handled in
+// place: one that does not fit is skipped or fails like in
+// id3_parser_feed(), and feeding the rest of the input after a failure
+// retries it
+static void test_engine_budget(const uint8_t *tag, size_t len, const Digest &expected) {
+    for (size_t chunk : { static_cast<size_t>(512), len }) {
+        id3_set_memory_budget(1000, ID3_BUDGET_SKIP);
+        {
+            id3::parser<AllFrames> parser{ AllFrames() };
+            id3::Status status = id3::Status::More;
+
+            for (size_t off = 0; off < len && status == id3::Status::More; off += chunk) {
+                status = parser.feed(tag + off, std::min(chunk, len - off));
+            }
+            CHECK(status == id3::Status::Done);
+            CHECK(parser.handler<AllFrames>().digest.count == expected.count - 1);
+        }
+        id3_set_memory_budget(1000, ID3_BUDGET_FAIL);
+        {
+            id3::parser<AllFrames> parser{ AllFrames() };
+            id3::Status status = id3::Status::More;
+            int errors = 0;
+
+            for (size_t off = 0; off < len && status == id3::Status::More;) {
+                size_t used;
+
+                status = parser.feed(tag + off, std::min(chunk, len - off), used);
+                off += used;
+                if (status == id3::Status::Error) {
+                    errors++;
+                    status = id3::Status::More;
+                    id3_set_memory_budget(0, ID3_BUDGET_FAIL); // Memory released elsewhere
+                }
+            }
+            CHECK(status == id3::Status::Done && errors == 1);
+            CHECK(parser.handler<AllFrames>().digest == expected);
+        }
+    }
+    id3_set_memory_budget(0, ID3_BUDGET_SKIP);
+    CHECK(in_use() == 0);
+}
+#endif
+
+#ifdef ID3_HAS_COROUTINES
+// Byte source over memory that suspends before every read, leaving the
+// coroutine for the test loop to resume as an event loop would
+class suspending_source {
+public:
+    struct read_awaiter {
+        suspending_source *source;
+        uint8_t *buffer;
+        size_t cap;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> waiting) const noexcept { source->pending = waiting; }
+        size_t await_resume() const noexcept {
+            size_t n = std::min(cap, std::min(source->chunk, source->len));
+
+            std::memcpy(buffer, source->data, n);
+            source->data += n;
+            source->len -= n;
+            return n;
+        }
+    };
+
+    suspending_source(const uint8_t *data, size_t len, size_t chunk) : data(data), len(len), chunk(chunk) {}
+
+    read_awaiter read(uint8_t *buffer, size_t cap) { return read_awaiter{ this, buffer, cap }; }
+
+    std::coroutine_handle<> pending;
+    const uint8_t *data;
+    size_t len;
+    size_t chunk;
+};
+
+template <typename Source>
+static id3::task<Digest> digest_frames(Source &source, id3::Status &status, size_t buffer_size) {
+    Digest digest;
+    id3::async_generator<id3::FrameView> stream = id3::frames(source, status, buffer_size);
+
+    while (const id3::FrameView *frame = co_await stream.next()) {
+        digest.add(frame->id, frame->data, frame->size);
+    }
+    co_return digest;
+}
+
+// Frames from the generator and from read_tag() must be those of the C API,
+// whether the source completes reads at once or suspends on each of them
+static void test_coroutines(const uint8_t *tag, size_t len, const Digest &expected) {
+    static const size_t buffer_sizes[] = { 1, 7, 4096 };
+
+    for (size_t buffer_size : buffer_sizes) {
+        id3::memory_source source(tag, len);
+        id3::Status status = id3::Status::Error;
+        id3::task<Digest> collect = digest_frames(source, status, buffer_size);
+
+        collect.start();
+        CHECK(collect.done());
+        CHECK(collect.result() == expected);
+        CHECK(status == id3::Status::Done);
+    }
+
+    {
+        suspending_source source(tag, len, 100);
+        id3::Status status = id3::Status::Error;
+        id3::task<Digest> collect = digest_frames(source, status, 64);
+        size_t suspensions = 0;
+
+        collect.start();
+        while (!collect.done()) {
+            std::coroutine_handle<> pending = source.pending;
+
+            source.pending = nullptr;
+            CHECK(pending != nullptr);
+            pending.resume();
+            suspensions++;
+        }
+        CHECK(collect.result() == expected);
+        CHECK(status == id3::Status::Done);
+        CHECK(suspensions >= len / 100);
+    }
+
+    {
+        id3::memory_source source(tag, len / 2);
+        id3::Status status = id3::Status::Error;
+        id3::task<Digest> collect = digest_frames(source, status, 512);
+
+        collect.start();
+        CHECK(collect.done());
+        CHECK(collect.result().count < expected.count);
+        CHECK(status == id3::Status::More);
+    }
+
+    {
+        suspending_source source(tag, len, 333);
+        id3::task<id3::tag> read = id3::read_tag(source, 256);
+        Digest digest;
+
+        read.start();
+        while (!read.done()) {
+            source.pending.resume();
+        }
+        id3::tag result = read.result();
+
+        CHECK(result.status == id3::Status::Done);
+        for (const id3::tag_frame &frame : result.frames) {
+            digest.add(frame.id, frame.data.data(), frame.data.size());
+        }
+        CHECK(digest == expected);
+        CHECK(in_use() > 0);
+    }
+    CHECK(in_use() == 0);
+}
+#endif
+
+int main() {
+    static const SynthTagSpec specs[] = {
+        { 2, 0, 10, 0, 0, 21 },
+        { 3, 1, 20, 3000, 64, 22 },
+        { 4, 0, 15, 700, 0, 23 },
+    };
+    static uint8_t tag[16 * 1024];
+
+    for (const SynthTagSpec &spec : specs) {
+        size_t len = synth_tag(tag, sizeof(tag), &spec);
+        Digest expected;
+
+        CHECK(id3_parse_buffer(tag, len, digest_frame, &expected) == ID3_DONE);
+        test_feed(tag, len, expected);
+        test_take_frame(tag, len, expected);
+        test_parse_buffer(tag, len, expected);
+#if defined(__cpp_exceptions)
+        test_throw(tag, len);
+#endif
+#ifdef ID3_HAS_PMR
+        test_memory_resource(tag, len, expected);
+#endif
+#if __cplusplus >= 201703L
+        test_engine(tag, len, expected);
+        if (spec.picture_size > 1000) {
+            test_engine_budget(tag, len, expected);
+        }
+#endif
+#ifdef ID3_HAS_COROUTINES
+        test_coroutines(tag, len, expected);
+#endif
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}